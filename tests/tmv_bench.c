@@ -0,0 +1,1211 @@
+/* tmv.h - v0.1 - public domain data structures - nickscha 2025
+
+A C89 standard compliant, single header, nostdlib (no C Standard Library) squarified tree map viewer (TMV).
+
+This Benchmark class measures the throughput of the tmv pipeline stages on generated trees.
+
+The suite at the end of main times each stage (depth sort, squarify, binary encode/decode and SVG)
+separately on reproducible tree shapes from 1k to TMV_BENCH_SUITE_MAX_ITEMS items. Build it like
+tests/build_bench.bat and the CI with
+
+  gcc -O2 -std=c89 -pthread -o tmv_bench tests/tmv_bench.c
+
+and -DTMV_BENCH_SUITE_MAX_ITEMS=1000000 to skip the 10M item trees (about 2 GB of memory). The
+_POSIX_C_SOURCE below declares the monotonic clock under -std=c89 too, the first line of the output
+names the wall clock in use.
+
+LICENSE
+
+  Placed in the public domain and also MIT licensed.
+  See end of file for detailed license information.
+
+*/
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 199309L /* clock_gettime */
+#endif
+
+#include "../tmv_parallel.h"
+#include "../tmv_platform_io.h" /* tmv_platform_time_us */
+#include "../tools/deps/vgg.h"  /* SVG writer of tmv_tools */
+
+#include <stdio.h>  /* printf */
+#include <stdlib.h> /* malloc, free */
+#include <string.h> /* memcpy */
+#include <time.h>   /* clock, clock_gettime */
+
+/* The clock behind tmv_platform_time_us, a platform that hides the monotonic clock falls back to gettimeofday */
+#if defined(_WIN32)
+#define TMV_BENCH_WALL_CLOCK "QueryPerformanceCounter"
+#elif defined(CLOCK_MONOTONIC)
+#define TMV_BENCH_WALL_CLOCK "clock_gettime(CLOCK_MONOTONIC)"
+#else
+#define TMV_BENCH_WALL_CLOCK "gettimeofday"
+#endif
+
+/* Above this count the quadratic legacy sort is not measured anymore */
+#define TMV_BENCH_LEGACY_MAX_ITEMS 100000
+
+/* Above this count the linear rect search of the layout diff is not measured anymore */
+#define TMV_BENCH_DIFF_LINEAR_MAX_ITEMS 20000
+
+/* Tree shapes of the suite */
+#define TMV_BENCH_SHAPE_UNIFORM 0    /* Random parents, uniform weights */
+#define TMV_BENCH_SHAPE_ZIPF 1       /* Random parents, Zipf distributed weights */
+#define TMV_BENCH_SHAPE_WIDE 2       /* One root with all other items as its children */
+#define TMV_BENCH_SHAPE_CHAIN 3      /* Each item is the only child of the previous one */
+#define TMV_BENCH_SHAPE_KARY 4       /* Balanced tree with TMV_BENCH_KARY children per item */
+#define TMV_BENCH_SHAPE_FILESYSTEM 5 /* Nested directories with heavy-tailed file sizes */
+#define TMV_BENCH_SHAPES 6
+
+#define TMV_BENCH_KARY 8
+
+#ifndef TMV_BENCH_SUITE_MAX_ITEMS
+#define TMV_BENCH_SUITE_MAX_ITEMS 10000000
+#endif
+
+/* Larger layouts are not written as SVG, 1M rects take about 150 MB */
+#define TMV_BENCH_SVG_MAX_ITEMS 1000000
+#define TMV_BENCH_SVG_CAPACITY (1024UL * 1024UL * 256UL)
+
+/* Small trees repeat each stage until about this many items went through it */
+#define TMV_BENCH_SUITE_MIN_ITEMS 1000000
+
+static unsigned long tmv_bench_seed = 1;
+
+/* Reproducible LCG so each run generates the same trees */
+static unsigned long tmv_bench_random(void)
+{
+  tmv_bench_seed = (tmv_bench_seed * 1103515245UL + 12345UL) & 0x7FFFFFFFUL;
+  return tmv_bench_seed;
+}
+
+static double tmv_bench_seconds(clock_t start)
+{
+  return (double)(clock() - start) / (double)CLOCKS_PER_SEC;
+}
+
+/* clock() sums the CPU time of all threads on POSIX, the parallel layout needs the wall time */
+static double tmv_bench_wall_seconds(void)
+{
+  return tmv_platform_time_us() * 1e-6;
+}
+
+/* A random tree where each item is attached to an earlier item (or is a root) */
+static void tmv_bench_generate_random_tree(tmv_item *items, unsigned long count)
+{
+  unsigned long i;
+
+  tmv_bench_seed = 1;
+
+  for (i = 0; i < count; ++i)
+  {
+    tmv_item item = {0};
+    item.id = (long)i;
+    item.parent_id = (i < 16) ? -1 : (long)(tmv_bench_random() % i);
+    item.weight = (tmv_real)(tmv_bench_random() % 100000 + 1);
+    items[i] = item;
+  }
+}
+
+/* The stable insertion sort tmv_items_depth_sort_offset used before the radix sort */
+static void tmv_bench_legacy_insertion_sort(tmv_item *items, unsigned long count)
+{
+  unsigned long i, j;
+
+  for (i = 1; i < count; ++i)
+  {
+    tmv_item key = items[i];
+    j = i;
+
+    while (j > 0)
+    {
+      tmv_item *prev = &items[j - 1];
+
+      int should_swap = (prev->children_offset_index > key.children_offset_index) ||
+                        (prev->children_offset_index == key.children_offset_index &&
+                         (prev->parent_id > key.parent_id || (prev->parent_id == key.parent_id && prev->weight < key.weight)));
+
+      if (!should_swap)
+      {
+        break;
+      }
+
+      items[j] = items[j - 1];
+      j--;
+    }
+
+    items[j] = key;
+  }
+}
+
+static void tmv_bench_sort(unsigned long count)
+{
+  tmv_item *source = (tmv_item *)malloc(count * sizeof(tmv_item));
+  tmv_item *work = (tmv_item *)malloc(count * sizeof(tmv_item));
+  unsigned long scratch_size = tmv_items_sort_scratch_size(count);
+  void *scratch = malloc(scratch_size);
+  clock_t start;
+  double seconds;
+
+  tmv_bench_generate_random_tree(source, count);
+
+  /* The sort input: depth in children_offset_index and position in children_count */
+  tmv_items_depth(source, count);
+
+  if (count <= TMV_BENCH_LEGACY_MAX_ITEMS)
+  {
+    memcpy(work, source, count * sizeof(tmv_item));
+    start = clock();
+    tmv_bench_legacy_insertion_sort(work, count);
+    seconds = tmv_bench_seconds(start);
+    printf("[bench][sort] %8lu items, insertion: %10.4fs\n", count, seconds);
+  }
+  else
+  {
+    printf("[bench][sort] %8lu items, insertion:    skipped\n", count);
+  }
+
+  memcpy(work, source, count * sizeof(tmv_item));
+  start = clock();
+  tmv_items_sort_layout(work, count, 0, 0);
+  seconds = tmv_bench_seconds(start);
+  printf("[bench][sort] %8lu items, heap:      %10.4fs\n", count, seconds);
+
+  memcpy(work, source, count * sizeof(tmv_item));
+  start = clock();
+  tmv_items_sort_layout(work, count, scratch, scratch_size);
+  seconds = tmv_bench_seconds(start);
+  printf("[bench][sort] %8lu items, radix:     %10.4fs\n", count, seconds);
+
+  free(source);
+  free(work);
+  free(scratch);
+}
+
+/* The row kernels on rows of TMV_BENCH_ROW_SIZE weights, scalar against the SIMD build (SSE2/AVX).
+   The sums are only vectorized with -DTMV_LANE_SUMS, otherwise they add up sequentially in both runs. */
+#define TMV_BENCH_ROW_SIZE 32
+
+static void tmv_bench_simd(unsigned long count, unsigned long repeat)
+{
+  tmv_real *weights = (tmv_real *)malloc(count * sizeof(tmv_real));
+  tmv_real *sizes = (tmv_real *)malloc(count * sizeof(tmv_real));
+  double sum = 0.0;
+  unsigned long i, r;
+  clock_t start;
+  double seconds;
+  double rects = (double)count * (double)repeat;
+
+  tmv_bench_seed = 1;
+
+  for (i = 0; i < count; ++i)
+  {
+    weights[i] = (tmv_real)(tmv_bench_random() % 100000 + 1);
+  }
+
+  start = clock();
+  for (r = 0; r < repeat; ++r)
+  {
+    for (i = 0; i + TMV_BENCH_ROW_SIZE <= count; i += TMV_BENCH_ROW_SIZE)
+    {
+      tmv_real scale = 1 / tmv_sum_scalar(&weights[i], sizeof(tmv_real), TMV_BENCH_ROW_SIZE);
+      tmv_row_sizes_scalar(&weights[i], TMV_BENCH_ROW_SIZE, scale, 3, &sizes[i]);
+    }
+    sum += (double)sizes[r % count];
+  }
+  seconds = tmv_bench_seconds(start);
+  printf("[bench][simd] %8lu items, scalar: %10.4fs, %8.1f M rects/s\n", count, seconds, rects / seconds * 1e-6);
+
+  start = clock();
+  for (r = 0; r < repeat; ++r)
+  {
+    for (i = 0; i + TMV_BENCH_ROW_SIZE <= count; i += TMV_BENCH_ROW_SIZE)
+    {
+      tmv_real scale = 1 / tmv_sum(&weights[i], TMV_BENCH_ROW_SIZE);
+      tmv_row_sizes(&weights[i], TMV_BENCH_ROW_SIZE, scale, 3, &sizes[i]);
+    }
+    sum += (double)sizes[r % count];
+  }
+  seconds = tmv_bench_seconds(start);
+  printf("[bench][simd] %8lu items, simd:   %10.4fs, %8.1f M rects/s (checksum %.3f)\n", count, seconds, rects / seconds * 1e-6, sum);
+
+  free(weights);
+  free(sizes);
+}
+
+static void tmv_bench_soa(unsigned long count)
+{
+  tmv_rect area = {0, 0.0, 0.0, 1920.0, 1080.0};
+  tmv_item *items = (tmv_item *)malloc(count * sizeof(tmv_item));
+  tmv_rect *rects = (tmv_rect *)malloc(count * sizeof(tmv_rect));
+  void *soa_memory = malloc(tmv_model_soa_memory_size(count));
+  clock_t start;
+  double seconds;
+
+  tmv_model model = {0};
+  tmv_model_soa model_soa = {0};
+
+  tmv_bench_generate_random_tree(items, count);
+  tmv_items_depth_sort_offset(items, count);
+
+  model.items = items;
+  model.items_count = count;
+  model.items_sorted = 1;
+  model.rects = rects;
+  model.rects_aligned = 1;
+
+  tmv_model_soa_init(&model_soa, soa_memory, tmv_model_soa_memory_size(count), count);
+  tmv_model_soa_from_items(&model_soa, items, count);
+
+  start = clock();
+  tmv_squarify(&model, area);
+  seconds = tmv_bench_seconds(start);
+  printf("[bench][layout] %8lu items, aos: %10.4fs\n", count, seconds);
+
+  start = clock();
+  tmv_squarify_soa(&model_soa, area);
+  seconds = tmv_bench_seconds(start);
+  printf("[bench][layout] %8lu items, soa: %10.4fs\n", count, seconds);
+
+  free(items);
+  free(rects);
+  free(soa_memory);
+}
+
+static void tmv_bench_parallel(unsigned long count)
+{
+  tmv_rect area = {0, 0.0, 0.0, 1920.0, 1080.0};
+  tmv_item *items = (tmv_item *)malloc(count * sizeof(tmv_item));
+  tmv_rect *rects = (tmv_rect *)malloc(count * sizeof(tmv_rect));
+  unsigned long threads_count;
+  double start;
+  double serial;
+
+  tmv_model model = {0};
+
+  tmv_bench_generate_random_tree(items, count);
+  tmv_items_depth_sort_offset(items, count);
+
+  /* Only the layout is measured, the items are sorted up front and the aligned
+     rects avoid the linear parent rect lookup */
+  model.items = items;
+  model.items_count = count;
+  model.items_sorted = 1;
+  model.rects = rects;
+  model.rects_aligned = 1;
+
+  start = tmv_bench_wall_seconds();
+  tmv_squarify(&model, area);
+  serial = tmv_bench_wall_seconds() - start;
+  printf("[bench][parallel] %8lu items, serial:     %10.4fs\n", count, serial);
+
+  for (threads_count = 1; threads_count <= 16; threads_count *= 2)
+  {
+    double seconds;
+
+    start = tmv_bench_wall_seconds();
+    tmv_squarify_parallel(&model, area, threads_count);
+    seconds = tmv_bench_wall_seconds() - start;
+    printf("[bench][parallel] %8lu items, %2lu threads: %10.4fs (%5.2fx)\n", count, threads_count, seconds, serial / seconds);
+  }
+
+  free(items);
+  free(rects);
+}
+
+/* Many small independent models, tmv_squarify one by one against tmv_squarify_batch */
+static void tmv_bench_batch(unsigned long models_count, unsigned long items_per_model)
+{
+  unsigned long count = models_count * items_per_model;
+  tmv_item *items = (tmv_item *)malloc(count * sizeof(tmv_item));
+  tmv_item *items_source = (tmv_item *)malloc(items_per_model * sizeof(tmv_item));
+  tmv_rect *rects = (tmv_rect *)malloc(count * sizeof(tmv_rect));
+  tmv_model *models = (tmv_model *)malloc(models_count * sizeof(tmv_model));
+  tmv_rect *areas = (tmv_rect *)malloc(models_count * sizeof(tmv_rect));
+  double *seconds = (double *)malloc(models_count * sizeof(double));
+  unsigned long threads_count;
+  unsigned long i;
+  double start;
+  double serial;
+
+  tmv_bench_generate_random_tree(items_source, items_per_model);
+
+  for (i = 0; i < models_count; ++i)
+  {
+    tmv_model model = {0};
+    tmv_rect area = {0, 0.0, 0.0, 320.0, 200.0};
+
+    model.items = &items[i * items_per_model];
+    model.items_count = items_per_model;
+    model.rects = &rects[i * items_per_model];
+    model.rects_aligned = 1;
+
+    models[i] = model;
+    areas[i] = area;
+  }
+
+  /* Every run starts from the unsorted items */
+  for (i = 0; i < models_count; ++i)
+  {
+    memcpy(models[i].items, items_source, items_per_model * sizeof(tmv_item));
+  }
+
+  start = tmv_bench_wall_seconds();
+  for (i = 0; i < models_count; ++i)
+  {
+    tmv_squarify(&models[i], areas[i]);
+  }
+  serial = tmv_bench_wall_seconds() - start;
+  printf("[bench][batch]    %6lu x %4lu items, serial:     %10.4fs\n", models_count, items_per_model, serial);
+
+  for (threads_count = 1; threads_count <= 16; threads_count *= 2)
+  {
+    double slowest = 0.0;
+    double elapsed;
+
+    for (i = 0; i < models_count; ++i)
+    {
+      memcpy(models[i].items, items_source, items_per_model * sizeof(tmv_item));
+      models[i].items_sorted = 0;
+    }
+
+    start = tmv_bench_wall_seconds();
+    tmv_squarify_batch(models, areas, models_count, threads_count, seconds);
+    elapsed = tmv_bench_wall_seconds() - start;
+
+    for (i = 0; i < models_count; ++i)
+    {
+      slowest = (seconds[i] > slowest) ? seconds[i] : slowest;
+    }
+
+    printf("[bench][batch]    %6lu x %4lu items, %2lu threads: %10.4fs (%5.2fx), slowest model: %8.6fs\n",
+           models_count, items_per_model, threads_count, elapsed, serial / elapsed, slowest);
+  }
+
+  free(items);
+  free(items_source);
+  free(rects);
+  free(models);
+  free(areas);
+  free(seconds);
+}
+
+/* Live updates that move weight between two siblings, their ancestors keep their weight */
+static void tmv_bench_relayout(unsigned long count, unsigned long updates)
+{
+  tmv_rect area = {0, 0.0, 0.0, 1920.0, 1080.0};
+  tmv_item *items = (tmv_item *)malloc(count * sizeof(tmv_item));
+  tmv_rect *rects = (tmv_rect *)malloc(count * sizeof(tmv_rect));
+  unsigned char *dirty = (unsigned char *)malloc(count);
+  void *index_memory = malloc(tmv_index_memory_size(count));
+  tmv_rect_range ranges[64];
+  unsigned long ranges_count = 0;
+  unsigned long i;
+  clock_t start;
+  double full;
+  double seconds;
+
+  tmv_model model = {0};
+  tmv_index index = {0};
+
+  tmv_bench_generate_random_tree(items, count);
+  tmv_index_init(&index, index_memory, tmv_index_memory_size(count), count);
+
+  model.items = items;
+  model.items_count = count;
+  model.rects = rects;
+  model.rects_aligned = 1;
+  model.index = &index;
+  model.dirty = dirty;
+
+  tmv_squarify(&model, area);
+
+  start = clock();
+  tmv_squarify(&model, area);
+  full = tmv_bench_seconds(start);
+
+  start = clock();
+  for (i = 0; i < updates; ++i)
+  {
+    tmv_item *item = &items[tmv_bench_random() % count];
+
+    if (item->children_count > 1)
+    {
+      tmv_item *a = &items[item->children_offset_index];
+      tmv_item *b = &items[item->children_offset_index + item->children_count - 1];
+      tmv_real moved = b->weight / 2;
+
+      tmv_update_weight(&model, a->id, a->weight - moved);
+      tmv_update_weight(&model, b->id, b->weight + moved);
+    }
+  }
+  ranges_count = tmv_relayout_dirty(&model, area, ranges, 64);
+  seconds = tmv_bench_seconds(start);
+
+  printf("[bench][relayout] %8lu items, full: %10.4fs, %4lu updates: %10.4fs (%lu ranges)\n", count, full, updates, seconds, ranges_count);
+
+  free(items);
+  free(rects);
+  free(dirty);
+  free(index_memory);
+}
+
+static void tmv_bench_subtree(unsigned long count, unsigned long zooms)
+{
+  tmv_rect area = {0, 0.0, 0.0, 1920.0, 1080.0};
+  tmv_item *items = (tmv_item *)malloc(count * sizeof(tmv_item));
+  tmv_rect *rects = (tmv_rect *)malloc(count * sizeof(tmv_rect));
+  void *index_memory = malloc(tmv_index_memory_size(count));
+  unsigned long visible = 0;
+  unsigned long i;
+  clock_t start;
+  double full;
+  double seconds;
+
+  tmv_model model = {0};
+  tmv_index index = {0};
+
+  tmv_bench_generate_random_tree(items, count);
+  tmv_index_init(&index, index_memory, tmv_index_memory_size(count), count);
+
+  model.items = items;
+  model.items_count = count;
+  model.rects = rects;
+  model.index = &index;
+
+  tmv_squarify(&model, area);
+
+  start = clock();
+  tmv_squarify(&model, area);
+  full = tmv_bench_seconds(start);
+
+  /* Zoom into random items two levels deep, the rects are in emission order so rects_count is what is visible */
+  start = clock();
+  for (i = 0; i < zooms; ++i)
+  {
+    tmv_squarify_subtree(&model, items[tmv_bench_random() % count].id, area, 2);
+    visible += model.rects_count;
+  }
+  seconds = tmv_bench_seconds(start);
+
+  printf("[bench][subtree]  %8lu items, full: %10.4fs, %4lu zooms: %10.4fs (%lu rects)\n", count, full, zooms, seconds, visible);
+
+  free(items);
+  free(rects);
+  free(index_memory);
+}
+
+static void tmv_bench_engines(unsigned long count)
+{
+  static const char *names[] = {"squarify", "slice_dice", "strip", "pivot"};
+
+  tmv_rect area = {0, 0.0, 0.0, 1920.0, 1080.0};
+  tmv_item *items = (tmv_item *)malloc(count * sizeof(tmv_item));
+  tmv_rect *rects = (tmv_rect *)malloc(count * sizeof(tmv_rect));
+  void *scratch = malloc(tmv_items_sort_scratch_size(count));
+  int engine;
+
+  tmv_model model = {0};
+
+  tmv_bench_generate_random_tree(items, count);
+
+  model.items = items;
+  model.items_count = count;
+  model.rects = rects;
+  model.rects_aligned = 1;
+  model.scratch = scratch;
+  model.scratch_size = tmv_items_sort_scratch_size(count);
+
+  /* Sort once so only the layout is measured, the ordered engines keep the weight order of that sort */
+  tmv_squarify(&model, area);
+
+  for (engine = TMV_LAYOUT_SQUARIFY; engine <= TMV_LAYOUT_PIVOT; ++engine)
+  {
+    double aspect_sum = 0.0;
+    unsigned long aspect_count = 0;
+    unsigned long i;
+    clock_t start;
+    double seconds;
+
+    model.layout_engine = engine;
+
+    start = clock();
+    tmv_squarify(&model, area);
+    seconds = tmv_bench_seconds(start);
+
+    /* Mean aspect ratio of the visible leaves */
+    for (i = 0; i < count; ++i)
+    {
+      double w = (double)rects[i].width;
+      double h = (double)rects[i].height;
+
+      if (items[i].children_count == 0 && rects[i].id == items[i].id && w > 0.0 && h > 0.0)
+      {
+        aspect_sum += (w > h) ? w / h : h / w;
+        ++aspect_count;
+      }
+    }
+
+    printf("[bench][engine]   %8lu items, %-10s: %10.4fs, %8.2f M items/s, mean aspect ratio: %12.2f\n",
+           count, names[engine], seconds, (double)count / (seconds > 0.0 ? seconds : 1e-9) / 1e6,
+           aspect_count ? aspect_sum / (double)aspect_count : 0.0);
+  }
+
+  free(items);
+  free(rects);
+  free(scratch);
+}
+
+/* Point queries on a full layout, tmv_hit_test against testing every rect */
+static void tmv_bench_hit_test(unsigned long count, unsigned long queries)
+{
+  tmv_rect area = {0, 0.0, 0.0, 1920.0, 1080.0};
+  tmv_item *items = (tmv_item *)malloc(count * sizeof(tmv_item));
+  tmv_rect *rects = (tmv_rect *)malloc(count * sizeof(tmv_rect));
+  tmv_real *points = (tmv_real *)malloc(2 * queries * sizeof(tmv_real));
+  unsigned long hits_tree = 0;
+  unsigned long hits_linear = 0;
+  unsigned long path[64];
+  unsigned long i;
+  clock_t start;
+  double tree;
+  double linear;
+
+  tmv_model model = {0};
+
+  tmv_bench_generate_random_tree(items, count);
+
+  model.items = items;
+  model.items_count = count;
+  model.rects = rects;
+  model.rects_aligned = 1;
+
+  tmv_squarify(&model, area);
+
+  for (i = 0; i < queries; ++i)
+  {
+    points[2 * i] = (tmv_real)(tmv_bench_random() % 1920);
+    points[2 * i + 1] = (tmv_real)(tmv_bench_random() % 1080);
+  }
+
+  start = clock();
+  for (i = 0; i < queries; ++i)
+  {
+    unsigned long depth = tmv_hit_test(&model, points[2 * i], points[2 * i + 1], path, 64);
+    hits_tree += depth ? path[(depth < 64) ? depth - 1 : 63] : 0;
+  }
+  tree = tmv_bench_seconds(start);
+
+  /* The items are sorted by depth, the last rect containing the point is the deepest */
+  start = clock();
+  for (i = 0; i < queries; ++i)
+  {
+    unsigned long hit = 0;
+    unsigned long r;
+
+    for (r = 0; r < count; ++r)
+    {
+      if (rects[r].id == items[r].id && tmv_rect_contains(&rects[r], points[2 * i], points[2 * i + 1]))
+      {
+        hit = r;
+      }
+    }
+    hits_linear += hit;
+  }
+  linear = tmv_bench_seconds(start);
+
+  printf("[bench][hit_test] %8lu rects, %6lu queries, tree: %10.4fs, linear: %10.4fs, speedup: %8.1fx (%s)\n",
+         count, queries, tree, linear, linear / (tree > 0.0 ? tree : 1e-9), hits_tree == hits_linear ? "same hits" : "MISMATCH");
+
+  free(items);
+  free(rects);
+  free(points);
+}
+
+/* Layout from flat id/parent_id items (depth sort + layout) against compressed sparse row input */
+static void tmv_bench_csr(unsigned long count)
+{
+  tmv_rect area = {0, 0.0, 0.0, 1920.0, 1080.0};
+  unsigned long scratch_size = tmv_items_sort_scratch_size(count);
+  tmv_item *nodes = (tmv_item *)malloc(count * sizeof(tmv_item));
+  tmv_item *items = (tmv_item *)malloc(count * sizeof(tmv_item));
+  tmv_rect *rects = (tmv_rect *)malloc(count * sizeof(tmv_rect));
+  unsigned long *child_offsets = (unsigned long *)malloc((count + 1) * sizeof(unsigned long));
+  unsigned long *child_indices = (unsigned long *)malloc(count * sizeof(unsigned long));
+  void *scratch = malloc(scratch_size);
+  unsigned long i;
+  clock_t start;
+  double flat;
+  double csr;
+  int valid;
+
+  tmv_model model = {0};
+
+  tmv_bench_generate_random_tree(nodes, count);
+
+  /* The producer side: a counting sort of the nodes by parent, the ids are the indices */
+  for (i = 0; i <= count; ++i)
+  {
+    child_offsets[i] = 0;
+  }
+  for (i = 0; i < count; ++i)
+  {
+    if (nodes[i].parent_id >= 0)
+    {
+      child_offsets[nodes[i].parent_id + 1]++;
+    }
+  }
+  for (i = 0; i < count; ++i)
+  {
+    child_offsets[i + 1] += child_offsets[i];
+  }
+  for (i = 0; i < count; ++i)
+  {
+    if (nodes[i].parent_id >= 0)
+    {
+      child_indices[child_offsets[nodes[i].parent_id]++] = i;
+    }
+  }
+  for (i = count; i > 0; --i)
+  {
+    child_offsets[i] = child_offsets[i - 1];
+  }
+  child_offsets[0] = 0;
+
+  model.items = items;
+  model.items_count = count;
+  model.rects = rects;
+  model.rects_aligned = 1;
+  model.scratch = scratch;
+  model.scratch_size = scratch_size;
+
+  memcpy(items, nodes, count * sizeof(tmv_item));
+  start = clock();
+  tmv_squarify(&model, area);
+  flat = tmv_bench_seconds(start);
+
+  model.items_sorted = 0;
+  start = clock();
+  valid = tmv_items_from_csr(items, nodes, count, child_offsets, child_indices) && tmv_model_presorted(&model);
+  tmv_squarify(&model, area);
+  csr = tmv_bench_seconds(start);
+
+  printf("[bench][csr]      %8lu items, flat: %10.4fs, csr: %10.4fs, speedup: %6.2fx (%s)\n",
+         count, flat, csr, flat / (csr > 0.0 ? csr : 1e-9), valid ? "presorted" : "INVALID");
+
+  free(nodes);
+  free(items);
+  free(rects);
+  free(child_offsets);
+  free(child_indices);
+  free(scratch);
+}
+
+/* Visiting random subtrees, walking the children offsets of the layout order against a DFS preorder slice */
+static void tmv_bench_preorder(unsigned long count, unsigned long subtrees)
+{
+  tmv_rect area = {0, 0.0, 0.0, 1920.0, 1080.0};
+  unsigned long scratch_size = tmv_items_sort_scratch_size(count);
+  tmv_item *items = (tmv_item *)malloc(count * sizeof(tmv_item));
+  tmv_item *preorder = (tmv_item *)malloc(count * sizeof(tmv_item));
+  tmv_rect *rects = (tmv_rect *)malloc(count * sizeof(tmv_rect));
+  unsigned long *subtree_sizes = (unsigned long *)malloc(count * sizeof(unsigned long));
+  unsigned long *positions = (unsigned long *)malloc(count * sizeof(unsigned long));
+  unsigned long *stack = (unsigned long *)malloc(count * sizeof(unsigned long));
+  void *scratch = malloc(scratch_size);
+  double sum_layout = 0.0;
+  double sum_preorder = 0.0;
+  unsigned long visited = 0;
+  unsigned long i;
+  unsigned long j;
+  clock_t start;
+  double convert;
+  double layout;
+  double slices;
+
+  tmv_model model = {0};
+
+  tmv_bench_generate_random_tree(items, count);
+
+  model.items = items;
+  model.items_count = count;
+  model.rects = rects;
+  model.rects_aligned = 1;
+  model.scratch = scratch;
+  model.scratch_size = scratch_size;
+
+  tmv_squarify(&model, area);
+
+  start = clock();
+  tmv_items_preorder(items, count, preorder, subtree_sizes);
+  convert = tmv_bench_seconds(start);
+
+  /* The layout position of each preorder item, the generated ids are the original indices */
+  for (i = 0; i < count; ++i)
+  {
+    positions[items[i].id] = i;
+  }
+
+  start = clock();
+  tmv_bench_seed = 7;
+  for (i = 0; i < subtrees; ++i)
+  {
+    unsigned long top = 1;
+
+    stack[0] = positions[preorder[tmv_bench_random() % count].id];
+
+    while (top > 0)
+    {
+      tmv_item *item = &items[stack[--top]];
+
+      sum_layout += (double)item->weight;
+      ++visited;
+
+      for (j = 0; j < item->children_count; ++j)
+      {
+        stack[top++] = item->children_offset_index + j;
+      }
+    }
+  }
+  layout = tmv_bench_seconds(start);
+
+  start = clock();
+  tmv_bench_seed = 7;
+  for (i = 0; i < subtrees; ++i)
+  {
+    unsigned long p = tmv_bench_random() % count;
+
+    for (j = p; j < p + subtree_sizes[p]; ++j)
+    {
+      sum_preorder += (double)preorder[j].weight;
+    }
+  }
+  slices = tmv_bench_seconds(start);
+
+  printf("[bench][preorder] %8lu items, convert: %10.4fs, %4lu subtrees (%lu items) layout order: %10.4fs, preorder: %10.4fs, speedup: %6.2fx (%s)\n",
+         count, convert, subtrees, visited, layout, slices, layout / (slices > 0.0 ? slices : 1e-9),
+         sum_layout == sum_preorder ? "same sums" : "MISMATCH");
+
+  free(items);
+  free(preorder);
+  free(rects);
+  free(subtree_sizes);
+  free(positions);
+  free(stack);
+  free(scratch);
+}
+
+/* The diff of two layouts after weight changes, the rects joined by the indices, by the sorted ids in the
+   scratch and by the linear search */
+static void tmv_bench_diff(unsigned long count, unsigned long updates)
+{
+  tmv_rect area = {0, 0.0, 0.0, 1920.0, 1080.0};
+  unsigned long scratch_size = tmv_items_sort_scratch_size(count);
+  tmv_item *items_old = (tmv_item *)malloc(count * sizeof(tmv_item));
+  tmv_item *items_new = (tmv_item *)malloc(count * sizeof(tmv_item));
+  tmv_rect *rects_old = (tmv_rect *)malloc(count * sizeof(tmv_rect));
+  tmv_rect *rects_new = (tmv_rect *)malloc(count * sizeof(tmv_rect));
+  tmv_change *changes = (tmv_change *)malloc(count * sizeof(tmv_change));
+  void *index_memory_old = malloc(tmv_index_memory_size(count));
+  void *index_memory_new = malloc(tmv_index_memory_size(count));
+  void *scratch = malloc(scratch_size);
+  unsigned long changes_indexed;
+  unsigned long changes_sorted;
+  unsigned long i;
+  clock_t start;
+  double indexed;
+  double sorted;
+
+  tmv_model model_old = {0};
+  tmv_model model_new = {0};
+  tmv_index index_old = {0};
+  tmv_index index_new = {0};
+
+  tmv_bench_generate_random_tree(items_old, count);
+  memcpy(items_new, items_old, count * sizeof(tmv_item));
+
+  for (i = 0; i < updates; ++i)
+  {
+    items_new[tmv_bench_random() % count].weight *= 2;
+  }
+
+  tmv_index_init(&index_old, index_memory_old, tmv_index_memory_size(count), count);
+  tmv_index_init(&index_new, index_memory_new, tmv_index_memory_size(count), count);
+
+  model_old.items = items_old;
+  model_old.items_count = count;
+  model_old.rects = rects_old;
+  model_old.rects_aligned = 1;
+  model_old.index = &index_old;
+  model_old.scratch = scratch;
+  model_old.scratch_size = scratch_size;
+
+  model_new = model_old;
+  model_new.items = items_new;
+  model_new.rects = rects_new;
+  model_new.index = &index_new;
+
+  tmv_squarify(&model_old, area);
+  tmv_squarify(&model_new, area);
+
+  start = clock();
+  changes_indexed = tmv_layout_diff(&model_old, &model_new, 0, changes, count);
+  indexed = tmv_bench_seconds(start);
+
+  model_old.index = 0;
+  model_new.index = 0;
+
+  start = clock();
+  changes_sorted = tmv_layout_diff(&model_old, &model_new, 0, changes, count);
+  sorted = tmv_bench_seconds(start);
+
+  printf("[bench][diff]     %8lu items, %8lu changes, index: %10.4fs, sorted: %10.4fs",
+         count, changes_indexed, indexed, sorted);
+
+  if (count <= TMV_BENCH_DIFF_LINEAR_MAX_ITEMS)
+  {
+    unsigned long changes_linear;
+    double linear;
+
+    model_old.scratch = 0;
+    model_new.scratch = 0;
+
+    start = clock();
+    changes_linear = tmv_layout_diff(&model_old, &model_new, 0, changes, count);
+    linear = tmv_bench_seconds(start);
+
+    printf(", linear: %10.4fs (%s)\n", linear, (changes_sorted == changes_indexed && changes_linear == changes_indexed) ? "same changes" : "MISMATCH");
+  }
+  else
+  {
+    printf(", linear:    skipped (%s)\n", changes_sorted == changes_indexed ? "same changes" : "MISMATCH");
+  }
+
+  free(items_old);
+  free(items_new);
+  free(rects_old);
+  free(rects_new);
+  free(changes);
+  free(index_memory_old);
+  free(index_memory_new);
+  free(scratch);
+}
+
+/* Generates one of the TMV_BENCH_SHAPE trees, the ids are the indices and parents come before their children */
+static void tmv_bench_generate_shape(tmv_item *items, unsigned long count, int shape)
+{
+  unsigned long i;
+
+  tmv_bench_seed = 1;
+
+  for (i = 0; i < count; ++i)
+  {
+    tmv_item item = {0};
+    item.id = (long)i;
+    item.parent_id = (i == 0) ? -1 : (long)(tmv_bench_random() % i);
+    item.weight = (tmv_real)(tmv_bench_random() % 100000 + 1);
+
+    switch (shape)
+    {
+    case TMV_BENCH_SHAPE_ZIPF:
+      /* 1 / rank with a uniform rank gives the Zipf frequencies, a few items hold most of the weight */
+      item.weight = (tmv_real)(1000000.0 / (double)(tmv_bench_random() % count + 1));
+      break;
+    case TMV_BENCH_SHAPE_WIDE:
+      item.parent_id = (i == 0) ? -1 : 0;
+      break;
+    case TMV_BENCH_SHAPE_CHAIN:
+      item.parent_id = (long)i - 1;
+      item.weight = (tmv_real)(count - i);
+      break;
+    case TMV_BENCH_SHAPE_KARY:
+      item.parent_id = (i == 0) ? -1 : (long)((i - 1) / TMV_BENCH_KARY);
+      break;
+    case TMV_BENCH_SHAPE_FILESYSTEM:
+      if (i > 0)
+      {
+        /* Half of the items land next to the recently created ones, files are never parents */
+        unsigned long recent = (i < 64) ? i : 64;
+        unsigned long p = (tmv_bench_random() & 1) ? i - 1 - tmv_bench_random() % recent : tmv_bench_random() % i;
+        item.parent_id = (items[p].weight > (tmv_real)0) ? items[p].parent_id : (long)p;
+      }
+
+      /* One item in ten is a directory, it weighs the sum of its files below.
+         File sizes are spread over 20 powers of two. */
+      item.weight = (i == 0 || tmv_bench_random() % 10 == 0) ? (tmv_real)0 : (tmv_real)((1UL << (tmv_bench_random() % 20)) + tmv_bench_random() % 1024);
+      break;
+    case TMV_BENCH_SHAPE_UNIFORM:
+    default:
+      /* Random parents and uniform weights as drawn above */
+      break;
+    }
+
+    items[i] = item;
+  }
+
+  if (shape == TMV_BENCH_SHAPE_FILESYSTEM)
+  {
+    for (i = count; i-- > 1;)
+    {
+      items[items[i].parent_id].weight += items[i].weight;
+    }
+  }
+}
+
+/* Writes the aligned rects as tmv_tools does, with the weight as data field and its color */
+static void tmv_bench_svg_write(vgg_svg_writer *w, tmv_model *model, tmv_rect area)
+{
+  static vgg_color color_start = {144, 224, 239};
+  static vgg_color color_end = {255, 85, 0};
+
+  unsigned long i;
+
+  vgg_svg_start(w, "tmvsvg", (double)area.width, (double)area.height);
+
+  for (i = 0; i < model->items_count; ++i)
+  {
+    tmv_item *item = &model->items[i];
+    tmv_rect *r = &model->rects[i];
+    char weight_buffer[32];
+    vgg_data_field data_fields[1];
+    vgg_rect rect = {0};
+
+    if (r->id != item->id)
+    {
+      continue;
+    }
+
+    data_fields[0] = vgg_data_field_create_double("weight", (double)item->weight, 3, weight_buffer);
+
+    rect.header.id = (unsigned int)r->id;
+    rect.header.type = VGG_TYPE_RECT;
+    rect.header.color_fill = vgg_color_map_linear((double)item->weight, (double)model->stats.weigth_min, (double)model->stats.weigth_max, color_start, color_end);
+    rect.header.data_fields = data_fields;
+    rect.header.data_fields_count = 1;
+    rect.x = (double)r->x;
+    rect.y = (double)r->y;
+    rect.width = (double)r->width;
+    rect.height = (double)r->height;
+
+    vgg_svg_element_add(w, (vgg_header *)&rect);
+  }
+
+  vgg_svg_end(w);
+}
+
+static double tmv_bench_items_per_second(unsigned long count, double seconds)
+{
+  return (double)count / (seconds > 0.0 ? seconds : 1e-9);
+}
+
+/* Times each pipeline stage on one generated tree and prints M items/s and bytes per item.
+   The decode points the model into the binary, its time does not grow with the items. */
+static void tmv_bench_suite_tree(int shape, unsigned long count, unsigned char *svg_buffer)
+{
+  static const char *names[] = {"uniform", "zipf", "wide", "chain", "k-ary", "filesystem"};
+
+  tmv_rect area = {0, 0.0, 0.0, 1920.0, 1080.0};
+  unsigned long scratch_size = tmv_items_sort_scratch_size(count);
+  unsigned long binary_capacity = TMV_BINARY_SIZE_HEADER + sizeof(tmv_rect) + sizeof(tmv_stats) + count * (sizeof(tmv_item) + sizeof(tmv_rect));
+  unsigned long binary_size = 0;
+  unsigned long repeat = (count < TMV_BENCH_SUITE_MIN_ITEMS) ? TMV_BENCH_SUITE_MIN_ITEMS / count : 1;
+  tmv_item *generated = (tmv_item *)malloc(count * sizeof(tmv_item));
+  tmv_item *items = (tmv_item *)malloc(count * sizeof(tmv_item));
+  tmv_rect *rects = (tmv_rect *)malloc(count * sizeof(tmv_rect));
+  void *scratch = malloc(scratch_size);
+  unsigned char *binary = (unsigned char *)malloc(binary_capacity);
+  double seconds[5] = {0.0, 0.0, 0.0, 0.0, 0.0};
+  double start;
+  unsigned long r;
+
+  tmv_model model = {0};
+  tmv_model decoded = {0};
+  tmv_rect decoded_area = {0};
+  vgg_svg_writer w = {0};
+
+  if (!generated || !items || !rects || !scratch || !binary)
+  {
+    printf("[bench][suite] %-10s %8lu items: out of memory\n", names[shape], count);
+    free(generated);
+    free(items);
+    free(rects);
+    free(scratch);
+    free(binary);
+    return;
+  }
+
+  tmv_bench_generate_shape(generated, count, shape);
+
+  /* Fault the output pages in up front, the stages should not measure the first touch of fresh memory */
+  memset(rects, 0, count * sizeof(tmv_rect));
+  memset(binary, 0, binary_capacity);
+
+  /* Each run sorts a fresh copy of the generated order */
+  for (r = 0; r < repeat; ++r)
+  {
+    memcpy(items, generated, count * sizeof(tmv_item));
+
+    start = tmv_platform_time_us();
+    tmv_items_depth_sort_offset_scratch(items, count, scratch, scratch_size);
+    seconds[0] += (tmv_platform_time_us() - start) * 1e-6;
+  }
+
+  model.items = items;
+  model.items_count = count;
+  model.items_sorted = 1;
+  model.rects = rects;
+  model.rects_aligned = 1;
+
+  start = tmv_platform_time_us();
+  for (r = 0; r < repeat; ++r)
+  {
+    tmv_squarify(&model, area);
+  }
+  seconds[1] = (tmv_platform_time_us() - start) * 1e-6;
+
+  start = tmv_platform_time_us();
+  for (r = 0; r < repeat; ++r)
+  {
+    tmv_binary_encode(binary, binary_capacity, &binary_size, &model, area);
+  }
+  seconds[2] = (tmv_platform_time_us() - start) * 1e-6;
+
+  start = tmv_platform_time_us();
+  for (r = 0; r < repeat; ++r)
+  {
+    tmv_binary_decode(binary, binary_size, &decoded, &decoded_area);
+  }
+  seconds[3] = (tmv_platform_time_us() - start) * 1e-6;
+
+  if (count <= TMV_BENCH_SVG_MAX_ITEMS)
+  {
+    w.buffer = svg_buffer;
+    w.capacity = (int)TMV_BENCH_SVG_CAPACITY;
+
+    start = tmv_platform_time_us();
+    for (r = 0; r < repeat; ++r)
+    {
+      w.length = 0;
+      tmv_bench_svg_write(&w, &model, area);
+    }
+    seconds[4] = (tmv_platform_time_us() - start) * 1e-6;
+  }
+
+  printf("[bench][suite] %-10s %8lu items | depth_sort %6.2f | squarify %6.2f | encode %7.2f M items/s, %5.1f bytes/item | decode %6.2f us",
+         names[shape], count,
+         tmv_bench_items_per_second(count * repeat, seconds[0]) / 1e6,
+         tmv_bench_items_per_second(count * repeat, seconds[1]) / 1e6,
+         tmv_bench_items_per_second(count * repeat, seconds[2]) / 1e6,
+         (double)binary_size / (double)count,
+         seconds[3] * 1e6 / (double)repeat);
+
+  if (count <= TMV_BENCH_SVG_MAX_ITEMS)
+  {
+    printf(" | svg %5.2f M items/s, %5.1f bytes/item%s\n",
+           tmv_bench_items_per_second(count * repeat, seconds[4]) / 1e6, (double)w.length / (double)count,
+           (w.length >= w.capacity) ? " (truncated)" : "");
+  }
+  else
+  {
+    printf(" | svg skipped\n");
+  }
+
+  free(generated);
+  free(items);
+  free(rects);
+  free(scratch);
+  free(binary);
+}
+
+static void tmv_bench_suite(void)
+{
+  unsigned char *svg_buffer = (unsigned char *)malloc(TMV_BENCH_SVG_CAPACITY);
+  unsigned long count;
+  int shape;
+
+  if (!svg_buffer)
+  {
+    printf("[bench][suite] out of memory\n");
+    return;
+  }
+
+  memset(svg_buffer, 0, TMV_BENCH_SVG_CAPACITY);
+
+  for (shape = 0; shape < TMV_BENCH_SHAPES; ++shape)
+  {
+    for (count = 1000; count <= TMV_BENCH_SUITE_MAX_ITEMS; count *= 10)
+    {
+      tmv_bench_suite_tree(shape, count, svg_buffer);
+    }
+  }
+
+  free(svg_buffer);
+}
+
+int main(void)
+{
+  printf("[bench] wall clock: %s\n", TMV_BENCH_WALL_CLOCK);
+
+  tmv_bench_sort(10000);
+  tmv_bench_sort(100000);
+  tmv_bench_sort(1000000);
+
+  tmv_bench_simd(100000, 100);
+  tmv_bench_soa(1000000);
+  tmv_bench_parallel(1000000);
+  tmv_bench_batch(10000, 200);
+  tmv_bench_relayout(1000000, 16);
+  tmv_bench_subtree(1000000, 1000);
+  tmv_bench_engines(1000000);
+  tmv_bench_hit_test(1000000, 1000);
+  tmv_bench_csr(1000000);
+  tmv_bench_preorder(1000000, 1000);
+  tmv_bench_diff(10000, 100);
+  tmv_bench_diff(1000000, 1000);
+
+  tmv_bench_suite();
+
+  return 0;
+}
+
+/*
+   ------------------------------------------------------------------------------
+   This software is available under 2 licenses -- choose whichever you prefer.
+   ------------------------------------------------------------------------------
+   ALTERNATIVE A - MIT License
+   Copyright (c) 2025 nickscha
+   Permission is hereby granted, free of charge, to any person obtaining a copy of
+   this software and associated documentation files (the "Software"), to deal in
+   the Software without restriction, including without limitation the rights to
+   use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+   of the Software, and to permit persons to whom the Software is furnished to do
+   so, subject to the following conditions:
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   ------------------------------------------------------------------------------
+   ALTERNATIVE B - Public Domain (www.unlicense.org)
+   This is free and unencumbered software released into the public domain.
+   Anyone is free to copy, modify, publish, use, compile, sell, or distribute this
+   software, either in source code form or as a compiled binary, for any purpose,
+   commercial or non-commercial, and by any means.
+   In jurisdictions that recognize copyright laws, the author or authors of this
+   software dedicate any and all copyright interest in the software to the public
+   domain. We make this dedication for the benefit of the public at large and to
+   the detriment of our heirs and successors. We intend this dedication to be an
+   overt act of relinquishment in perpetuity of all present and future rights to
+   this software under copyright law.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+   WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+   ------------------------------------------------------------------------------
+*/
@@ -0,0 +1,335 @@
+/* tmv.h - v0.1 - public domain data structures - nickscha 2025
+
+A C89 standard compliant, single header, nostdlib (no C Standard Library) squarified tree map viewer (TMV).
+
+This Test class verifies that the multi-threaded layout of tmv_parallel.h matches the serial layout.
+
+LICENSE
+
+  Placed in the public domain and also MIT licensed.
+  See end of file for detailed license information.
+
+*/
+#include "../tmv_parallel.h"
+
+#include "test.h" /* Simple Testing framework */
+
+#define TMV_PARALLEL_TEST_ITEMS 20000
+
+static tmv_item tmv_parallel_test_items[TMV_PARALLEL_TEST_ITEMS];
+static tmv_item tmv_parallel_test_items_serial[TMV_PARALLEL_TEST_ITEMS];
+static tmv_item tmv_parallel_test_items_parallel[TMV_PARALLEL_TEST_ITEMS];
+static tmv_rect tmv_parallel_test_rects_serial[TMV_PARALLEL_TEST_ITEMS];
+static tmv_rect tmv_parallel_test_rects_parallel[TMV_PARALLEL_TEST_ITEMS];
+static tmv_index_entry tmv_parallel_test_index_memory[2 * 32768];
+
+#define TMV_PARALLEL_TEST_MODELS 100
+static tmv_model tmv_parallel_test_models_serial[TMV_PARALLEL_TEST_MODELS];
+static tmv_model tmv_parallel_test_models_batch[TMV_PARALLEL_TEST_MODELS];
+static tmv_rect tmv_parallel_test_areas[TMV_PARALLEL_TEST_MODELS];
+static double tmv_parallel_test_seconds[TMV_PARALLEL_TEST_MODELS];
+#ifdef TMV_PROFILE
+static tmv_profile tmv_parallel_test_profiles_serial[TMV_PARALLEL_TEST_MODELS];
+static tmv_profile tmv_parallel_test_profiles_batch[TMV_PARALLEL_TEST_MODELS];
+#endif
+
+static unsigned long tmv_parallel_test_seed = 1;
+
+static unsigned long tmv_parallel_test_random(void)
+{
+  tmv_parallel_test_seed = (tmv_parallel_test_seed * 1103515245UL + 12345UL) & 0x7FFFFFFFUL;
+  return tmv_parallel_test_seed;
+}
+
+/* A random tree with shuffled ids, an orphan subtree and a parent cycle that are not laid out */
+void tmv_parallel_test_generate(unsigned long count)
+{
+  unsigned long i;
+
+  tmv_parallel_test_seed = 1;
+
+  for (i = 0; i < count; ++i)
+  {
+    tmv_item item = {0};
+    item.id = (long)(i * 7919 % count) + 100;
+    item.parent_id = (i < 8) ? -1 : (long)((tmv_parallel_test_random() % i) * 7919 % count) + 100;
+    item.weight = (tmv_real)((double)(tmv_parallel_test_random() % 1000 + 1) / 7.0);
+    tmv_parallel_test_items[i] = item;
+  }
+
+  tmv_parallel_test_items[count - 1].parent_id = 42;
+  tmv_parallel_test_items[count - 2].parent_id = tmv_parallel_test_items[count - 3].id;
+  tmv_parallel_test_items[count - 3].parent_id = tmv_parallel_test_items[count - 2].id;
+}
+
+unsigned long tmv_parallel_test_compare(tmv_model *serial, tmv_model *parallel)
+{
+  unsigned long mismatches = 0;
+  unsigned long i;
+
+  for (i = 0; i < serial->items_count; ++i)
+  {
+    tmv_item a = serial->items[i];
+    tmv_item b = parallel->items[i];
+
+    mismatches += (a.id != b.id || a.children_offset_index != b.children_offset_index || a.children_count != b.children_count);
+  }
+
+  for (i = 0; i < serial->rects_count; ++i)
+  {
+    tmv_rect a = serial->rects[i];
+    tmv_rect b = parallel->rects[i];
+
+    mismatches += (a.id != b.id || a.x != b.x || a.y != b.y || a.width != b.width || a.height != b.height);
+  }
+
+  return mismatches;
+}
+
+void tmv_parallel_test_layout(int rects_aligned, unsigned long threads_count, tmv_real min_side)
+{
+  tmv_rect area = {0, 0.0, 0.0, 1920.0, 1080.0};
+  unsigned long count = TMV_PARALLEL_TEST_ITEMS;
+  unsigned long i;
+  tmv_real weigth_sum;
+
+  tmv_index index_parallel = {0};
+
+  tmv_model serial = {0};
+  tmv_model parallel = {0};
+
+  for (i = 0; i < count; ++i)
+  {
+    tmv_parallel_test_items_serial[i] = tmv_parallel_test_items[i];
+    tmv_parallel_test_items_parallel[i] = tmv_parallel_test_items[i];
+  }
+
+  serial.items = tmv_parallel_test_items_serial;
+  serial.items_count = count;
+  serial.rects = tmv_parallel_test_rects_serial;
+  serial.rects_aligned = rects_aligned;
+  serial.min_side = min_side;
+
+  parallel = serial;
+  parallel.items = tmv_parallel_test_items_parallel;
+  parallel.rects = tmv_parallel_test_rects_parallel;
+
+  assert(tmv_index_init(&index_parallel, tmv_parallel_test_index_memory, sizeof(tmv_parallel_test_index_memory), count));
+  parallel.index = &index_parallel;
+
+  tmv_squarify(&serial, area);
+  assert(tmv_squarify_parallel(&parallel, area, 1));
+  weigth_sum = parallel.stats.weigth_sum;
+  assert(tmv_squarify_parallel(&parallel, area, threads_count));
+
+  /* Bit for bit the same rects, the leaves are summed per block so the sum only depends on the blocks */
+  assert(parallel.rects_count == serial.rects_count);
+  assert(parallel.rects_count == (rects_aligned ? count : count - 3) || min_side > 0);
+  assert(parallel.collapsed_count == serial.collapsed_count);
+  assert((serial.collapsed_count > 0) == (min_side > 0));
+  assert(tmv_parallel_test_compare(&serial, &parallel) == 0);
+  assert(parallel.stats.count == serial.stats.count);
+  assert(parallel.stats.weigth_min == serial.stats.weigth_min);
+  assert(parallel.stats.weigth_max == serial.stats.weigth_max);
+  assert(parallel.stats.weigth_sum == weigth_sum);
+  assert_equalsd((double)parallel.stats.weigth_sum, (double)serial.stats.weigth_sum, (double)serial.stats.weigth_sum * 1e-4);
+  assert(parallel.stats.weigth_sum == serial.stats.weigth_sum || min_side <= 0);
+
+  /* The index points at the rects written by the worker threads */
+  for (i = 0; i < count; ++i)
+  {
+    tmv_rect *expected = tmv_find_rect_by_id(serial.rects, serial.rects_count, serial.items[i].id);
+    tmv_rect *actual = tmv_model_find_rect_by_id(&parallel, serial.items[i].id);
+
+    if ((expected == 0) != (actual == 0) || (actual && actual->id != serial.items[i].id))
+    {
+      break;
+    }
+  }
+
+  assert(i == count);
+}
+
+/* Many small models and one that gets the shared scratch, each one has a slice of the item buffers */
+void tmv_parallel_test_batch(int rects_aligned, unsigned long threads_count)
+{
+  unsigned long offset = 0;
+  unsigned long i;
+  unsigned long j;
+  double wall;
+  double seconds_sum = 0.0;
+
+  tmv_parallel_test_seed = 7;
+
+  for (i = 0; i < TMV_PARALLEL_TEST_MODELS; ++i)
+  {
+    tmv_model model = {0};
+    tmv_rect area = {0, 0.0, 0.0, 0.0, 0.0};
+#ifdef TMV_PROFILE
+    tmv_profile profile = {0};
+#endif
+    unsigned long count = (i == 0) ? TMV_PARALLEL_BATCH_SCRATCH_MIN_ITEMS + 500 : 1 + (i * 37) % 300;
+
+    for (j = 0; j < count; ++j)
+    {
+      tmv_item item = {0};
+      item.id = (long)j;
+      item.parent_id = (j < 3) ? -1 : (long)(tmv_parallel_test_random() % j);
+      item.weight = (tmv_real)(tmv_parallel_test_random() % 1000 + 1);
+      tmv_parallel_test_items_serial[offset + j] = item;
+      tmv_parallel_test_items_parallel[offset + j] = item;
+    }
+
+    area.width = (tmv_real)(100 + i);
+    area.height = (tmv_real)(50 + 2 * i);
+    tmv_parallel_test_areas[i] = area;
+
+    model.items_count = count;
+    model.rects_aligned = rects_aligned;
+    model.min_side = (i % 3 == 0) ? 2 : 0;
+
+    model.items = &tmv_parallel_test_items_serial[offset];
+    model.rects = &tmv_parallel_test_rects_serial[offset];
+#ifdef TMV_PROFILE
+    tmv_parallel_test_profiles_serial[i] = profile;
+    tmv_parallel_test_profiles_batch[i] = profile;
+    model.profile = &tmv_parallel_test_profiles_serial[i];
+#endif
+    tmv_parallel_test_models_serial[i] = model;
+
+    model.items = &tmv_parallel_test_items_parallel[offset];
+    model.rects = &tmv_parallel_test_rects_parallel[offset];
+#ifdef TMV_PROFILE
+    /* Each model of the batch counts into its own profile */
+    model.profile = &tmv_parallel_test_profiles_batch[i];
+#endif
+    tmv_parallel_test_models_batch[i] = model;
+
+    tmv_parallel_test_seconds[i] = -1.0;
+
+    offset += count;
+  }
+
+  assert(offset <= TMV_PARALLEL_TEST_ITEMS);
+
+  for (i = 0; i < TMV_PARALLEL_TEST_MODELS; ++i)
+  {
+    tmv_squarify(&tmv_parallel_test_models_serial[i], tmv_parallel_test_areas[i]);
+  }
+
+  wall = tmv_platform_time_us();
+  assert(tmv_squarify_batch(tmv_parallel_test_models_batch, tmv_parallel_test_areas, TMV_PARALLEL_TEST_MODELS, threads_count, tmv_parallel_test_seconds));
+  wall = (tmv_platform_time_us() - wall) * 1e-6;
+
+  for (i = 0; i < TMV_PARALLEL_TEST_MODELS; ++i)
+  {
+    tmv_model *serial = &tmv_parallel_test_models_serial[i];
+    tmv_model *batch = &tmv_parallel_test_models_batch[i];
+
+    if (batch->rects_count != serial->rects_count || batch->collapsed_count != serial->collapsed_count ||
+        tmv_parallel_test_compare(serial, batch) != 0 || batch->stats.weigth_sum != serial->stats.weigth_sum ||
+        batch->scratch != 0 || tmv_parallel_test_seconds[i] < 0.0)
+    {
+      break;
+    }
+
+#ifdef TMV_PROFILE
+    /* The sort moves depend on the scratch the batch hands out, the other counters do not */
+    if (batch->profile->depth_steps != serial->profile->depth_steps || batch->profile->parent_lookups != serial->profile->parent_lookups ||
+        batch->profile->rows != serial->profile->rows || batch->profile->row_candidates != serial->profile->row_candidates ||
+        batch->profile->rows == 0)
+    {
+      break;
+    }
+#endif
+  }
+
+  assert(i == TMV_PARALLEL_TEST_MODELS);
+
+  /* Wall times, no model takes longer than the batch and the threads together spend at most
+     threads_count times the batch (a CPU clock would count the other threads as well) */
+  for (i = 0; i < TMV_PARALLEL_TEST_MODELS; ++i)
+  {
+    if (tmv_parallel_test_seconds[i] > wall + 1e-3)
+    {
+      break;
+    }
+    seconds_sum += tmv_parallel_test_seconds[i];
+  }
+
+  assert(i == TMV_PARALLEL_TEST_MODELS);
+  assert(seconds_sum <= wall * (double)threads_count + 1e-3);
+
+  /* A model that does not fit fails the batch, the others are still laid out */
+  tmv_parallel_test_models_batch[1].rects_aligned = 1;
+  tmv_parallel_test_models_batch[1].rects_capacity = 1;
+  tmv_parallel_test_models_batch[TMV_PARALLEL_TEST_MODELS - 1].rects_count = 0;
+
+  assert(!tmv_squarify_batch(tmv_parallel_test_models_batch, tmv_parallel_test_areas, TMV_PARALLEL_TEST_MODELS, threads_count, 0));
+  assert(tmv_parallel_test_models_batch[TMV_PARALLEL_TEST_MODELS - 1].rects_count == tmv_parallel_test_models_serial[TMV_PARALLEL_TEST_MODELS - 1].rects_count);
+}
+
+int main(void)
+{
+  tmv_parallel_test_generate(TMV_PARALLEL_TEST_ITEMS);
+
+  tmv_parallel_test_layout(0, 1, 0);
+  tmv_parallel_test_layout(0, 2, 0);
+  tmv_parallel_test_layout(0, 8, 0);
+  tmv_parallel_test_layout(1, 1, 0);
+  tmv_parallel_test_layout(1, 3, 0);
+  tmv_parallel_test_layout(1, 16, 0);
+
+  /* Subtrees below a pixel are collapsed */
+  tmv_parallel_test_layout(0, 4, 1);
+  tmv_parallel_test_layout(1, 4, 1);
+
+  /* Many small models at once */
+  tmv_parallel_test_batch(0, 1);
+  tmv_parallel_test_batch(0, 4);
+  tmv_parallel_test_batch(1, 3);
+  tmv_parallel_test_batch(1, 64);
+
+  return 0;
+}
+/*
+   ------------------------------------------------------------------------------
+   This software is available under 2 licenses -- choose whichever you prefer.
+   ------------------------------------------------------------------------------
+   ALTERNATIVE A - MIT License
+   Copyright (c) 2025 nickscha
+   Permission is hereby granted, free of charge, to any person obtaining a copy of
+   this software and associated documentation files (the "Software"), to deal in
+   the Software without restriction, including without limitation the rights to
+   use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+   of the Software, and to permit persons to whom the Software is furnished to do
+   so, subject to the following conditions:
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   ------------------------------------------------------------------------------
+   ALTERNATIVE B - Public Domain (www.unlicense.org)
+   This is free and unencumbered software released into the public domain.
+   Anyone is free to copy, modify, publish, use, compile, sell, or distribute this
+   software, either in source code form or as a compiled binary, for any purpose,
+   commercial or non-commercial, and by any means.
+   In jurisdictions that recognize copyright laws, the author or authors of this
+   software dedicate any and all copyright interest in the software to the public
+   domain. We make this dedication for the benefit of the public at large and to
+   the detriment of our heirs and successors. We intend this dedication to be an
+   overt act of relinquishment in perpetuity of all present and future rights to
+   this software under copyright law.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+   WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+   ------------------------------------------------------------------------------
+*/
@@ -14,7 +14,8 @@ LICENSE
 
 #include "test.h" /* Simple Testing framework */
 
-#define TVM_TEST_EPSILON 1e-6
+/* Float builds (-DTMV_REAL=float) carry about 7 significant digits */
+#define TVM_TEST_EPSILON ((tmv_real)(sizeof(tmv_real) == sizeof(float) ? 1e-3 : 1e-6))
 #define TMV_MAX_RECTS 1024
 
 void tmv_test_print_rects(tmv_rect *rects, unsigned long rect_count)
@@ -23,7 +24,7 @@ void tmv_test_print_rects(tmv_rect *rects, unsigned long rect_count)
   for (i = 0; i < rect_count; ++i)
   {
     tmv_rect rect = rects[i];
-    printf("id: %5lu, x: %5.2f, y: %5.2f, w: %5.2f, h: %5.2f\n", rect.id, rect.x, rect.y, rect.width, rect.height);
+    printf("id: %5lu, x: %5.2f, y: %5.2f, w: %5.2f, h: %5.2f\n", rect.id, (double)rect.x, (double)rect.y, (double)rect.width, (double)rect.height);
   }
 }
 
@@ -54,10 +55,10 @@ void tmv_test_simple_sort(void)
    and the item fields (id, parent_id, weight) are the original ones after the squarification */
   assert(model.items[1].id == 1);
   assert(model.items[1].parent_id == -1);
-  assert_equalsd(model.items[1].weight, 10.0, TVM_TEST_EPSILON);
-  assert_equalsd(model.stats.weigth_min, 1.0, TVM_TEST_EPSILON);
-  assert_equalsd(model.stats.weigth_max, 20.0, TVM_TEST_EPSILON);
-  assert_equalsd(model.stats.weigth_sum, 34.0, TVM_TEST_EPSILON);
+  assert_equalsd((double)model.items[1].weight, 10.0, (double)TVM_TEST_EPSILON);
+  assert_equalsd((double)model.stats.weigth_min, 1.0, (double)TVM_TEST_EPSILON);
+  assert_equalsd((double)model.stats.weigth_max, 20.0, (double)TVM_TEST_EPSILON);
+  assert_equalsd((double)model.stats.weigth_sum, 34.0, (double)TVM_TEST_EPSILON);
 
   assert(model.rects_count == 4);
 
@@ -184,7 +185,7 @@ void tmv_test_simple_recursive_layout(void)
 
   found = tmv_find_item_by_id(items, TMV_ARRAY_SIZE(items), 3);
   assert(found->id == 3);
-  assert_equalsd(found->weight, 10.0, TVM_TEST_EPSILON);
+  assert_equalsd((double)found->weight, 10.0, (double)TVM_TEST_EPSILON);
 }
 
 void tmv_test_simple_more_items(void)
@@ -226,7 +227,7 @@ void tmv_test_simple_more_items(void)
     tmv_rect rect = rects[i];
     if (i % 100 == 0)
     {
-      assert_equalsd(rect.width + rect.height, 8.0, TVM_TEST_EPSILON);
+      assert_equalsd((double)(rect.width + rect.height), 8.0, (double)TVM_TEST_EPSILON);
     }
   }
 }
@@ -291,7 +292,7 @@ void tmv_test_flat_tree(void)
            i,
            items[i].id,
            items[i].parent_id,
-           items[i].weight,
+           (double)items[i].weight,
            items[i].children_offset_index,
            items[i].children_count);
   }
@@ -303,17 +304,375 @@ void tmv_test_flat_tree(void)
   tmv_squarify(&model, area);
 
   search = tmv_find_item_by_id(model.items, model.items_count, 0);
-  assert_equalsd(search->weight, 20.0, TVM_TEST_EPSILON);
+  assert_equalsd((double)search->weight, 20.0, (double)TVM_TEST_EPSILON);
 
   search = tmv_find_item_by_id(model.items, model.items_count, 6);
-  assert_equalsd(search->weight, 3.5, TVM_TEST_EPSILON);
+  assert_equalsd((double)search->weight, 3.5, (double)TVM_TEST_EPSILON);
 
   search = tmv_find_item_by_id(model.items, model.items_count, 8);
-  assert_equalsd(search->weight, 1.75, TVM_TEST_EPSILON);
+  assert_equalsd((double)search->weight, 1.75, (double)TVM_TEST_EPSILON);
 
   tmv_test_print_rects(model.rects, model.rects_count);
 }
 
+void tmv_test_depth_sort_cycle(void)
+{
+  /* Layout
+     [0] p1
+       [1] c1
+     [2] x1 -> x2 -> x3 -> x1 (cycle)
+     [5] y1 -> x3             (hangs below the cycle)
+     [6] o1 -> 99             (orphan)
+  */
+  tmv_item items[] = {
+      {10, 11, 1.0, 0, 0},
+      {0, -1, 4.0, 0, 0},
+      {12, 10, 1.0, 0, 0},
+      {1, 0, 4.0, 0, 0},
+      {11, 12, 1.0, 0, 0},
+      {13, 12, 1.0, 0, 0},
+      {14, 99, 1.0, 0, 0}};
+
+  assert(tmv_items_depth_sort_offset(items, TMV_ARRAY_SIZE(items)) == 0);
+
+  /* Only the acyclic part is connected */
+  assert(items[0].id == 0);
+  assert(items[0].children_count == 1);
+  assert(items[items[0].children_offset_index].id == 1);
+  assert(items[items[0].children_offset_index].children_count == 0);
+
+  /* The first two items (root p1 and an orphan) are acyclic */
+  assert(tmv_items_depth_sort_offset(items, 2) == 1);
+}
+
+void tmv_test_sort_scratch(void)
+{
+  unsigned long i;
+
+  /* Enough scratch memory for the radix sort of 8 items */
+  unsigned long scratch[512];
+
+  tmv_item items[] = {
+      {5, 1, 2.5, 0, 0},
+      {2, -1, 10.0, 0, 0},
+      {6, 1, -1.0, 0, 0},
+      {1, -1, 10.0, 0, 0},
+      {7, 1, 0.5, 0, 0},
+      {3, -1, 30.0, 0, 0},
+      {8, 3, 0.0, 0, 0},
+      {4, -1, 0.25, 0, 0}};
+
+  tmv_item expected[TMV_ARRAY_SIZE(items)];
+
+  for (i = 0; i < TMV_ARRAY_SIZE(items); ++i)
+  {
+    expected[i] = items[i];
+  }
+
+  assert(tmv_items_sort_scratch_size(TMV_ARRAY_SIZE(items)) <= sizeof(scratch));
+
+  /* Radix sort and the in-place heap sort fallback agree, ties keep the input order (2 before 1) */
+  tmv_items_depth_sort_offset_scratch(items, TMV_ARRAY_SIZE(items), scratch, sizeof(scratch));
+  tmv_items_depth_sort_offset(expected, TMV_ARRAY_SIZE(expected));
+
+  for (i = 0; i < TMV_ARRAY_SIZE(items); ++i)
+  {
+    assert(items[i].id == expected[i].id);
+    assert(items[i].children_offset_index == expected[i].children_offset_index);
+    assert(items[i].children_count == expected[i].children_count);
+  }
+
+  assert(items[0].id == 3);
+  assert(items[1].id == 2);
+  assert(items[2].id == 1);
+  assert(items[3].id == 4);
+  assert(items[4].id == 5);
+  assert(items[5].id == 7);
+  assert(items[6].id == 6);
+  assert(items[7].id == 8);
+
+  /* Parent ids over the whole long range leave no bits for the depth in the packed key */
+  for (i = 0; i < TMV_ARRAY_SIZE(items); ++i)
+  {
+    long spread = (long)(~0UL >> 1) / 8;
+    items[i].id *= spread;
+    items[i].parent_id = (items[i].parent_id < 0) ? -(long)(~0UL >> 1) - 1 : items[i].parent_id * spread;
+    expected[i] = items[i];
+  }
+
+  tmv_items_depth_sort_offset_scratch(items, TMV_ARRAY_SIZE(items), scratch, sizeof(scratch));
+  tmv_items_depth_sort_offset(expected, TMV_ARRAY_SIZE(expected));
+
+  for (i = 0; i < TMV_ARRAY_SIZE(items); ++i)
+  {
+    assert(items[i].id == expected[i].id);
+    assert(items[i].children_offset_index == expected[i].children_offset_index);
+    assert(items[i].children_count == expected[i].children_count);
+  }
+}
+
+void tmv_test_index(void)
+{
+  unsigned long i;
+
+  tmv_rect area = {0, 0, 0, 100, 100};
+  tmv_rect rects[TMV_MAX_RECTS];
+
+  /* Memory for an index of 8 ids */
+  tmv_index_entry index_memory[16];
+  tmv_index index = {0};
+
+  tmv_item items[8] = {
+      {1, -1, 10.0, 0, 0},
+      {2, -1, 10.0, 0, 0},
+      {3, -1, 10.0, 0, 0},
+      {4, -1, 10.0, 0, 0},
+      {5, 1, 2.5, 0, 0},
+      {6, 1, 2.5, 0, 0},
+      {7, 1, 2.5, 0, 0},
+      {8, 1, 2.5, 0, 0}};
+
+  tmv_model model = {0};
+
+  assert(tmv_index_memory_size(TMV_ARRAY_SIZE(items)) <= sizeof(index_memory));
+  assert(tmv_index_init(&index, index_memory, sizeof(index_memory), TMV_ARRAY_SIZE(items)));
+  assert(!tmv_index_init(&index, index_memory, sizeof(index_memory) / 2, TMV_ARRAY_SIZE(items)));
+  assert(tmv_index_init(&index, index_memory, sizeof(index_memory), TMV_ARRAY_SIZE(items)));
+
+  model.rects = rects;
+  model.items = items;
+  model.items_count = TMV_ARRAY_SIZE(items);
+  model.index = &index;
+
+  tmv_squarify(&model, area);
+
+  /* Ids 1..8 are not dense */
+  assert(index.dense == 0);
+  assert(model.rects_count == 8);
+  assert(model.rects[4].id == 5 && model.rects[4].x == 0 && model.rects[4].y == 0 && model.rects[4].width == 25 && model.rects[4].height == 25);
+
+  for (i = 0; i < model.items_count; ++i)
+  {
+    assert(tmv_model_find_item_by_id(&model, model.items[i].id) == &model.items[i]);
+    assert(tmv_model_find_rect_by_id(&model, model.rects[i].id) == &model.rects[i]);
+  }
+  assert(tmv_model_find_item_by_id(&model, 0) == 0);
+  assert(tmv_model_find_rect_by_id(&model, 9) == 0);
+
+  /* Dense ids 0..n-1 are looked up directly */
+  for (i = 0; i < model.items_count; ++i)
+  {
+    model.items[i].id = (long)(model.items_count - 1 - i);
+  }
+  tmv_index_build(&index, &model);
+
+  assert(index.dense == 1);
+  for (i = 0; i < model.items_count; ++i)
+  {
+    assert(tmv_model_find_item_by_id(&model, (long)i) == &model.items[model.items_count - 1 - i]);
+  }
+  assert(tmv_model_find_item_by_id(&model, 8) == 0);
+  assert(tmv_model_find_item_by_id(&model, -1) == 0);
+}
+
+void tmv_test_rects_aligned(void)
+{
+  unsigned long i, j;
+
+  tmv_rect area = {0, 0.0, 0.0, 100.0, 100.0};
+  tmv_rect rects[TMV_MAX_RECTS];
+  tmv_rect rects_aligned[TMV_MAX_RECTS];
+
+  /* The flat tree of tmv_test_flat_tree and an orphan (10) */
+  tmv_item items[11] = {
+      {4, 1, 5.0, 0, 0},
+      {2, -1, 5.0, 0, 0},
+      {5, 1, 5.0, 0, 0},
+      {8, 6, 1.75, 0, 0},
+      {3, -1, 5.0, 0, 0},
+      {0, -1, 20.0, 0, 0},
+      {1, -1, 10.0, 0, 0},
+      {10, 42, 1.0, 0, 0},
+      {6, 3, 3.5, 0, 0},
+      {9, 6, 1.75, 0, 0},
+      {7, 3, 1.5, 0, 0}};
+
+  tmv_item items_aligned[11];
+
+  tmv_model model = {0};
+  tmv_model model_aligned = {0};
+
+  for (i = 0; i < TMV_ARRAY_SIZE(items); ++i)
+  {
+    items_aligned[i] = items[i];
+  }
+
+  model.items = items;
+  model.items_count = TMV_ARRAY_SIZE(items);
+  model.rects = rects;
+
+  model_aligned.items = items_aligned;
+  model_aligned.items_count = TMV_ARRAY_SIZE(items_aligned);
+  model_aligned.rects = rects_aligned;
+  model_aligned.rects_aligned = 1;
+
+  tmv_squarify(&model, area);
+  tmv_squarify(&model_aligned, area);
+
+  assert(model.rects_count == 10);
+  assert(model_aligned.rects_count == model_aligned.items_count);
+  assert(model_aligned.stats.count == model.stats.count);
+  assert(model_aligned.stats.weigth_sum == model.stats.weigth_sum);
+
+  for (i = 0; i < model_aligned.items_count; ++i)
+  {
+    tmv_rect *expected = tmv_find_rect_by_id(model.rects, model.rects_count, model_aligned.items[i].id);
+
+    if (model_aligned.items[i].id == 10)
+    {
+      /* The orphan has no rect */
+      assert(expected == 0);
+      assert(model_aligned.rects[i].id != 10);
+      assert(model_aligned.rects[i].width == 0 && model_aligned.rects[i].height == 0);
+      continue;
+    }
+
+    /* Same rect as the emission order layout, found at the item position */
+    assert(model_aligned.rects[i].id == model_aligned.items[i].id);
+    assert(expected->x == model_aligned.rects[i].x && expected->y == model_aligned.rects[i].y);
+    assert(expected->width == model_aligned.rects[i].width && expected->height == model_aligned.rects[i].height);
+    assert(tmv_model_find_rect_by_id(&model_aligned, model_aligned.items[i].id) == &model_aligned.rects[i]);
+  }
+
+  /* Children lie in the rect of their parent */
+  for (i = 0; i < model_aligned.items_count; ++i)
+  {
+    tmv_rect parent = model_aligned.rects[i];
+    for (j = 0; j < model_aligned.items[i].children_count; ++j)
+    {
+      tmv_rect child = model_aligned.rects[model_aligned.items[i].children_offset_index + j];
+      assert(child.x >= parent.x - TVM_TEST_EPSILON && child.x + child.width <= parent.x + parent.width + TVM_TEST_EPSILON);
+      assert(child.y >= parent.y - TVM_TEST_EPSILON && child.y + child.height <= parent.y + parent.height + TVM_TEST_EPSILON);
+    }
+  }
+}
+
+#define TMV_TEST_SOA_ITEMS 300
+
+tmv_item tmv_test_soa_items[TMV_TEST_SOA_ITEMS];
+tmv_rect tmv_test_soa_rects[TMV_TEST_SOA_ITEMS];
+tmv_rect tmv_test_soa_rects_soa[TMV_TEST_SOA_ITEMS];
+double tmv_test_soa_memory[TMV_TEST_SOA_ITEMS * 9];
+
+void tmv_test_model_soa(void)
+{
+  unsigned long i;
+
+  tmv_rect area = {0, 0.0, 0.0, 100.0, 60.0};
+  tmv_rect rects[TMV_MAX_RECTS];
+  tmv_rect rects_soa[TMV_MAX_RECTS];
+
+  /* The flat tree of tmv_test_flat_tree and an orphan (10) */
+  tmv_item items[11] = {
+      {4, 1, 5.0, 0, 0},
+      {2, -1, 5.0, 0, 0},
+      {5, 1, 5.0, 0, 0},
+      {8, 6, 1.75, 0, 0},
+      {3, -1, 5.0, 0, 0},
+      {0, -1, 20.0, 0, 0},
+      {1, -1, 10.0, 0, 0},
+      {10, 42, 1.0, 0, 0},
+      {6, 3, 3.5, 0, 0},
+      {9, 6, 1.75, 0, 0},
+      {7, 3, 1.5, 0, 0}};
+
+  tmv_item items_soa[11];
+
+  /* 5 doubles and 4 longs per item */
+  double soa_memory[11 * 9];
+
+  tmv_model model = {0};
+  tmv_model_soa model_soa = {0};
+
+  model.items = items;
+  model.items_count = TMV_ARRAY_SIZE(items);
+  model.rects = rects;
+  model.rects_aligned = 1;
+
+  tmv_squarify(&model, area);
+
+  assert(!tmv_model_soa_init(&model_soa, soa_memory, tmv_model_soa_memory_size(11) - 1, 11));
+  assert(tmv_model_soa_init(&model_soa, soa_memory, sizeof(soa_memory), 11));
+
+  tmv_model_soa_from_items(&model_soa, model.items, model.items_count);
+  tmv_squarify_soa(&model_soa, area);
+  tmv_model_soa_to_rects(&model_soa, rects_soa);
+
+  /* Same layout and statistics as the aligned mode */
+  assert(model_soa.stats.count == model.stats.count);
+  assert(model_soa.stats.weigth_min == model.stats.weigth_min);
+  assert(model_soa.stats.weigth_max == model.stats.weigth_max);
+  assert(model_soa.stats.weigth_sum == model.stats.weigth_sum);
+
+  for (i = 0; i < model.items_count; ++i)
+  {
+    assert(rects_soa[i].id == rects[i].id);
+    assert(rects_soa[i].x == rects[i].x && rects_soa[i].y == rects[i].y);
+    assert(rects_soa[i].width == rects[i].width && rects_soa[i].height == rects[i].height);
+  }
+
+  /* The orphan has no rect */
+  i = 0;
+  while (model_soa.ids[i] != 10)
+  {
+    ++i;
+  }
+  assert(model_soa.w[i] < 0);
+  assert(rects_soa[i].id == -11);
+
+  tmv_model_soa_to_items(&model_soa, items_soa);
+
+  for (i = 0; i < model.items_count; ++i)
+  {
+    assert(items_soa[i].id == items[i].id && items_soa[i].parent_id == items[i].parent_id);
+    assert(items_soa[i].weight == items[i].weight);
+    assert(items_soa[i].children_offset_index == items[i].children_offset_index);
+    assert(items_soa[i].children_count == items[i].children_count);
+  }
+
+  /* Weights without an exact binary representation in groups of many siblings, both layouts add
+     them up in the same order so the rects are still equal bit for bit */
+  for (i = 0; i < TMV_ARRAY_SIZE(tmv_test_soa_items); ++i)
+  {
+    tmv_item item = {0};
+    item.id = (long)i;
+    item.parent_id = (i < 7) ? -1 : (long)(i % 23);
+    item.weight = (tmv_real)1 / (tmv_real)(i % 9 + 3) + (tmv_real)(i % 13) * (tmv_real)0.1;
+    tmv_test_soa_items[i] = item;
+  }
+
+  model.items = tmv_test_soa_items;
+  model.items_count = TMV_ARRAY_SIZE(tmv_test_soa_items);
+  model.rects = tmv_test_soa_rects;
+  model.items_sorted = 0;
+
+  tmv_squarify(&model, area);
+
+  assert(tmv_model_soa_init(&model_soa, tmv_test_soa_memory, sizeof(tmv_test_soa_memory), model.items_count));
+  tmv_model_soa_from_items(&model_soa, model.items, model.items_count);
+  tmv_squarify_soa(&model_soa, area);
+  tmv_model_soa_to_rects(&model_soa, tmv_test_soa_rects_soa);
+
+  assert(model_soa.stats.weigth_sum == model.stats.weigth_sum);
+
+  for (i = 0; i < model.items_count; ++i)
+  {
+    assert(tmv_test_soa_rects_soa[i].id == tmv_test_soa_rects[i].id);
+    assert(tmv_test_soa_rects_soa[i].x == tmv_test_soa_rects[i].x && tmv_test_soa_rects_soa[i].y == tmv_test_soa_rects[i].y);
+    assert(tmv_test_soa_rects_soa[i].width == tmv_test_soa_rects[i].width && tmv_test_soa_rects_soa[i].height == tmv_test_soa_rects[i].height);
+  }
+}
+
 void tmv_test_binary_decode(void)
 {
   unsigned long i;
@@ -379,15 +738,16 @@ void tmv_test_binary_decode(void)
 
   /* Check area struct */
   assert(binary_area.id == area.id);
-  assert_equalsd(binary_area.x, area.x, TVM_TEST_EPSILON);
-  assert_equalsd(binary_area.y, area.y, TVM_TEST_EPSILON);
-  assert_equalsd(binary_area.width, area.width, TVM_TEST_EPSILON);
-  assert_equalsd(binary_area.height, area.height, TVM_TEST_EPSILON);
+  assert_equalsd((double)binary_area.x, (double)area.x, (double)TVM_TEST_EPSILON);
+  assert_equalsd((double)binary_area.y, (double)area.y, (double)TVM_TEST_EPSILON);
+  assert_equalsd((double)binary_area.width, (double)area.width, (double)TVM_TEST_EPSILON);
+  assert_equalsd((double)binary_area.height, (double)area.height, (double)TVM_TEST_EPSILON);
 
   /* Check model counts */
   assert(binary_model.items_count == model.items_count);
   assert(binary_model.items_user_data_size == model.items_user_data_size);
   assert(binary_model.rects_count == model.rects_count);
+  assert(binary_model.rects_aligned == model.rects_aligned);
 
   /* Check model stats */
   assert(binary_model.stats.weigth_min == model.stats.weigth_min);
@@ -400,17 +760,1881 @@ void tmv_test_binary_decode(void)
   {
     assert(binary_model.items[i].id == model.items[i].id);
     assert(binary_model.items[i].children_count == model.items[i].children_count);
-    assert_equalsd(binary_model.items[i].weight, model.items[i].weight, TVM_TEST_EPSILON);
+    assert_equalsd((double)binary_model.items[i].weight, (double)model.items[i].weight, (double)TVM_TEST_EPSILON);
   }
 
   /* Check model rects */
   for (i = 0; i < model.rects_count; ++i)
   {
     assert(binary_model.rects[i].id == model.rects[i].id);
-    assert_equalsd(binary_model.rects[i].x, model.rects[i].x, TVM_TEST_EPSILON);
-    assert_equalsd(binary_model.rects[i].y, model.rects[i].y, TVM_TEST_EPSILON);
-    assert_equalsd(binary_model.rects[i].width, model.rects[i].width, TVM_TEST_EPSILON);
-    assert_equalsd(binary_model.rects[i].height, model.rects[i].height, TVM_TEST_EPSILON);
+    assert_equalsd((double)binary_model.rects[i].x, (double)model.rects[i].x, (double)TVM_TEST_EPSILON);
+    assert_equalsd((double)binary_model.rects[i].y, (double)model.rects[i].y, (double)TVM_TEST_EPSILON);
+    assert_equalsd((double)binary_model.rects[i].width, (double)model.rects[i].width, (double)TVM_TEST_EPSILON);
+    assert_equalsd((double)binary_model.rects[i].height, (double)model.rects[i].height, (double)TVM_TEST_EPSILON);
+  }
+
+  /* A binary written with another TMV_REAL is rejected */
+  assert(binary_buffer[6] == sizeof(tmv_real));
+  binary_buffer[6] = (unsigned char)(sizeof(tmv_real) == sizeof(float) ? sizeof(double) : sizeof(float));
+  binary_model.items_count = 0;
+  tmv_binary_decode(binary_buffer, binary_buffer_size, &binary_model, &binary_area);
+  assert(binary_model.items_count == 0);
+}
+
+/* Lays out a copy of the items from scratch and compares it with the incremental layout */
+void tmv_test_relayout_compare(tmv_model *model, tmv_rect area)
+{
+  unsigned long i;
+
+  tmv_item items[16];
+  tmv_rect rects[16];
+  tmv_model fresh = {0};
+
+  for (i = 0; i < model->items_count; ++i)
+  {
+    items[i] = model->items[i];
+  }
+
+  fresh.items = items;
+  fresh.items_count = model->items_count;
+  fresh.rects = rects;
+  fresh.rects_aligned = model->rects_aligned;
+  fresh.min_side = model->min_side;
+
+  tmv_squarify(&fresh, area);
+
+  assert(fresh.rects_count == model->rects_count);
+  assert(fresh.collapsed_count == model->collapsed_count);
+  assert(fresh.stats.count == model->stats.count);
+  assert(fresh.stats.weigth_min == model->stats.weigth_min);
+  assert(fresh.stats.weigth_max == model->stats.weigth_max);
+  assert(fresh.stats.weigth_sum == model->stats.weigth_sum);
+
+  for (i = 0; i < fresh.items_count; ++i)
+  {
+    assert(fresh.items[i].id == model->items[i].id);
+    assert(fresh.items[i].weight == model->items[i].weight);
+  }
+
+  for (i = 0; i < fresh.rects_count; ++i)
+  {
+    assert(fresh.rects[i].id == model->rects[i].id);
+    assert(fresh.rects[i].x == model->rects[i].x && fresh.rects[i].y == model->rects[i].y);
+    assert(fresh.rects[i].width == model->rects[i].width && fresh.rects[i].height == model->rects[i].height);
+  }
+}
+
+void tmv_test_relayout_dirty(void)
+{
+  tmv_rect area = {0, 0.0, 0.0, 120.0, 80.0};
+  tmv_rect rects[TMV_MAX_RECTS];
+  tmv_rect_range ranges[8];
+  tmv_stats stats;
+  unsigned long ranges_count;
+
+  /* Parents weigh the sum of their children, all siblings have distinct weights */
+  tmv_item items[12] = {
+      {1, -1, 10.0, 0, 0},
+      {2, -1, 8.0, 0, 0},
+      {3, -1, 6.0, 0, 0},
+      {10, 1, 4.0, 0, 0},
+      {11, 1, 3.0, 0, 0},
+      {12, 1, 2.0, 0, 0},
+      {13, 1, 1.0, 0, 0},
+      {20, 2, 3.0, 0, 0},
+      {21, 2, 5.0, 0, 0},
+      {30, 20, 2.0, 0, 0},
+      {31, 20, 1.0, 0, 0},
+      {40, 42, 1.0, 0, 0}};
+
+  tmv_item items_emission[12];
+  unsigned char dirty[12];
+
+  tmv_index_entry index_memory[32];
+  tmv_index index = {0};
+
+  tmv_model model = {0};
+  tmv_item *item;
+  unsigned long i;
+
+  for (i = 0; i < TMV_ARRAY_SIZE(items); ++i)
+  {
+    items_emission[i] = items[i];
+  }
+
+  assert(tmv_index_init(&index, index_memory, sizeof(index_memory), TMV_ARRAY_SIZE(items)));
+
+  model.items = items;
+  model.items_count = TMV_ARRAY_SIZE(items);
+  model.rects = rects;
+  model.rects_aligned = 1;
+  model.index = &index;
+  model.dirty = dirty;
+
+  /* A second layout of a sorted model starts over with the stats */
+  tmv_squarify(&model, area);
+  stats = model.stats;
+  tmv_squarify(&model, area);
+  assert(model.stats.count == stats.count && model.stats.weigth_sum == stats.weigth_sum);
+  assert(model.rects_count == TMV_ARRAY_SIZE(items));
+
+  /* Two children of 1 swap places, 1 keeps its weight and rect */
+  assert(tmv_update_weight(&model, 13, 3.5));
+  assert(tmv_update_weight(&model, 10, 1.5));
+  assert(!tmv_update_weight(&model, 99, 1.0));
+  assert(tmv_model_find_item_by_id(&model, 1)->weight == 10);
+
+  ranges_count = tmv_relayout_dirty(&model, area, ranges, TMV_ARRAY_SIZE(ranges));
+
+  /* Only the roots and the children of 1 are written, the subtree of 2 did not move */
+  item = tmv_model_find_item_by_id(&model, 1);
+  assert(ranges_count == 2);
+  assert(ranges[0].offset == 0 && ranges[0].count == 3);
+  assert(ranges[1].offset == item->children_offset_index && ranges[1].count == item->children_count);
+  assert(model.items[item->children_offset_index].id == 13);
+  assert(tmv_model_find_rect_by_id(&model, 13) == &model.rects[item->children_offset_index]);
+
+  tmv_test_relayout_compare(&model, area);
+
+  /* A grandchild grows, its ancestors follow and the roots change their order */
+  assert(tmv_update_weight(&model, 30, 7.0));
+  assert(tmv_model_find_item_by_id(&model, 20)->weight == 8);
+  assert(tmv_model_find_item_by_id(&model, 2)->weight == 13);
+
+  ranges_count = tmv_relayout_dirty(&model, area, ranges, 1);
+  assert(ranges_count > 1);
+  assert(ranges[0].offset == 0);
+  assert(model.items[0].id == 2);
+
+  tmv_test_relayout_compare(&model, area);
+
+  /* Nothing changed, nothing is written */
+  assert(tmv_relayout_dirty(&model, area, ranges, TMV_ARRAY_SIZE(ranges)) == 0);
+
+  /* Emission order rects are laid out completely */
+  model.items = items_emission;
+  model.items_sorted = 0;
+  model.rects_aligned = 0;
+
+  tmv_squarify(&model, area);
+  assert(tmv_update_weight(&model, 31, 4.0));
+
+  ranges_count = tmv_relayout_dirty(&model, area, ranges, TMV_ARRAY_SIZE(ranges));
+  assert(ranges_count == 1);
+  assert(ranges[0].offset == 0 && ranges[0].count == model.rects_count);
+
+  tmv_test_relayout_compare(&model, area);
+
+  /* Without dirty flags the model is sorted again */
+  model.dirty = 0;
+  assert(tmv_update_weight(&model, 21, 0.5));
+  assert(model.items_sorted == 0);
+  assert(tmv_relayout_dirty(&model, area, ranges, TMV_ARRAY_SIZE(ranges)) == 1);
+
+  tmv_test_relayout_compare(&model, area);
+}
+
+void tmv_test_collapse(void)
+{
+  tmv_rect area = {0, 0.0, 0.0, 100.0, 100.0};
+  tmv_rect rects[TMV_MAX_RECTS];
+  tmv_rect_range ranges[8];
+
+  /* Root 2 ends up in a column less than a pixel wide */
+  tmv_item items[6] = {
+      {1, -1, 1000.0, 0, 0},
+      {2, -1, 1.0, 0, 0},
+      {3, -1, 2.0, 0, 0},
+      {20, 2, 0.75, 0, 0},
+      {21, 2, 0.25, 0, 0},
+      {30, 21, 0.25, 0, 0}};
+
+  tmv_item items_emission[6];
+  unsigned char dirty[6];
+  double soa_memory[6 * 9];
+
+  tmv_model model = {0};
+  tmv_model_soa model_soa = {0};
+  tmv_rect *rect;
+  unsigned long i;
+
+  for (i = 0; i < TMV_ARRAY_SIZE(items); ++i)
+  {
+    items_emission[i] = items[i];
+  }
+
+  model.items = items;
+  model.items_count = TMV_ARRAY_SIZE(items);
+  model.rects = rects;
+  model.rects_aligned = 1;
+  model.dirty = dirty;
+  model.min_side = 1;
+
+  tmv_squarify(&model, area);
+
+  /* The rect of 2 stands in for its subtree */
+  rect = tmv_model_find_rect_by_id(&model, 2);
+  assert(rect && tmv_collapsed(model.min_side, rect->width, rect->height));
+  assert(model.collapsed_count == 1);
+  assert(tmv_model_find_rect_by_id(&model, 20) == 0);
+  assert(tmv_model_find_rect_by_id(&model, 21) == 0);
+  assert(tmv_model_find_rect_by_id(&model, 30) == 0);
+  assert(model.stats.count == 3);
+  assert(model.stats.weigth_sum == 1003);
+
+  /* The structure of arrays layout collapses the same subtrees */
+  assert(tmv_model_soa_init(&model_soa, soa_memory, sizeof(soa_memory), model.items_count));
+  tmv_model_soa_from_items(&model_soa, model.items, model.items_count);
+  model_soa.min_side = model.min_side;
+  tmv_squarify_soa(&model_soa, area);
+
+  assert(model_soa.collapsed_count == 1);
+  assert(model_soa.stats.count == model.stats.count && model_soa.stats.weigth_sum == model.stats.weigth_sum);
+  for (i = 0; i < model.items_count; ++i)
+  {
+    assert((model_soa.w[i] >= 0) == (model.rects[i].id == model.items[i].id));
+  }
+
+  /* 2 grows and gets expanded, then shrinks and gets collapsed again */
+  assert(tmv_update_weight(&model, 1, 1.0));
+  tmv_relayout_dirty(&model, area, ranges, TMV_ARRAY_SIZE(ranges));
+  assert(model.collapsed_count == 0);
+  assert(tmv_model_find_rect_by_id(&model, 30) != 0);
+  tmv_test_relayout_compare(&model, area);
+
+  assert(tmv_update_weight(&model, 1, 1000.0));
+  tmv_relayout_dirty(&model, area, ranges, TMV_ARRAY_SIZE(ranges));
+  assert(model.collapsed_count == 1);
+  assert(tmv_model_find_rect_by_id(&model, 30) == 0);
+  tmv_test_relayout_compare(&model, area);
+
+  /* Emission order rects of collapsed subtrees are not written at all */
+  model.items = items_emission;
+  model.items_sorted = 0;
+  model.rects_aligned = 0;
+  model.dirty = 0;
+
+  tmv_squarify(&model, area);
+  assert(model.rects_count == 3);
+  assert(model.collapsed_count == 1);
+}
+
+int tmv_test_rect_equals(tmv_rect *a, tmv_rect *b)
+{
+  return a->id == b->id && a->x == b->x && a->y == b->y && a->width == b->width && a->height == b->height;
+}
+
+/* The tree the subtree, stream, hit test, diff, csr, preorder and profile tests share: two roots,
+   four levels and a group out of weight order (21 behind 1001) */
+#define TMV_TEST_TREE_ITEMS 13
+
+tmv_item tmv_test_tree[TMV_TEST_TREE_ITEMS] = {
+    {1, -1, 60.0, 0, 0},
+    {2, -1, 40.0, 0, 0},
+    {10, 1, 30.0, 0, 0},
+    {11, 1, 20.0, 0, 0},
+    {12, 1, 10.0, 0, 0},
+    {20, 2, 40.0, 0, 0},
+    {100, 10, 15.0, 0, 0},
+    {101, 10, 10.0, 0, 0},
+    {102, 10, 5.0, 0, 0},
+    {110, 11, 20.0, 0, 0},
+    {1000, 100, 10.0, 0, 0},
+    {1001, 100, 5.0, 0, 0},
+    {21, 2, 10.0, 0, 0}};
+
+/* The layouts sort and modify the items, so every test works on its own copy */
+void tmv_test_tree_copy(tmv_item *items)
+{
+  unsigned long i;
+
+  for (i = 0; i < TMV_TEST_TREE_ITEMS; ++i)
+  {
+    items[i] = tmv_test_tree[i];
+  }
+}
+
+void tmv_test_squarify_subtree(void)
+{
+  tmv_rect area = {0, 0.0, 0.0, 100.0, 100.0};
+  tmv_rect rects[13];
+  tmv_rect rects_full[13];
+  tmv_rect rects_emission[13];
+
+  tmv_index_entry index_memory[32];
+  tmv_index_entry index_emission_memory[32];
+  tmv_index index = {0};
+  tmv_index index_emission = {0};
+
+  tmv_item items[TMV_TEST_TREE_ITEMS];
+
+  tmv_item items_emission[TMV_TEST_TREE_ITEMS];
+
+  tmv_model model = {0};
+  tmv_model model_emission = {0};
+  tmv_rect *rect;
+  tmv_real area_sum;
+  unsigned long i;
+
+  tmv_test_tree_copy(items);
+  tmv_test_tree_copy(items_emission);
+
+  assert(tmv_index_memory_size(TMV_ARRAY_SIZE(items)) <= sizeof(index_memory));
+  assert(tmv_index_init(&index, index_memory, sizeof(index_memory), TMV_ARRAY_SIZE(items)));
+  assert(tmv_index_init(&index_emission, index_emission_memory, sizeof(index_emission_memory), TMV_ARRAY_SIZE(items)));
+
+  model.items = items;
+  model.items_count = TMV_ARRAY_SIZE(items);
+  model.rects = rects;
+  model.rects_aligned = 1;
+  model.index = &index;
+
+  tmv_squarify(&model, area);
+
+  for (i = 0; i < model.items_count; ++i)
+  {
+    rects_full[i] = rects[i];
+  }
+
+  /* The subtree of 1 laid out into its own rect is the same as in the full layout */
+  rect = tmv_model_find_rect_by_id(&model, 1);
+  assert(rect != 0);
+  assert(tmv_squarify_subtree(&model, 1, *rect, (unsigned long)-1));
+
+  for (i = 0; i < model.items_count; ++i)
+  {
+    assert(tmv_test_rect_equals(&rects[i], &rects_full[i]));
+  }
+
+  /* Leaves of 1 are 1000, 1001, 101, 102, 110 and 12 */
+  assert(model.stats.count == 6);
+  assert_equalsd((double)model.stats.weigth_sum, 60.0, (double)TVM_TEST_EPSILON);
+  assert(model.collapsed_count == 0);
+
+  /* Zoom into 10 one level deep, the children fill the area and the grandchildren stay untouched */
+  assert(tmv_squarify_subtree(&model, 10, area, 1));
+
+  area_sum = 0;
+  for (i = 0; i < model.items_count; ++i)
+  {
+    if (items[i].parent_id == 10)
+    {
+      assert(rects[i].id == items[i].id);
+      assert(rects[i].x >= 0 && rects[i].y >= 0 && rects[i].x + rects[i].width <= 100 + TVM_TEST_EPSILON && rects[i].y + rects[i].height <= 100 + TVM_TEST_EPSILON);
+      area_sum += rects[i].width * rects[i].height;
+    }
+    else if (items[i].parent_id != 1 || items[i].id == 10)
+    {
+      assert(tmv_test_rect_equals(&rects[i], &rects_full[i]) || items[i].id == 10);
+    }
+  }
+
+  assert_equalsd((double)area_sum, 10000.0, 0.1);
+
+  /* 100 stands in for its children at the depth limit */
+  assert(model.stats.count == 3);
+  assert_equalsd((double)model.stats.weigth_sum, 30.0, (double)TVM_TEST_EPSILON);
+
+  /* Unknown ids and leaves */
+  assert(!tmv_squarify_subtree(&model, 999, area, 1));
+  assert(tmv_squarify_subtree(&model, 12, area, 1));
+  assert(model.stats.count == 1);
+
+  /* A zoom below the level of detail is collapsed */
+  model.min_side = 1;
+  area.width = 0.5;
+  assert(tmv_squarify_subtree(&model, 1, area, (unsigned long)-1));
+  assert(model.collapsed_count == 1);
+  assert(model.stats.count == 1);
+  area.width = 100;
+  model.min_side = 0;
+
+  /* Emission order rects hold the descendants only, an unsorted model gets sorted first */
+  assert(tmv_squarify_subtree(&model, 1, area, (unsigned long)-1));
+
+  model_emission.items = items_emission;
+  model_emission.items_count = TMV_ARRAY_SIZE(items_emission);
+  model_emission.rects = rects_emission;
+  model_emission.index = &index_emission;
+
+  assert(tmv_squarify_subtree(&model_emission, 1, area, (unsigned long)-1));
+  assert(model_emission.items_sorted);
+  assert(model_emission.rects_count == 9);
+  assert(model_emission.stats.count == model.stats.count);
+
+  for (i = 0; i < model_emission.rects_count; ++i)
+  {
+    rect = tmv_model_find_rect_by_id(&model, rects_emission[i].id);
+    assert(rect && tmv_test_rect_equals(rect, &rects_emission[i]));
+    assert(tmv_model_find_rect_by_id(&model_emission, rects_emission[i].id) == &rects_emission[i]);
+  }
+
+  /* Index entries of the previous zoom are replaced or no longer found */
+  assert(tmv_squarify_subtree(&model_emission, 10, area, 1));
+  assert(model_emission.rects_count == 3);
+
+  rect = tmv_model_find_rect_by_id(&model_emission, 101);
+  assert(rect && rect->id == 101 && rect < &rects_emission[3]);
+  assert(tmv_model_find_rect_by_id(&model_emission, 1000) == 0);
+  assert(tmv_model_find_rect_by_id(&model_emission, 110) == 0);
+}
+
+typedef struct tmv_test_sink
+{
+  tmv_rect rects[16];
+  unsigned long count;
+  unsigned long calls;
+  unsigned long calls_max;
+
+} tmv_test_sink;
+
+int tmv_test_sink_collect(void *user_data, tmv_rect *rects, tmv_item *items, unsigned long count)
+{
+  tmv_test_sink *sink = (tmv_test_sink *)user_data;
+  unsigned long i;
+
+  for (i = 0; i < count; ++i)
+  {
+    assert(rects[i].id == items[i].id);
+    assert(sink->count < TMV_ARRAY_SIZE(sink->rects));
+    sink->rects[sink->count++] = rects[i];
+  }
+
+  return ++sink->calls < sink->calls_max;
+}
+
+void tmv_test_squarify_stream(void)
+{
+  tmv_rect area = {0, 0.0, 0.0, 100.0, 100.0};
+  tmv_rect rects_full[13];
+  tmv_rect rects[14];
+
+  tmv_item items[TMV_TEST_TREE_ITEMS];
+
+  tmv_model model = {0};
+  tmv_model model_full = {0};
+  tmv_test_sink sink = {0};
+  tmv_rect *rect;
+  unsigned long i;
+
+  tmv_test_tree_copy(items);
+
+  model_full.items = items;
+  model_full.items_count = TMV_ARRAY_SIZE(items);
+  model_full.rects = rects_full;
+  assert(tmv_squarify(&model_full, area));
+  assert(model_full.rects_count == 13);
+
+  /* A capacity below the rects count drops the rest and never writes past it */
+  model = model_full;
+  model.rects = rects;
+  model.rects_capacity = 5;
+  rects[5].id = 12345;
+
+  assert(!tmv_squarify(&model, area));
+  assert(model.rects_count == 5);
+  assert(model.rects_dropped > 0);
+  assert(rects[5].id == 12345);
+
+  model.rects_capacity = 13;
+  assert(tmv_squarify(&model, area));
+  assert(model.rects_dropped == 0);
+  assert(model.rects_count == 13);
+
+  /* Aligned rects need one per item */
+  model.rects_aligned = 1;
+  model.rects_capacity = 12;
+  assert(!tmv_squarify(&model, area));
+  assert(!tmv_squarify_subtree(&model, 1, area, 1));
+  model.rects_capacity = 13;
+  assert(tmv_squarify(&model, area));
+  model.rects_aligned = 0;
+
+  /* Emission order zooms are checked as well */
+  model.rects_capacity = 2;
+  assert(!tmv_squarify_subtree(&model, 1, area, (unsigned long)-1));
+  assert(model.rects_dropped == 3);
+
+  /* The stream only needs the groups on the deepest path: 2 roots, 3 + 3 + 2 descendants */
+  model.rects_capacity = 10;
+  sink.calls_max = 100;
+
+  assert(tmv_squarify_stream(&model, area, tmv_test_sink_collect, &sink));
+  assert(sink.count == 13);
+  assert(model.rects_count == 0);
+  assert(model.stats.count == model_full.stats.count);
+  assert_equalsd((double)model.stats.weigth_sum, (double)model_full.stats.weigth_sum, (double)TVM_TEST_EPSILON);
+  assert(model.collapsed_count == model_full.collapsed_count);
+
+  for (i = 0; i < sink.count; ++i)
+  {
+    rect = tmv_model_find_rect_by_id(&model_full, sink.rects[i].id);
+    assert(rect != 0 && tmv_test_rect_equals(rect, &sink.rects[i]));
+  }
+
+  /* A path that does not fit fails instead of overflowing */
+  model.rects_capacity = 9;
+  sink.count = 0;
+  sink.calls = 0;
+
+  assert(!tmv_squarify_stream(&model, area, tmv_test_sink_collect, &sink));
+  assert(model.rects_dropped == 2);
+
+  /* The sink can stop the layout */
+  model.rects_capacity = 10;
+  sink.count = 0;
+  sink.calls = 0;
+  sink.calls_max = 2;
+
+  assert(!tmv_squarify_stream(&model, area, tmv_test_sink_collect, &sink));
+  assert(sink.calls == 2);
+
+  /* Streaming needs emission order rects */
+  model.rects_aligned = 1;
+  assert(!tmv_squarify_stream(&model, area, tmv_test_sink_collect, &sink));
+}
+
+#define TMV_TEST_CHAIN_ITEMS 50000
+
+tmv_item tmv_test_chain_items[TMV_TEST_CHAIN_ITEMS];
+tmv_rect tmv_test_chain_rects[TMV_TEST_CHAIN_ITEMS];
+tmv_sort_key tmv_test_chain_scratch[2 * TMV_TEST_CHAIN_ITEMS + TMV_SORT_RADIX];
+
+int tmv_test_sink_count(void *user_data, tmv_rect *rects, tmv_item *items, unsigned long count)
+{
+  unsigned long *total = (unsigned long *)user_data;
+
+  (void)rects;
+  (void)items;
+  *total += count;
+
+  return 1;
+}
+
+void tmv_test_squarify_deep_chain(void)
+{
+  tmv_rect area = {0, 0.0, 0.0, 100.0, 100.0};
+  tmv_model model = {0};
+  unsigned long total = 0;
+  unsigned long i;
+
+  /* A chain deeper than any call stack, item i + 1 is the only child of item i */
+  for (i = 0; i < TMV_TEST_CHAIN_ITEMS; ++i)
+  {
+    tmv_test_chain_items[i].id = (long)i + 1;
+    tmv_test_chain_items[i].parent_id = i == 0 ? -1 : (long)i;
+    tmv_test_chain_items[i].weight = (tmv_real)1.0;
+  }
+
+  model.items = tmv_test_chain_items;
+  model.items_count = TMV_TEST_CHAIN_ITEMS;
+  model.rects = tmv_test_chain_rects;
+  model.rects_aligned = 1;
+  model.scratch = tmv_test_chain_scratch;
+  model.scratch_size = sizeof(tmv_test_chain_scratch);
+  assert(model.scratch_size >= tmv_items_sort_scratch_size(TMV_TEST_CHAIN_ITEMS));
+
+  assert(tmv_squarify_subtree(&model, 1, area, (unsigned long)-1));
+  assert(model.rects[TMV_TEST_CHAIN_ITEMS - 1].id == TMV_TEST_CHAIN_ITEMS);
+  area.id = TMV_TEST_CHAIN_ITEMS;
+  assert(tmv_test_rect_equals(&model.rects[TMV_TEST_CHAIN_ITEMS - 1], &area));
+
+  /* The stream holds the whole path, one rect per level */
+  model.rects_aligned = 0;
+  model.rects_capacity = TMV_TEST_CHAIN_ITEMS;
+
+  assert(tmv_squarify_stream(&model, area, tmv_test_sink_count, &total));
+  assert(total == TMV_TEST_CHAIN_ITEMS);
+  assert(model.rects_count == 0);
+
+  /* Without scratch memory the path is bounded by TMV_SUBTREE_PATH_MAX and fails instead */
+  model.scratch = 0;
+  model.scratch_size = 0;
+  total = 0;
+
+  assert(!tmv_squarify_stream(&model, area, tmv_test_sink_count, &total));
+  assert(total == TMV_SUBTREE_PATH_MAX);
+  assert(!tmv_squarify_subtree(&model, 1, area, (unsigned long)-1));
+  assert(tmv_squarify_subtree(&model, 1, area, TMV_SUBTREE_PATH_MAX));
+  assert(model.rects_count == TMV_SUBTREE_PATH_MAX);
+}
+
+/* The spans seen by tmv_test_span_count */
+typedef struct tmv_test_spans
+{
+  unsigned long begins;
+  unsigned long ends;
+  unsigned long groups;
+  int open;
+
+} tmv_test_spans;
+
+void tmv_test_span_count(void *user_data, const char *name, tmv_item *item, int begin)
+{
+  tmv_test_spans *spans = (tmv_test_spans *)user_data;
+
+  /* The spans of the library do not nest */
+  assert(name && spans->open != begin);
+  spans->open = begin;
+  spans->begins += begin ? 1UL : 0UL;
+  spans->ends += begin ? 0UL : 1UL;
+  spans->groups += (begin && item) ? 1UL : 0UL;
+}
+
+void tmv_test_span(void)
+{
+  tmv_rect area = {0, 0.0, 0.0, 100.0, 100.0};
+  tmv_rect rects[TMV_TEST_TREE_ITEMS];
+  tmv_item items[TMV_TEST_TREE_ITEMS];
+  tmv_test_spans spans = {0, 0, 0, 0};
+  unsigned long parents = 0;
+  unsigned long i;
+
+  tmv_model model = {0};
+
+  tmv_test_tree_copy(items);
+
+  model.items = items;
+  model.items_count = TMV_ARRAY_SIZE(items);
+  model.rects = rects;
+  model.rects_aligned = 1;
+  model.span = tmv_test_span_count;
+  model.span_user_data = &spans;
+
+  assert(tmv_squarify(&model, area));
+
+  for (i = 0; i < model.items_count; ++i)
+  {
+    parents += (items[i].children_count > 0) ? 1UL : 0UL;
+  }
+
+  /* The sort, the roots and one span per children group */
+  assert(!spans.open && spans.begins == spans.ends);
+  assert(spans.groups == parents && spans.begins == 2 + parents);
+
+  /* A sorted model only traces the layout */
+  spans.begins = 0;
+  spans.groups = 0;
+  assert(tmv_squarify(&model, area));
+  assert(spans.groups == parents && spans.begins == 1 + parents);
+}
+
+void tmv_test_emission_positions(void)
+{
+  tmv_rect area = {0, 0.0, 0.0, 100.0, 60.0};
+  tmv_rect rects[TMV_TEST_TREE_ITEMS];
+  tmv_rect rects_scratch[TMV_TEST_TREE_ITEMS];
+  tmv_item items[TMV_TEST_TREE_ITEMS];
+  tmv_item items_scratch[TMV_TEST_TREE_ITEMS];
+  tmv_sort_key scratch[2 * TMV_TEST_TREE_ITEMS + TMV_SORT_RADIX];
+  unsigned long i;
+  int run;
+
+  /* The parent rects found by their position in the scratch memory are the ones the search finds,
+     also with collapsed groups (run 1) and dropped rects (run 2) */
+  for (run = 0; run < 3; ++run)
+  {
+    tmv_model model = {0};
+    tmv_model model_scratch = {0};
+
+    tmv_test_tree_copy(items);
+    tmv_test_tree_copy(items_scratch);
+
+    model.items = items;
+    model.items_count = TMV_TEST_TREE_ITEMS;
+    model.rects = rects;
+    model.min_side = (run == 1) ? (tmv_real)40 : (tmv_real)0;
+    model.rects_capacity = (run == 2) ? 7UL : 0UL;
+
+    model_scratch = model;
+    model_scratch.items = items_scratch;
+    model_scratch.rects = rects_scratch;
+    model_scratch.scratch = scratch;
+    model_scratch.scratch_size = sizeof(scratch);
+
+    assert(tmv_squarify(&model, area) == tmv_squarify(&model_scratch, area));
+    assert(model.rects_count == model_scratch.rects_count && model.rects_count > 0);
+    assert(model.collapsed_count == model_scratch.collapsed_count && model.rects_dropped == model_scratch.rects_dropped);
+    assert(run != 1 || model.collapsed_count > 0);
+    assert(run != 2 || model.rects_dropped > 0);
+
+    for (i = 0; i < model.rects_count; ++i)
+    {
+      assert(tmv_test_rect_equals(&rects[i], &rects_scratch[i]));
+    }
+  }
+}
+
+void tmv_test_arena(void)
+{
+  tmv_rect area = {0, 0.0, 0.0, 100.0, 100.0};
+  unsigned long flags = TMV_MEMORY_RECTS | TMV_MEMORY_SCRATCH | TMV_MEMORY_INDEX | TMV_MEMORY_DIRTY;
+  unsigned long size;
+  unsigned long i;
+
+  /* Aligned like a double, the arena hands out multiples of TMV_ARENA_ALIGN */
+  double memory[512];
+  unsigned char *a;
+  unsigned char *b;
+
+  tmv_item items[8] = {
+      {1, -1, 10.0, 0, 0},
+      {2, -1, 10.0, 0, 0},
+      {3, -1, 10.0, 0, 0},
+      {4, -1, 10.0, 0, 0},
+      {5, 1, 2.5, 0, 0},
+      {6, 1, 2.5, 0, 0},
+      {7, 1, 2.5, 0, 0},
+      {8, 1, 2.5, 0, 0}};
+
+  tmv_arena arena;
+  tmv_model model = {0};
+
+  tmv_arena_init(&arena, memory, 64);
+
+  a = (unsigned char *)tmv_arena_alloc(&arena, 1);
+  b = (unsigned char *)tmv_arena_alloc(&arena, 17);
+  assert(a == (unsigned char *)memory);
+  assert(b == a + TMV_ARENA_ALIGN);
+  assert(arena.used == 3 * TMV_ARENA_ALIGN);
+  assert(tmv_arena_alloc(&arena, TMV_ARENA_ALIGN + 1) == 0);
+  assert(tmv_arena_alloc(&arena, TMV_ARENA_ALIGN) != 0);
+  assert(tmv_arena_alloc(&arena, 1) == 0);
+
+  tmv_arena_reset(&arena);
+  assert(tmv_arena_alloc(&arena, 64) == a);
+
+  /* The requirements are exact */
+  model.items = items;
+  model.items_count = TMV_ARRAY_SIZE(items);
+
+  size = tmv_memory_requirements(model.items_count, flags);
+  assert(size <= sizeof(memory));
+
+  tmv_arena_init(&arena, memory, size - 1);
+  assert(!tmv_model_arena_init(&model, &arena, flags));
+
+  tmv_arena_init(&arena, memory, size);
+  assert(tmv_model_arena_init(&model, &arena, flags));
+  assert(arena.used == size);
+  assert(model.rects_capacity == model.items_count);
+  assert(model.scratch_size == tmv_items_sort_scratch_size(model.items_count));
+  assert(model.index && model.index->entries);
+
+  for (i = 0; i < model.items_count; ++i)
+  {
+    assert(model.dirty[i] == 0);
+  }
+
+  /* The model lays out like one with caller sized buffers */
+  model.rects_aligned = 1;
+  assert(tmv_squarify(&model, area));
+  assert(model.stats.count == 7);
+  assert(tmv_model_find_rect_by_id(&model, 5) != 0);
+  assert(tmv_model_find_rect_by_id(&model, 5)->width == 25);
+
+  assert(tmv_memory_requirements(model.items_count, 0) == 0);
+}
+
+/* Checks that the children of every laid out parent tile it in proportion to their weights */
+void tmv_test_layout_tiles(tmv_model *model)
+{
+  tmv_real epsilon = TVM_TEST_EPSILON * 100;
+  unsigned long i, j, k;
+
+  for (i = 0; i < model->items_count; ++i)
+  {
+    tmv_item *parent = &model->items[i];
+    tmv_rect *parent_rect = &model->rects[i];
+    tmv_real parent_area = parent_rect->width * parent_rect->height;
+    tmv_real weight_sum;
+
+    if (parent->children_count == 0 || parent_rect->id != parent->id)
+    {
+      continue;
+    }
+
+    weight_sum = tmv_total_weight(&model->items[parent->children_offset_index], parent->children_count);
+
+    for (j = parent->children_offset_index; j < parent->children_offset_index + parent->children_count; ++j)
+    {
+      tmv_rect *a = &model->rects[j];
+
+      assert(a->id == model->items[j].id);
+      assert(a->width >= 0 && a->height >= 0);
+      assert(a->x >= parent_rect->x - epsilon && a->x + a->width <= parent_rect->x + parent_rect->width + epsilon);
+      assert(a->y >= parent_rect->y - epsilon && a->y + a->height <= parent_rect->y + parent_rect->height + epsilon);
+      assert_equalsd((double)(a->width * a->height), (double)(parent_area * model->items[j].weight / weight_sum), (double)epsilon);
+
+      for (k = j + 1; k < parent->children_offset_index + parent->children_count; ++k)
+      {
+        tmv_rect *b = &model->rects[k];
+        tmv_real ox = ((a->x + a->width < b->x + b->width) ? a->x + a->width : b->x + b->width) - ((a->x > b->x) ? a->x : b->x);
+        tmv_real oy = ((a->y + a->height < b->y + b->height) ? a->y + a->height : b->y + b->height) - ((a->y > b->y) ? a->y : b->y);
+
+        assert(ox <= epsilon || oy <= epsilon);
+      }
+    }
+  }
+}
+
+void tmv_test_layout_engines(void)
+{
+  tmv_rect area = {0, 0.0, 0.0, 100.0, 60.0};
+  tmv_rect rects[16];
+  tmv_rect rects_emission[16];
+  int engine;
+  unsigned long i;
+
+  tmv_item items[16] = {
+      {1, -1, 60.0, 0, 0},
+      {2, -1, 40.0, 0, 0},
+      {3, -1, 3.0, 0, 0},
+      {10, 1, 30.0, 0, 0},
+      {11, 1, 20.0, 0, 0},
+      {12, 1, 10.0, 0, 0},
+      {13, 1, 7.0, 0, 0},
+      {14, 1, 7.0, 0, 0},
+      {15, 1, 1.0, 0, 0},
+      {20, 2, 40.0, 0, 0},
+      {21, 2, 10.0, 0, 0},
+      {100, 10, 15.0, 0, 0},
+      {101, 10, 10.0, 0, 0},
+      {102, 10, 5.0, 0, 0},
+      {103, 10, 4.0, 0, 0},
+      {104, 10, 1.0, 0, 0}};
+
+  tmv_item items_engine[16];
+  tmv_item items_emission[16];
+
+  tmv_item items_slice[4] = {
+      {1, -1, 1.0, 0, 0},
+      {2, -1, 1.0, 0, 0},
+      {3, -1, 1.0, 0, 0},
+      {4, -1, 1.0, 0, 0}};
+
+  tmv_model model = {0};
+
+  for (engine = TMV_LAYOUT_SQUARIFY; engine <= TMV_LAYOUT_PIVOT; ++engine)
+  {
+    tmv_model model_emission = {0};
+
+    for (i = 0; i < TMV_ARRAY_SIZE(items); ++i)
+    {
+      items_engine[i] = items[i];
+      items_emission[i] = items[i];
+    }
+
+    model.items = items_engine;
+    model.items_count = TMV_ARRAY_SIZE(items_engine);
+    model.items_sorted = 0;
+    model.rects = rects;
+    model.rects_aligned = 1;
+    model.layout_engine = engine;
+
+    assert(tmv_squarify(&model, area));
+    assert(model.stats.count == 13);
+    tmv_test_layout_tiles(&model);
+
+    /* Emission order gives the same rects, every engine writes a group in item order */
+    model_emission.items = items_emission;
+    model_emission.items_count = TMV_ARRAY_SIZE(items_emission);
+    model_emission.rects = rects_emission;
+    model_emission.layout_engine = engine;
+
+    assert(tmv_squarify(&model_emission, area));
+    assert(model_emission.rects_count == model.items_count);
+
+    for (i = 0; i < model_emission.rects_count; ++i)
+    {
+      tmv_rect *rect = tmv_model_find_rect_by_id(&model, rects_emission[i].id);
+      assert(rect != 0 && tmv_test_rect_equals(rect, &rects_emission[i]));
+    }
+  }
+
+  /* Strips span the width of their parent, so each row of the roots starts at the left edge */
+  model.items = items_engine;
+  model.layout_engine = TMV_LAYOUT_STRIP;
+  assert(tmv_squarify(&model, area));
+
+  for (i = 0; i < 3; ++i)
+  {
+    unsigned long j;
+    int left = 0;
+
+    for (j = 0; j < 3; ++j)
+    {
+      left |= (rects[j].y == rects[i].y && rects[j].x == 0);
+    }
+
+    assert(left);
+  }
+
+  /* Slice and dice cuts along the long side */
+  model.items = items_slice;
+  model.items_count = TMV_ARRAY_SIZE(items_slice);
+  model.items_sorted = 0;
+  model.layout_engine = TMV_LAYOUT_SLICE_DICE;
+  assert(tmv_squarify(&model, area));
+
+  for (i = 0; i < model.items_count; ++i)
+  {
+    assert_equalsd((double)rects[i].x, (double)(25 * i), (double)TVM_TEST_EPSILON);
+    assert_equalsd((double)rects[i].width, 25.0, (double)TVM_TEST_EPSILON);
+    assert_equalsd((double)rects[i].height, 60.0, (double)TVM_TEST_EPSILON);
+  }
+}
+
+/* The ordered engines keep the input order of a group, also after weight updates */
+void tmv_test_layout_ordered(void)
+{
+  tmv_rect area = {0, 0.0, 0.0, 100.0, 60.0};
+  tmv_rect rects[7];
+  tmv_rect_range ranges[4];
+  unsigned char dirty[7];
+  int engine;
+  unsigned long i;
+
+  tmv_item items[7] = {
+      {1, -1, 1.0, 0, 0},
+      {2, -1, 5.0, 0, 0},
+      {3, -1, 2.0, 0, 0},
+      {4, -1, 8.0, 0, 0},
+      {5, -1, 3.0, 0, 0},
+      {6, -1, 1.0, 0, 0},
+      {7, -1, 4.0, 0, 0}};
+
+  for (engine = TMV_LAYOUT_SLICE_DICE; engine <= TMV_LAYOUT_PIVOT; ++engine)
+  {
+    tmv_model model = {0};
+    tmv_real area_sum = 0;
+
+    assert(tmv_layout_keeps_order(engine));
+
+    model.items = items;
+    model.items_count = TMV_ARRAY_SIZE(items);
+    model.rects = rects;
+    model.rects_aligned = 1;
+    model.dirty = dirty;
+    model.layout_engine = engine;
+
+    assert(tmv_squarify(&model, area));
+
+    for (i = 0; i < model.items_count; ++i)
+    {
+      assert(model.items[i].id == (long)i + 1);
+      assert(rects[i].id == (long)i + 1);
+      area_sum += rects[i].width * rects[i].height;
+    }
+
+    assert_equalsd((double)area_sum, 6000.0, (double)TVM_TEST_EPSILON * 100);
+
+    /* 1 becomes the heaviest item and stays first */
+    assert(tmv_update_weight(&model, 1, 20.0));
+    assert(tmv_relayout_dirty(&model, area, ranges, TMV_ARRAY_SIZE(ranges)) == 1);
+    assert(ranges[0].offset == 0 && ranges[0].count == 7);
+
+    for (i = 0; i < model.items_count; ++i)
+    {
+      assert(model.items[i].id == (long)i + 1);
+    }
+
+    assert(tmv_update_weight(&model, 1, 1.0));
+    tmv_relayout_dirty(&model, area, ranges, TMV_ARRAY_SIZE(ranges));
+  }
+
+  /* Squarify puts the heaviest item first */
+  {
+    tmv_model model = {0};
+
+    model.items = items;
+    model.items_count = TMV_ARRAY_SIZE(items);
+    model.rects = rects;
+    model.rects_aligned = 1;
+
+    assert(!tmv_layout_keeps_order(TMV_LAYOUT_SQUARIFY));
+    assert(tmv_squarify(&model, area));
+    assert(model.items[0].id == 4);
+  }
+}
+
+/* A wide group splits into nested parts on a bounded stack, whatever the order of the weights */
+void tmv_test_layout_pivot_deep(void)
+{
+  tmv_rect area = {0, 0.0, 0.0, 100.0, 60.0};
+  tmv_real epsilon = TVM_TEST_EPSILON * 100;
+  int ascending;
+  unsigned long i;
+
+  for (ascending = 0; ascending < 2; ++ascending)
+  {
+    tmv_model model = {0};
+    tmv_real weight_sum = 0;
+    tmv_real area_sum = 0;
+    unsigned long wrong = 0;
+
+    for (i = 0; i < TMV_TEST_CHAIN_ITEMS; ++i)
+    {
+      tmv_test_chain_items[i].id = (long)i + 1;
+      tmv_test_chain_items[i].parent_id = -1;
+      tmv_test_chain_items[i].weight = ascending ? (tmv_real)(i + 1) : (tmv_real)1.0 / (tmv_real)(i + 1);
+      weight_sum += tmv_test_chain_items[i].weight;
+    }
+
+    model.items = tmv_test_chain_items;
+    model.items_count = TMV_TEST_CHAIN_ITEMS;
+    model.rects = tmv_test_chain_rects;
+    model.rects_aligned = 1;
+    model.scratch = tmv_test_chain_scratch;
+    model.scratch_size = sizeof(tmv_test_chain_scratch);
+    model.layout_engine = TMV_LAYOUT_PIVOT;
+
+    assert(tmv_squarify(&model, area));
+    assert(model.stats.count == TMV_TEST_CHAIN_ITEMS);
+
+    /* Counted instead of asserted one by one, the group is too large for a line per check */
+    for (i = 0; i < TMV_TEST_CHAIN_ITEMS; ++i)
+    {
+      tmv_rect *rect = &tmv_test_chain_rects[i];
+      tmv_real expected = area.width * area.height * tmv_test_chain_items[i].weight / weight_sum;
+      tmv_real error = rect->width * rect->height - expected;
+
+      wrong += (tmv_test_chain_items[i].id != (long)i + 1 || rect->id != (long)i + 1);
+      wrong += (rect->width < 0 || rect->height < 0);
+      wrong += (rect->x < -epsilon || rect->x + rect->width > area.width + epsilon);
+      wrong += (rect->y < -epsilon || rect->y + rect->height > area.height + epsilon);
+      wrong += (error > epsilon || error < -epsilon);
+
+      area_sum += rect->width * rect->height;
+    }
+
+    assert(wrong == 0);
+    assert_equalsd((double)area_sum, 6000.0, (double)epsilon * 10);
+  }
+}
+
+unsigned long tmv_test_subtree_size(tmv_model *model, long id)
+{
+  tmv_item *item = tmv_model_find_item_by_id(model, id);
+  assert(item != 0);
+  return model->subtree_sizes[item - model->items];
+}
+
+void tmv_test_aggregate_weights(void)
+{
+  tmv_rect area = {0, 0.0, 0.0, 100.0, 100.0};
+  tmv_rect rects[9];
+  double memory[128];
+  unsigned long i;
+
+  /* Parents weigh nothing until aggregated, then 10 outweighs its sibling 11 */
+  tmv_item items[9] = {
+      {1, -1, 0.0, 0, 0},
+      {2, -1, 100.0, 0, 0},
+      {3, -1, 0.0, 0, 0},
+      {10, 1, 0.0, 0, 0},
+      {11, 1, 5.0, 0, 0},
+      {100, 10, 30.0, 0, 0},
+      {101, 10, 20.0, 0, 0},
+      {30, 3, 1.0, 0, 0},
+      {5, 99, 7.0, 0, 0}};
+
+  tmv_arena arena;
+  tmv_model model = {0};
+
+  model.items = items;
+  model.items_count = TMV_ARRAY_SIZE(items);
+  model.rects = rects;
+  model.rects_aligned = 1;
+
+  assert(tmv_memory_requirements(model.items_count, TMV_MEMORY_SUBTREE | TMV_MEMORY_INDEX) <= sizeof(memory));
+  tmv_arena_init(&arena, memory, sizeof(memory));
+  assert(tmv_model_arena_init(&model, &arena, TMV_MEMORY_SUBTREE | TMV_MEMORY_INDEX));
+
+  tmv_aggregate_weights(&model);
+
+  assert(model.items_sorted);
+  assert(model.depth_max == 2);
+  assert_equalsd((double)tmv_model_find_item_by_id(&model, 10)->weight, 50.0, (double)TVM_TEST_EPSILON);
+  assert_equalsd((double)tmv_model_find_item_by_id(&model, 1)->weight, 55.0, (double)TVM_TEST_EPSILON);
+  assert_equalsd((double)tmv_model_find_item_by_id(&model, 3)->weight, 1.0, (double)TVM_TEST_EPSILON);
+  assert_equalsd((double)tmv_model_find_item_by_id(&model, 2)->weight, 100.0, (double)TVM_TEST_EPSILON);
+
+  assert(tmv_test_subtree_size(&model, 1) == 5);
+  assert(tmv_test_subtree_size(&model, 2) == 1);
+  assert(tmv_test_subtree_size(&model, 3) == 2);
+  assert(tmv_test_subtree_size(&model, 10) == 3);
+  assert(tmv_test_subtree_size(&model, 5) == 1);
+
+  /* The siblings are in weight order again */
+  for (i = 0; i < model.items_count; ++i)
+  {
+    tmv_item *item = &items[i];
+    unsigned long j;
+
+    for (j = item->children_offset_index + 1; j < item->children_offset_index + item->children_count; ++j)
+    {
+      assert(items[j - 1].weight >= items[j].weight);
+    }
+  }
+  assert(items[0].id == 2 && items[1].id == 1 && items[2].id == 3);
+
+  /* The parents are now tiled exactly by their children */
+  assert(tmv_squarify(&model, area));
+  tmv_test_layout_tiles(&model);
+
+  /* Aggregating again changes nothing */
+  tmv_aggregate_weights(&model);
+  assert(model.depth_max == 2);
+  assert(tmv_test_subtree_size(&model, 1) == 5);
+}
+
+void tmv_test_hit_test(void)
+{
+  tmv_rect area = {0, 0.0, 0.0, 100.0, 100.0};
+  tmv_rect rects[13];
+  tmv_rect rects_emission[13];
+  tmv_index_entry index_memory[32];
+  tmv_index index = {0};
+  unsigned long path[4];
+  unsigned long path_emission[4];
+  unsigned long i;
+
+  tmv_item items[TMV_TEST_TREE_ITEMS];
+
+  tmv_item items_emission[TMV_TEST_TREE_ITEMS];
+
+  tmv_model model = {0};
+  tmv_model model_emission = {0};
+
+  tmv_test_tree_copy(items);
+  tmv_test_tree_copy(items_emission);
+
+  model.items = items;
+  model.items_count = TMV_ARRAY_SIZE(items);
+  model.rects = rects;
+  model.rects_aligned = 1;
+
+  assert(tmv_hit_test(&model, 1, 1, path, TMV_ARRAY_SIZE(path)) == 0);
+  assert(tmv_squarify(&model, area));
+
+  assert(tmv_index_init(&index, index_memory, sizeof(index_memory), TMV_ARRAY_SIZE(items)));
+  model_emission.items = items_emission;
+  model_emission.items_count = TMV_ARRAY_SIZE(items_emission);
+  model_emission.rects = rects_emission;
+  model_emission.index = &index;
+  assert(tmv_squarify(&model_emission, area));
+
+  /* The center of every leaf hits the leaf, the path holds its ancestors from the root down */
+  for (i = 0; i < model.items_count; ++i)
+  {
+    tmv_real x = rects[i].x + rects[i].width / 2;
+    tmv_real y = rects[i].y + rects[i].height / 2;
+    unsigned long depth;
+    unsigned long d;
+
+    if (items[i].children_count > 0)
+    {
+      continue;
+    }
+
+    depth = tmv_hit_test(&model, x, y, path, TMV_ARRAY_SIZE(path));
+    assert(depth > 0 && path[depth - 1] == i);
+
+    for (d = depth - 1; d > 0; --d)
+    {
+      assert(items[path[d]].parent_id == items[path[d - 1]].id);
+    }
+    assert(items[path[0]].parent_id < 0);
+
+    /* Emission order rects give the same path */
+    assert(tmv_hit_test(&model_emission, x, y, path_emission, TMV_ARRAY_SIZE(path_emission)) == depth);
+    for (d = 0; d < depth; ++d)
+    {
+      assert(items_emission[path_emission[d]].id == items[path[d]].id);
+    }
+  }
+
+  /* 1000 is three levels below its root */
+  assert(tmv_hit_test(&model, tmv_model_find_rect_by_id(&model, 1000)->x, tmv_model_find_rect_by_id(&model, 1000)->y, path, TMV_ARRAY_SIZE(path)) == 4);
+  assert(items[path[3]].id == 1000 && items[path[2]].id == 100 && items[path[1]].id == 10 && items[path[0]].id == 1);
+
+  /* A short path keeps the deepest item last */
+  assert(tmv_hit_test(&model, tmv_model_find_rect_by_id(&model, 1000)->x, tmv_model_find_rect_by_id(&model, 1000)->y, path, 2) == 4);
+  assert(items[path[0]].id == 1 && items[path[1]].id == 1000);
+  assert(tmv_hit_test(&model, 1, 1, 0, 0) == 4);
+
+  /* Outside of the area and on its far edge */
+  assert(tmv_hit_test(&model, -1, 50, path, TMV_ARRAY_SIZE(path)) == 0);
+  assert(tmv_hit_test(&model, 100, 50, path, TMV_ARRAY_SIZE(path)) == 0);
+
+  /* A collapsed parent is the deepest item that can be hit */
+  model.min_side = 60;
+  assert(tmv_squarify(&model, area));
+  assert(tmv_hit_test(&model, 1, 1, path, TMV_ARRAY_SIZE(path)) == 2);
+  assert(items[path[1]].id == 10);
+}
+
+tmv_change *tmv_test_find_change(tmv_change *changes, unsigned long count, long id)
+{
+  unsigned long i;
+  for (i = 0; i < count; ++i)
+  {
+    if (changes[i].id == id)
+    {
+      return &changes[i];
+    }
+  }
+  return 0;
+}
+
+void tmv_test_layout_diff(void)
+{
+  tmv_rect area = {0, 0.0, 0.0, 100.0, 100.0};
+  tmv_rect rects_old[13];
+  tmv_rect rects_new[13];
+  tmv_rect rects_emission[13];
+  tmv_index_entry index_memory[32];
+  tmv_index index = {0};
+  tmv_change changes[16];
+  tmv_change changes_emission[16];
+  tmv_change changes_sorted[16];
+  tmv_sort_key scratch[2 * TMV_TEST_TREE_ITEMS + TMV_SORT_RADIX];
+  unsigned long count;
+  unsigned long i;
+
+  tmv_item items_old[TMV_TEST_TREE_ITEMS];
+
+  tmv_item items_new[TMV_TEST_TREE_ITEMS];
+  tmv_item items_emission[TMV_TEST_TREE_ITEMS];
+
+  tmv_model model_old = {0};
+  tmv_model model_new = {0};
+  tmv_model model_emission = {0};
+
+  tmv_test_tree_copy(items_old);
+
+  /* 1001 is replaced by 1002 of the same weight, 21 doubles its weight */
+  for (i = 0; i < TMV_ARRAY_SIZE(items_old); ++i)
+  {
+    items_new[i] = items_old[i];
+    items_new[i].id = (items_old[i].id == 1001) ? 1002 : items_old[i].id;
+    items_new[i].weight = (items_old[i].id == 21) ? 20 : items_old[i].weight;
+    items_emission[i] = items_new[i];
+  }
+
+  model_old.items = items_old;
+  model_old.items_count = TMV_ARRAY_SIZE(items_old);
+  model_old.rects = rects_old;
+  model_old.rects_aligned = 1;
+  assert(tmv_squarify(&model_old, area));
+
+  model_new.items = items_new;
+  model_new.items_count = TMV_ARRAY_SIZE(items_new);
+  model_new.rects = rects_new;
+  model_new.rects_aligned = 1;
+  assert(tmv_squarify(&model_new, area));
+
+  /* The same layout has no changes */
+  assert(tmv_layout_diff(&model_old, &model_old, 0, changes, TMV_ARRAY_SIZE(changes)) == 0);
+
+  count = tmv_layout_diff(&model_old, &model_new, (tmv_real)0.001, changes, TMV_ARRAY_SIZE(changes));
+  assert(count == 4);
+
+  /* Only the second root changed its split */
+  assert(changes[0].id == 20 && changes[0].flags == TMV_CHANGE_RESIZED);
+  assert(tmv_test_rect_equals(&changes[0].old_rect, tmv_model_find_rect_by_id(&model_old, 20)));
+  assert(tmv_test_rect_equals(&changes[0].new_rect, tmv_model_find_rect_by_id(&model_new, 20)));
+  assert(changes[1].id == 21 && changes[1].flags == (TMV_CHANGE_MOVED | TMV_CHANGE_RESIZED));
+
+  /* Added ones are reported in new order, removed ones last */
+  assert(changes[2].id == 1002 && changes[2].flags == TMV_CHANGE_ADDED);
+  assert(changes[2].old_rect.id == 0 && changes[2].old_rect.width == 0);
+  assert(tmv_test_rect_equals(&changes[2].new_rect, tmv_model_find_rect_by_id(&model_new, 1002)));
+  assert(changes[3].id == 1001 && changes[3].flags == TMV_CHANGE_REMOVED);
+  assert(changes[3].new_rect.id == 0 && changes[3].new_rect.width == 0);
+  assert(changes[2].new_rect.x == changes[3].old_rect.x && changes[2].new_rect.width == changes[3].old_rect.width);
+
+  /* A tolerance above the change hides it */
+  assert(tmv_layout_diff(&model_old, &model_new, 100, changes, TMV_ARRAY_SIZE(changes)) == 2);
+
+  /* The count goes on beyond the capacity, changes[1] is left from the call before */
+  assert(tmv_layout_diff(&model_old, &model_new, 0, changes, 1) == 4);
+  assert(changes[0].id == 20 && changes[1].id == 1001);
+
+  /* Emission order rects joined with an index give the same changes */
+  assert(tmv_index_init(&index, index_memory, sizeof(index_memory), TMV_ARRAY_SIZE(items_emission)));
+  model_emission.items = items_emission;
+  model_emission.items_count = TMV_ARRAY_SIZE(items_emission);
+  model_emission.rects = rects_emission;
+  model_emission.index = &index;
+  assert(tmv_squarify(&model_emission, area));
+
+  assert(tmv_layout_diff(&model_old, &model_emission, (tmv_real)0.001, changes_emission, TMV_ARRAY_SIZE(changes_emission)) == 4);
+
+  /* The calls above left changes incomplete, take the reference from the aligned layouts again */
+  assert(tmv_layout_diff(&model_old, &model_new, (tmv_real)0.001, changes, TMV_ARRAY_SIZE(changes)) == count);
+  assert(changes[1].id == 21 && changes[2].id == 1002);
+
+  for (i = 0; i < count; ++i)
+  {
+    tmv_change *change = tmv_test_find_change(changes_emission, count, changes[i].id);
+    assert(change != 0 && change->flags == changes[i].flags);
+  }
+
+  /* Without an index on both models the old ids are sorted in the scratch, the changes and their order stay */
+  model_old.scratch = scratch;
+  model_old.scratch_size = sizeof(scratch);
+  assert(tmv_layout_diff(&model_old, &model_new, (tmv_real)0.001, changes_sorted, TMV_ARRAY_SIZE(changes_sorted)) == count);
+
+  for (i = 0; i < count; ++i)
+  {
+    assert(changes_sorted[i].id == changes[i].id && changes_sorted[i].flags == changes[i].flags);
+    assert(tmv_test_rect_equals(&changes_sorted[i].old_rect, &changes[i].old_rect));
+    assert(tmv_test_rect_equals(&changes_sorted[i].new_rect, &changes[i].new_rect));
+  }
+
+  /* The scratch of the new model is taken if the old one has none */
+  assert(tmv_layout_diff(&model_emission, &model_old, (tmv_real)0.001, changes_sorted, TMV_ARRAY_SIZE(changes_sorted)) == 4);
+  assert(changes_sorted[2].id == 1001 && changes_sorted[2].flags == TMV_CHANGE_ADDED);
+  assert(changes_sorted[3].id == 1002 && changes_sorted[3].flags == TMV_CHANGE_REMOVED);
+  model_old.scratch = 0;
+  model_old.scratch_size = 0;
+
+  /* Swapping the layouts swaps added and removed */
+  assert(tmv_layout_diff(&model_emission, &model_old, (tmv_real)0.001, changes_emission, TMV_ARRAY_SIZE(changes_emission)) == 4);
+  assert(changes_emission[3].id == 1002 && changes_emission[3].flags == TMV_CHANGE_REMOVED);
+}
+
+void tmv_test_csr(void)
+{
+  tmv_rect area = {0, 0.0, 0.0, 100.0, 100.0};
+  tmv_rect rects[13];
+  tmv_rect rects_sorted[13];
+  tmv_item items[13];
+  tmv_item items_sorted[13];
+  unsigned long found;
+  unsigned long i;
+  unsigned long j;
+
+  /* The nodes in producer order, the parent ids are only used by the sorted reference */
+  tmv_item nodes[TMV_TEST_TREE_ITEMS];
+
+  /* The children of node 1 (id 2) are given lightest first */
+  unsigned long child_offsets[14] = {0, 3, 5, 8, 9, 9, 9, 11, 11, 11, 11, 11, 11, 11};
+  unsigned long child_indices[11] = {2, 3, 4, 12, 5, 6, 7, 8, 9, 10, 11};
+
+  unsigned long two_parents[11] = {2, 3, 4, 12, 5, 6, 7, 8, 5, 10, 11};
+  unsigned long cycle_offsets[4] = {0, 0, 1, 2};
+  unsigned long cycle_indices[2] = {2, 1};
+
+  tmv_model model = {0};
+  tmv_model sorted = {0};
+  tmv_model orphans = {0};
+  tmv_model presorted = {0};
+
+  tmv_test_tree_copy(nodes);
+
+  assert(tmv_items_from_csr(items, nodes, TMV_ARRAY_SIZE(nodes), child_offsets, child_indices));
+  assert(tmv_items_layout_ordered(items, TMV_ARRAY_SIZE(items)));
+
+  /* Roots and groups heaviest first, each group behind the one of the previous parent */
+  assert(items[0].id == 1 && items[0].parent_id == -1);
+  assert(items[1].id == 2 && items[1].parent_id == -1);
+  assert(items[0].children_offset_index == 2 && items[0].children_count == 3);
+  assert(items[1].children_offset_index == 5 && items[1].children_count == 2);
+  assert(items[5].id == 20 && items[6].id == 21 && items[6].parent_id == 2);
+  assert(items[12].id == 1001 && items[12].children_count == 0);
+
+  for (i = 0; i < TMV_ARRAY_SIZE(nodes); ++i)
+  {
+    items_sorted[i] = nodes[i];
+  }
+
+  model.items = items;
+  model.items_count = TMV_ARRAY_SIZE(items);
+  model.rects = rects;
+  model.rects_aligned = 1;
+
+  sorted.items = items_sorted;
+  sorted.items_count = TMV_ARRAY_SIZE(items_sorted);
+  sorted.rects = rects_sorted;
+  sorted.rects_aligned = 1;
+
+  assert(tmv_model_presorted(&model));
+  assert(model.items_sorted == 1);
+  assert(tmv_squarify(&model, area));
+  assert(tmv_squarify(&sorted, area));
+
+  /* The depth sort orders the groups of a depth by parent id, the layout of each item is the same */
+  assert(tmv_items_layout_ordered(items_sorted, TMV_ARRAY_SIZE(items_sorted)));
+
+  for (i = 0; i < TMV_ARRAY_SIZE(items); ++i)
+  {
+    found = 0;
+    for (j = 0; j < TMV_ARRAY_SIZE(items_sorted); ++j)
+    {
+      if (items_sorted[j].id == items[i].id)
+      {
+        assert(tmv_test_rect_equals(&rects[i], &rects_sorted[j]));
+        ++found;
+      }
+    }
+    assert(found == 1);
+  }
+
+  /* A group out of weight order is sorted by the next layout */
+  items[5].weight = (tmv_real)5.0;
+  assert(!tmv_items_layout_ordered(items, TMV_ARRAY_SIZE(items)));
+  assert(!tmv_model_presorted(&model));
+  assert(model.items_sorted == 0);
+  assert(tmv_squarify(&model, area));
+  assert(tmv_items_layout_ordered(items, TMV_ARRAY_SIZE(items)));
+
+  /* An item outside of every group, an orphan, needs the depth sort */
+  items_sorted[12].parent_id = 9999;
+  assert(!tmv_items_layout_ordered(items_sorted, TMV_ARRAY_SIZE(items_sorted)));
+
+  /* Two parents of node 5, the unreachable cycle 1 -> 2 -> 1 and a child index out of range are rejected */
+  assert(!tmv_items_from_csr(items, nodes, TMV_ARRAY_SIZE(nodes), child_offsets, two_parents));
+  assert(!tmv_items_from_csr(items, nodes, 3, cycle_offsets, cycle_indices));
+  assert(!tmv_items_from_csr(items, nodes, 2, cycle_offsets, cycle_indices));
+
+  /* The depth sort puts the orphans and parent cycle members behind the roots, they are never laid out
+     and the order holds. 2 lost its parent and keeps its children, 1000 and 1001 are each other's parent. */
+  tmv_test_tree_copy(items_sorted);
+  items_sorted[1].parent_id = 9999;
+  items_sorted[10].parent_id = 1001;
+  items_sorted[11].parent_id = 1000;
+
+  orphans.items = items_sorted;
+  orphans.items_count = TMV_ARRAY_SIZE(items_sorted);
+  orphans.rects = rects_sorted;
+
+  assert(tmv_squarify(&orphans, area));
+  assert(orphans.rects_count == 8);
+  assert(items_sorted[0].id == 1 && items_sorted[1].id == 1001 && items_sorted[2].id == 1000 && items_sorted[3].id == 2);
+  assert(tmv_items_top_count(items_sorted, TMV_ARRAY_SIZE(items_sorted)) == 4);
+  assert(tmv_items_layout_ordered(items_sorted, TMV_ARRAY_SIZE(items_sorted)));
+
+  for (i = 0; i < TMV_ARRAY_SIZE(items); ++i)
+  {
+    items[i] = items_sorted[i];
+  }
+
+  presorted.items = items;
+  presorted.items_count = TMV_ARRAY_SIZE(items);
+  presorted.rects = rects;
+
+  assert(tmv_model_presorted(&presorted));
+  assert(tmv_squarify(&presorted, area));
+  assert(presorted.rects_count == orphans.rects_count);
+
+  for (i = 0; i < presorted.rects_count; ++i)
+  {
+    assert(tmv_test_rect_equals(&rects[i], &rects_sorted[i]));
+  }
+
+  /* An item whose parent is laid out belongs into the group of that parent, a root behind an orphan is out of order */
+  items[1].parent_id = 10;
+  assert(!tmv_items_layout_ordered(items, TMV_ARRAY_SIZE(items)));
+  items[1].parent_id = 1000;
+  items[2].parent_id = -1;
+  assert(!tmv_items_layout_ordered(items, TMV_ARRAY_SIZE(items)));
+}
+
+void tmv_test_preorder(void)
+{
+  tmv_rect area = {0, 0.0, 0.0, 100.0, 100.0};
+  tmv_rect rects[13];
+  tmv_rect rects_back[13];
+  tmv_rect rects_slice[6];
+  tmv_item preorder[13];
+  tmv_item items_back[13];
+  tmv_item items_slice[6];
+  unsigned long subtree_sizes[13];
+  unsigned long i;
+  unsigned long j;
+
+  long expected_ids[13] = {1, 10, 100, 1000, 1001, 101, 102, 11, 110, 12, 2, 20, 21};
+  unsigned long expected_sizes[13] = {10, 6, 3, 1, 1, 1, 1, 2, 1, 1, 3, 1, 1};
+  long orphan_ids[13] = {1, 10, 100, 101, 102, 11, 110, 12, 1001, 1000, 2, 20, 21};
+  unsigned long orphan_sizes[13] = {8, 4, 1, 1, 1, 2, 1, 1, 1, 1, 3, 1, 1};
+
+  tmv_item items[TMV_TEST_TREE_ITEMS];
+
+  tmv_model model = {0};
+  tmv_model back = {0};
+  tmv_model slice = {0};
+  tmv_model orphans = {0};
+  tmv_model orphans_back = {0};
+
+  tmv_test_tree_copy(items);
+
+  /* Unsorted items are not in a layout order */
+  assert(!tmv_items_preorder(items, TMV_ARRAY_SIZE(items), preorder, subtree_sizes));
+
+  model.items = items;
+  model.items_count = TMV_ARRAY_SIZE(items);
+  model.rects = rects;
+  model.rects_aligned = 1;
+
+  assert(tmv_squarify(&model, area));
+  assert(tmv_items_preorder(items, TMV_ARRAY_SIZE(items), preorder, subtree_sizes));
+
+  /* Each subtree is one slice, siblings heaviest first */
+  for (i = 0; i < TMV_ARRAY_SIZE(preorder); ++i)
+  {
+    assert(preorder[i].id == expected_ids[i]);
+    assert(subtree_sizes[i] == expected_sizes[i]);
+    assert(preorder[i].children_offset_index == (preorder[i].children_count > 0 ? i + 1 : 0));
+  }
+  assert(preorder[0].children_count == 3 && preorder[1].children_count == 3 && preorder[10].children_count == 2);
+
+  /* Back to the layout order, the layout is the same */
+  assert(tmv_items_from_preorder(preorder, subtree_sizes, TMV_ARRAY_SIZE(preorder), items_back));
+
+  back.items = items_back;
+  back.items_count = TMV_ARRAY_SIZE(items_back);
+  back.rects = rects_back;
+  back.rects_aligned = 1;
+
+  assert(tmv_model_presorted(&back));
+  assert(tmv_squarify(&back, area));
+
+  for (i = 0; i < TMV_ARRAY_SIZE(items); ++i)
+  {
+    assert(items_back[i].id == items[i].id);
+    assert(tmv_test_rect_equals(&rects_back[i], &rects[i]));
+  }
+
+  /* The subtree of 10 on its own, laid out into the rect it has in the full layout */
+  assert(tmv_items_from_preorder(&preorder[1], &subtree_sizes[1], subtree_sizes[1], items_slice));
+  assert(items_slice[0].id == 10 && items_slice[0].parent_id == -1);
+  assert(items_slice[0].children_offset_index == 1 && items_slice[0].children_count == 3);
+
+  slice.items = items_slice;
+  slice.items_count = TMV_ARRAY_SIZE(items_slice);
+  slice.rects = rects_slice;
+  slice.rects_aligned = 1;
+
+  assert(tmv_model_presorted(&slice));
+  assert(tmv_squarify(&slice, rects[2]));
+
+  for (i = 1; i < TMV_ARRAY_SIZE(items_slice); ++i)
+  {
+    for (j = 0; j < TMV_ARRAY_SIZE(items); ++j)
+    {
+      if (items[j].id == items_slice[i].id)
+      {
+        assert_equalsd((double)rects_slice[i].x, (double)rects[j].x, (double)TVM_TEST_EPSILON);
+        assert_equalsd((double)rects_slice[i].y, (double)rects[j].y, (double)TVM_TEST_EPSILON);
+        assert_equalsd((double)rects_slice[i].width, (double)rects[j].width, (double)TVM_TEST_EPSILON);
+        assert_equalsd((double)rects_slice[i].height, (double)rects[j].height, (double)TVM_TEST_EPSILON);
+      }
+    }
+  }
+
+  /* Subtree sizes that do not tile the slice */
+  subtree_sizes[1] = 7;
+  assert(!tmv_items_from_preorder(preorder, subtree_sizes, TMV_ARRAY_SIZE(preorder), items_back));
+  subtree_sizes[1] = 6;
+  assert(!tmv_items_from_preorder(preorder, subtree_sizes, 12, items_back));
+
+  /* The orphan 2 with its children and the cycle 1000 <-> 1001 follow the subtree of the root and keep their parents */
+  tmv_test_tree_copy(items);
+  items[1].parent_id = 9999;
+  items[10].parent_id = 1001;
+  items[11].parent_id = 1000;
+
+  orphans.items = items;
+  orphans.items_count = TMV_ARRAY_SIZE(items);
+  orphans.rects = rects;
+
+  assert(tmv_squarify(&orphans, area));
+  assert(tmv_items_preorder(items, TMV_ARRAY_SIZE(items), preorder, subtree_sizes));
+
+  for (i = 0; i < TMV_ARRAY_SIZE(preorder); ++i)
+  {
+    assert(preorder[i].id == orphan_ids[i]);
+    assert(subtree_sizes[i] == orphan_sizes[i]);
+  }
+  assert(preorder[10].parent_id == 9999 && preorder[10].children_offset_index == 11);
+
+  assert(tmv_items_from_preorder(preorder, subtree_sizes, TMV_ARRAY_SIZE(preorder), items_back));
+
+  for (i = 0; i < TMV_ARRAY_SIZE(items); ++i)
+  {
+    assert(items_back[i].id == items[i].id && items_back[i].parent_id == items[i].parent_id);
+  }
+
+  orphans_back.items = items_back;
+  orphans_back.items_count = TMV_ARRAY_SIZE(items_back);
+  orphans_back.rects = rects_back;
+
+  assert(tmv_model_presorted(&orphans_back));
+  assert(tmv_squarify(&orphans_back, area));
+  assert(orphans_back.rects_count == 8 && orphans_back.rects_count == orphans.rects_count);
+
+  for (i = 0; i < orphans.rects_count; ++i)
+  {
+    assert(tmv_test_rect_equals(&rects_back[i], &rects[i]));
+  }
+}
+
+#ifdef TMV_PROFILE
+void tmv_test_profile(void)
+{
+  tmv_rect area = {0, 0.0, 0.0, 100.0, 100.0};
+  tmv_rect rects[13];
+  tmv_rect rects_other[13];
+  tmv_profile profile = {0};
+  tmv_profile first;
+
+  tmv_item items[TMV_TEST_TREE_ITEMS];
+
+  tmv_item items_other[TMV_TEST_TREE_ITEMS];
+
+  tmv_model model = {0};
+  tmv_model other = {0};
+
+  tmv_test_tree_copy(items);
+  tmv_test_tree_copy(items_other);
+
+  model.items = items;
+  model.items_count = TMV_ARRAY_SIZE(items);
+  model.rects = rects;
+  model.rects_aligned = 1;
+  model.profile = &profile;
+
+  assert(tmv_squarify(&model, area));
+
+  /* Every item is visited once by the depth pass, each one with a parent looks it up */
+  assert(profile.depth_steps == 13);
+  assert(profile.parent_lookups >= 11);
+  assert(profile.group_searches == 2 * 13);
+  assert(profile.sort_moves > 0);
+
+  /* Each of the 13 items is a row candidate, at most twice, and ends up in one of the rows */
+  assert(profile.row_candidates >= 13 && profile.row_candidates <= 2 * 13);
+  assert(profile.rows >= 6 && profile.rows <= 13);
+  assert(profile.cycles[TMV_PROFILE_DEPTH] >= 0 && profile.cycles[TMV_PROFILE_LAYOUT] >= 0);
+
+  /* The counters add up, a sorted model skips the sort */
+  first = profile;
+  assert(tmv_squarify(&model, area));
+  assert(profile.depth_steps == first.depth_steps);
+  assert(profile.sort_moves == first.sort_moves);
+  assert(profile.rows == 2 * first.rows);
+  assert(profile.row_candidates == 2 * first.row_candidates);
+
+  /* A model without a profile leaves it alone */
+  first = profile;
+  other.items = items_other;
+  other.items_count = TMV_ARRAY_SIZE(items_other);
+  other.rects = rects_other;
+  assert(tmv_squarify(&other, area));
+  assert(profile.depth_steps == first.depth_steps && profile.rows == first.rows && profile.parent_lookups == first.parent_lookups);
+}
+
+#define TMV_TEST_GROWTH_ITEMS 4096 /* The work for n items is compared with the work for 2n */
+
+#define TMV_TEST_GROWTH_RANDOM 0 /* Each item hangs below a random earlier item */
+#define TMV_TEST_GROWTH_WIDE 1   /* One root with all other items as its children */
+#define TMV_TEST_GROWTH_CHAIN 2  /* Each item is the only child of the previous one */
+#define TMV_TEST_GROWTH_KARY 3   /* Balanced tree with 4 children per item */
+#define TMV_TEST_GROWTH_SHAPES 4
+
+tmv_item tmv_test_growth_items[2 * TMV_TEST_GROWTH_ITEMS];
+tmv_rect tmv_test_growth_rects[2 * TMV_TEST_GROWTH_ITEMS];
+unsigned long tmv_test_growth_scratch[2 * 2 * TMV_TEST_GROWTH_ITEMS * 3 + 256];
+
+/* Lays out a generated tree and returns its work counters, radix selects the sort with scratch memory
+   and aligned the aligned rects, the emission order rects have no index for the parent rect lookups */
+tmv_profile tmv_test_growth_profile(int shape, unsigned long count, int radix, int aligned)
+{
+  tmv_rect area = {0, 0.0, 0.0, 1000.0, 1000.0};
+  tmv_profile profile = {0};
+  unsigned long seed = 1;
+  unsigned long i;
+
+  tmv_model model = {0};
+
+  for (i = 0; i < count; ++i)
+  {
+    tmv_item item = {0};
+
+    seed = (seed * 1103515245UL + 12345UL) & 0x7FFFFFFFUL;
+
+    item.id = (long)i;
+    item.parent_id = (i == 0) ? -1 : (long)(seed % i);
+    item.weight = (tmv_real)(seed % 1000 + 1);
+
+    if (shape == TMV_TEST_GROWTH_RANDOM)
+    {
+      /* The random parent drawn above */
+    }
+    else if (shape == TMV_TEST_GROWTH_WIDE)
+    {
+      item.parent_id = (i == 0) ? -1 : 0;
+    }
+    else if (shape == TMV_TEST_GROWTH_CHAIN)
+    {
+      item.parent_id = (long)i - 1;
+      item.weight = (tmv_real)(count - i);
+    }
+    else if (shape == TMV_TEST_GROWTH_KARY)
+    {
+      item.parent_id = (i == 0) ? -1 : (long)((i - 1) / 4);
+    }
+
+    tmv_test_growth_items[i] = item;
+  }
+
+  model.items = tmv_test_growth_items;
+  model.items_count = count;
+  model.rects = tmv_test_growth_rects;
+  model.rects_aligned = aligned;
+  model.profile = &profile;
+
+  if (radix)
+  {
+    model.scratch = tmv_test_growth_scratch;
+    model.scratch_size = sizeof(tmv_test_growth_scratch);
+  }
+
+  assert(tmv_squarify(&model, area));
+
+  return profile;
+}
+
+/* Doubling the items may at most double the work of linear passes, integer math so float builds agree */
+#define TMV_TEST_GROWTH_LINEAR(n, n2) assert(10 * (n2) < 22 * (n) && (n) > 0)
+
+/* The comparison sorts need n log n moves, 2n items take 2 + 2 / log2(n) times the moves of n items */
+#define TMV_TEST_GROWTH_NLOGN(n, n2) assert(10 * (n2) < 25 * (n) && (n) > 0)
+
+void tmv_test_profile_growth(void)
+{
+  int shape;
+  int radix;
+  int aligned;
+
+  assert(tmv_items_sort_scratch_size(2 * TMV_TEST_GROWTH_ITEMS) <= sizeof(tmv_test_growth_scratch));
+
+  for (shape = TMV_TEST_GROWTH_RANDOM; shape < TMV_TEST_GROWTH_SHAPES; ++shape)
+  {
+    for (radix = 0; radix <= 1; ++radix)
+    {
+      /* The emission order rects are found by their position in the scratch memory, without it they are searched */
+      for (aligned = radix ? 0 : 1; aligned <= 1; ++aligned)
+      {
+        tmv_profile n = tmv_test_growth_profile(shape, TMV_TEST_GROWTH_ITEMS, radix, aligned);
+        tmv_profile n2 = tmv_test_growth_profile(shape, 2 * TMV_TEST_GROWTH_ITEMS, radix, aligned);
+
+        /* A quadratic depth loop, row rescan or id search would take four times the work */
+        TMV_TEST_GROWTH_LINEAR(n.depth_steps, n2.depth_steps);
+        TMV_TEST_GROWTH_LINEAR(n.parent_lookups, n2.parent_lookups);
+        TMV_TEST_GROWTH_LINEAR(n.group_searches, n2.group_searches);
+        TMV_TEST_GROWTH_LINEAR(n.row_candidates, n2.row_candidates);
+        TMV_TEST_GROWTH_LINEAR(n.rows, n2.rows);
+
+        /* The id sort of the depth pass is a heap sort, an insertion sort would be quadratic */
+        TMV_TEST_GROWTH_NLOGN(n.sort_moves, n2.sort_moves);
+
+        /* The binary searches probe log n items per call, a linear scan would probe n */
+        TMV_TEST_GROWTH_NLOGN(n.search_probes, n2.search_probes);
+
+        /* Every item is a row candidate at most twice */
+        assert(n2.row_candidates <= 2 * 2 * TMV_TEST_GROWTH_ITEMS);
+      }
+    }
+  }
+}
+#endif
+
+void tmv_test_weight_sum(void)
+{
+  tmv_item items[103];
+  tmv_real weights[TMV_ARRAY_SIZE(items)];
+  tmv_real expected = 0;
+  unsigned long i;
+
+  /* Weights without an exact binary representation, their sum depends on the order of the additions */
+  for (i = 0; i < TMV_ARRAY_SIZE(items); ++i)
+  {
+    tmv_item item = {0};
+    item.id = (long)i;
+    item.parent_id = -1;
+    item.weight = (tmv_real)1 / (tmv_real)(i % 7 + 3) + (tmv_real)i * (tmv_real)0.1;
+    items[i] = item;
+    weights[i] = item.weight;
+  }
+
+#ifndef TMV_LANE_SUMS
+  /* The sum of the plain loop the layout always used, so the rects stay the same bit for bit */
+  for (i = 0; i < TMV_ARRAY_SIZE(items); ++i)
+  {
+    expected += weights[i];
+  }
+#else
+  expected = tmv_sum_scalar(weights, sizeof(tmv_real), TMV_ARRAY_SIZE(weights));
+#endif
+
+  assert(tmv_total_weight(items, TMV_ARRAY_SIZE(items)) == expected);
+  assert(tmv_sum(weights, TMV_ARRAY_SIZE(weights)) == expected);
+  assert(tmv_total_weight(items, 0) == 0);
+}
+
+void tmv_test_precision(void)
+{
+  unsigned long i;
+  unsigned long j;
+
+  tmv_rect area = {0, 0.0, 0.0, 1920.0, 1080.0};
+  tmv_rect rects[TMV_MAX_RECTS];
+  tmv_item items[257];
+
+  tmv_model model = {0};
+
+  /* One root with 256 children whose weights span four orders of magnitude */
+  items[0].id = 0;
+  items[0].parent_id = -1;
+  items[0].weight = 0;
+
+  for (i = 1; i < TMV_ARRAY_SIZE(items); ++i)
+  {
+    items[i].id = (long)i;
+    items[i].parent_id = 0;
+    items[i].weight = (tmv_real)((i * 7919) % 10007 + 1);
+    items[0].weight += items[i].weight;
+  }
+
+  model.items = items;
+  model.items_count = TMV_ARRAY_SIZE(items);
+  model.rects = rects;
+  model.rects_aligned = 1;
+
+  tmv_squarify(&model, area);
+
+  assert(model.rects_count == TMV_ARRAY_SIZE(items));
+
+  /* The areas, recomputed in double, are proportional to the weights */
+  for (i = 0; i < model.items_count; ++i)
+  {
+    tmv_rect parent = model.rects[i];
+    double parent_area = (double)parent.width * (double)parent.height;
+
+    for (j = 0; j < model.items[i].children_count; ++j)
+    {
+      unsigned long child_index = model.items[i].children_offset_index + j;
+      tmv_rect child = model.rects[child_index];
+      double expected = parent_area * (double)model.items[child_index].weight / (double)model.items[i].weight;
+
+      assert_equalsd((double)child.width * (double)child.height / expected, 1.0, (double)TVM_TEST_EPSILON);
+      assert(child.x >= parent.x - TVM_TEST_EPSILON && child.x + child.width <= parent.x + parent.width + TVM_TEST_EPSILON);
+      assert(child.y >= parent.y - TVM_TEST_EPSILON && child.y + child.height <= parent.y + parent.height + TVM_TEST_EPSILON);
+    }
   }
 }
 
@@ -421,6 +2645,33 @@ int main(void)
   tmv_test_simple_recursive_layout();
   tmv_test_simple_more_items();
   tmv_test_flat_tree();
+  tmv_test_depth_sort_cycle();
+  tmv_test_sort_scratch();
+  tmv_test_index();
+  tmv_test_rects_aligned();
+  tmv_test_model_soa();
+  tmv_test_relayout_dirty();
+  tmv_test_collapse();
+  tmv_test_squarify_subtree();
+  tmv_test_squarify_stream();
+  tmv_test_squarify_deep_chain();
+  tmv_test_span();
+  tmv_test_emission_positions();
+  tmv_test_arena();
+  tmv_test_layout_engines();
+  tmv_test_layout_ordered();
+  tmv_test_layout_pivot_deep();
+  tmv_test_aggregate_weights();
+  tmv_test_hit_test();
+  tmv_test_layout_diff();
+  tmv_test_csr();
+  tmv_test_preorder();
+#ifdef TMV_PROFILE
+  tmv_test_profile();
+  tmv_test_profile_growth();
+#endif
+  tmv_test_weight_sum();
+  tmv_test_precision();
   tmv_test_binary_decode();
 
   return 0;
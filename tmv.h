@@ -23,457 +23,3791 @@ LICENSE
 #elif defined(_MSC_VER)
 #define TMV_INLINE __inline
 #else
-#define TMV_INLINE
+#define TMV_INLINE
 #endif
 
 #define TMV_API static
 
+/* SIMD kernels are picked at compile time (SSE2 or AVX), define TMV_NO_SIMD to use the scalar code only */
+#if !defined(TMV_NO_SIMD) && defined(__AVX__)
+#include <immintrin.h>
+#define TMV_SIMD_AVX
+#elif !defined(TMV_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define TMV_SIMD_SSE2
+#endif
+
 #define TMV_ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
 #define TMV_FIRST_VALID_PARENT_ID 0
 
-typedef struct tmv_item
-{
+/* The scalar type of weights and coordinates, define TMV_REAL as float to halve the rect memory */
+#ifndef TMV_REAL
+#define TMV_REAL double
+#endif
+
+typedef TMV_REAL tmv_real;
+
+typedef struct tmv_item
+{
+
+  /* User provided fields */
+  long id;        /* The id of this item that is also used for the computed tmv_rect */
+  long parent_id; /* The parent id of this item */
+  tmv_real weight; /* The weight of the item */
+
+  /* Computed fields */
+  unsigned long children_offset_index; /* The tmv_item index where the childrens are located */
+  unsigned long children_count;        /* The number of childrens */
+
+} tmv_item;
+
+typedef struct tmv_rect
+{
+  long id;
+
+  tmv_real x;
+  tmv_real y;
+  tmv_real width;
+  tmv_real height;
+
+} tmv_rect;
+
+typedef struct tmv_stats
+{
+  tmv_real weigth_min;
+  tmv_real weigth_max;
+  tmv_real weigth_sum;
+  unsigned long count;
+
+} tmv_stats;
+
+typedef struct tmv_index_entry
+{
+  long id;            /* The item id */
+  unsigned long item; /* The index of the item in tmv_model.items */
+  unsigned long rect; /* The index of the rect in tmv_model.rects or TMV_INDEX_NONE if there is none */
+
+} tmv_index_entry;
+
+typedef struct tmv_index
+{
+  tmv_index_entry *entries; /* Caller provided memory, see tmv_index_memory_size */
+  unsigned long capacity;   /* The number of entries (power of two) */
+  int dense;                /* The ids are 0..n-1 and entries[id] belongs to id */
+
+} tmv_index;
+
+/* The phases of tmv_profile.cycles */
+#define TMV_PROFILE_DEPTH 0   /* The topological depth pass */
+#define TMV_PROFILE_SORT 1    /* The layout order sort */
+#define TMV_PROFILE_OFFSETS 2 /* The children offsets of the sorted items */
+#define TMV_PROFILE_LAYOUT 3  /* The rects of tmv_squarify and tmv_relayout_dirty */
+#define TMV_PROFILE_PHASES 4
+
+/* Work counters of the layout pipeline, only filled if TMV_PROFILE is defined, see tmv_model.profile.
+   They add up over calls, zero the struct to start over. */
+typedef struct tmv_profile
+{
+  unsigned long depth_steps;    /* Items visited by the depth pass on the way up to a known ancestor */
+  unsigned long sort_moves;     /* Items written by the sorts, a swap counts as two */
+  unsigned long parent_lookups; /* Searches for the parent item or the parent rect of an item */
+  unsigned long group_searches; /* Searches for the children group of an item */
+  unsigned long search_probes;  /* Items compared by the id and group searches and the rect lookups */
+  unsigned long row_candidates; /* Items tested by the row search of tmv_squarify_current */
+  unsigned long rows;           /* Rows that have been laid out */
+
+  double cycles[TMV_PROFILE_PHASES];       /* Time stamp counter cycles spent per phase, 0 without a counter */
+  double cycles_start[TMV_PROFILE_PHASES]; /* The start of a running phase */
+
+} tmv_profile;
+
+/* Called at the start (begin 1) and at the end (begin 0) of the sort and of each laid out sibling group, for tracing.
+   item is the parent of the group, 0 for the roots and the sort steps. */
+typedef void (*tmv_span_hook)(void *user_data, const char *name, tmv_item *item, int begin);
+
+typedef struct tmv_model
+{
+  tmv_stats stats;                    /* The calculated stats and metrics  */
+  int items_sorted;                   /* Did the items have been sorted */
+  int rects_aligned;                  /* Layout mode where rects[i] belongs to items[i] after sorting */
+  unsigned long items_count;          /* The number of items */
+  unsigned long items_user_data_size; /* The user_data size per item */
+  unsigned long rects_count;          /* The output rects that have been computed */
+  tmv_item *items;                    /* The treemap items, each group sorted by weight (desc) unless the engine keeps the order */
+  tmv_rect *rects;                    /* The output rects that have been computed */
+  unsigned long rects_capacity;       /* The number of rects that fit into rects, 0 if there is one per item */
+  unsigned long rects_dropped;        /* The number of emission order rects that did not fit into rects_capacity */
+  void *scratch;                      /* Optional scratch memory for sorting, the emission order rect positions, the subtree layout path and the id join of tmv_layout_diff, see tmv_items_sort_scratch_size */
+  unsigned long scratch_size;         /* The size of the scratch memory in bytes */
+  tmv_index *index;                   /* Optional id index for item and rect lookups, see tmv_index_init */
+  unsigned char *dirty;               /* Optional items_count flags for tmv_update_weight, see tmv_relayout_dirty */
+  tmv_real min_side;                  /* Subtrees in a rect with a side below min_side are collapsed into it, 0 lays out all */
+  unsigned long collapsed_count;      /* The number of items whose children have been skipped for min_side */
+  int layout_engine;                  /* How a sibling group is split up, one of TMV_LAYOUT_*, 0 squarifies */
+  unsigned long *subtree_sizes;       /* Optional items_count sizes, the items in the subtree of items[i] including it, see tmv_aggregate_weights */
+  unsigned long depth_max;            /* The depth of the deepest item (roots are 0), see tmv_aggregate_weights */
+  tmv_profile *profile;               /* Optional work counters, filled if TMV_PROFILE is defined. Not thread-safe: models laid out
+                                         at once by tmv_squarify_batch need a profile each, tmv_squarify_parallel only counts its serial part */
+  tmv_span_hook span;                 /* Optional hook around the steps of tmv_model_sort and tmv_squarify, called by the thread laying out the model */
+  void *span_user_data;               /* Passed to span */
+
+} tmv_model;
+
+/* A range of rects that has been written by tmv_relayout_dirty */
+typedef struct tmv_rect_range
+{
+  unsigned long offset; /* The first rect */
+  unsigned long count;  /* The number of rects */
+
+} tmv_rect_range;
+
+/* Receives the rects of one laid out sibling group, rects[i] belongs to items[i]. Returns 0 to stop the layout. */
+typedef int (*tmv_rect_sink)(void *user_data, tmv_rect *rects, tmv_item *items, unsigned long count);
+
+/* A rect that differs between two layouts, see tmv_layout_diff */
+typedef struct tmv_change
+{
+  long id;           /* The item id */
+  int flags;         /* TMV_CHANGE_* */
+  tmv_rect old_rect; /* The rect in the old layout, zero if it has been added */
+  tmv_rect new_rect; /* The rect in the new layout, zero if it has been removed */
+
+} tmv_change;
+
+/* The model as separate arrays, the layout only touches the weights and coordinates.
+   Item i is in the order of tmv_items_depth_sort_offset and its rect is x[i], y[i], w[i], h[i]. */
+typedef struct tmv_model_soa
+{
+  tmv_stats stats;                  /* The calculated stats and metrics  */
+  unsigned long items_count;        /* The number of items */
+  long *ids;                        /* The item ids */
+  long *parent_ids;                 /* The parent item ids */
+  tmv_real *weights;                /* The item weights */
+  unsigned long *children_offsets;  /* The index where the children of item i are located */
+  unsigned long *children_counts;   /* The number of children of item i */
+  tmv_real *x;                      /* The rect of item i, w[i] is -1 if the item has not been laid out */
+  tmv_real *y;
+  tmv_real *w;
+  tmv_real *h;
+  tmv_real min_side;             /* Subtrees in a rect with a side below min_side are collapsed into it, 0 lays out all */
+  unsigned long collapsed_count; /* The number of items whose children have been skipped for min_side */
+  tmv_profile *profile;          /* Optional work counters like tmv_model.profile, the layout phase only */
+
+} tmv_model_soa;
+
+/* ########################################################## */
+/* # Profile                                                  */
+/* ########################################################## */
+#ifdef TMV_PROFILE
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h> /* __rdtsc */
+#endif
+
+TMV_API TMV_INLINE double tmv_profile_cycles(void)
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+  return (double)__rdtsc();
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+  return (double)__builtin_ia32_rdtsc();
+#elif (defined(__GNUC__) || defined(__clang__)) && defined(__aarch64__)
+  unsigned long ticks;
+  __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(ticks));
+  return (double)ticks;
+#else
+  return 0.0;
+#endif
+}
+
+TMV_API TMV_INLINE void tmv_profile_begin(tmv_profile *profile, int phase)
+{
+  if (profile)
+  {
+    profile->cycles_start[phase] = tmv_profile_cycles();
+  }
+}
+
+TMV_API TMV_INLINE void tmv_profile_end(tmv_profile *profile, int phase)
+{
+  if (profile)
+  {
+    profile->cycles[phase] += tmv_profile_cycles() - profile->cycles_start[phase];
+  }
+}
+
+/* The profile is passed down explicitly, usually model->profile, 0 counts nothing */
+#define TMV_PROFILE_COUNT(profile, counter, n) ((profile) ? (void)((profile)->counter += (n)) : (void)0)
+#define TMV_PROFILE_BEGIN(profile, phase) tmv_profile_begin(profile, phase)
+#define TMV_PROFILE_END(profile, phase) tmv_profile_end(profile, phase)
+
+#else
+
+#define TMV_PROFILE_COUNT(profile, counter, n) ((void)(profile))
+#define TMV_PROFILE_BEGIN(profile, phase) ((void)(profile))
+#define TMV_PROFILE_END(profile, phase) ((void)(profile))
+
+#endif
+
+/* Weights are read with a byte stride, so the same code runs on tmv_item.weight and on plain weight arrays */
+TMV_API TMV_INLINE tmv_real tmv_weight_at(tmv_real *weights, unsigned long stride, unsigned long i)
+{
+  return *(tmv_real *)(void *)((char *)weights + i * stride);
+}
+
+/* A rect with children is collapsed if one of its sides is below min_side, it stands in for its whole subtree */
+TMV_API TMV_INLINE int tmv_collapsed(tmv_real min_side, tmv_real width, tmv_real height)
+{
+  return min_side > 0 && (width < min_side || height < min_side);
+}
+
+/* Weight sums add the weights one after the other, so every build computes the rects of a plain loop.
+   Define TMV_LANE_SUMS to add them in TMV_SUM_LANES interleaved partial sums, lanes[i % 4] += weights[i],
+   added up as (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]), which the SSE2/AVX code vectorizes. That
+   rounds differently in the last bits, the scalar, SSE2 and AVX code keep the lane order among each other. */
+#define TMV_SUM_LANES 4
+
+TMV_API TMV_INLINE tmv_real tmv_sum_lanes(tmv_real *lanes)
+{
+  return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+TMV_API TMV_INLINE tmv_real tmv_sum_scalar(tmv_real *weights, unsigned long stride, unsigned long count)
+{
+#ifdef TMV_LANE_SUMS
+  tmv_real lanes[TMV_SUM_LANES] = {0, 0, 0, 0};
+  unsigned long i;
+  for (i = 0; i < count; ++i)
+  {
+    lanes[i % TMV_SUM_LANES] += tmv_weight_at(weights, stride, i);
+  }
+  return tmv_sum_lanes(lanes);
+#else
+  tmv_real sum = 0;
+  unsigned long i;
+  for (i = 0; i < count; ++i)
+  {
+    sum += tmv_weight_at(weights, stride, i);
+  }
+  return sum;
+#endif
+}
+
+/* Sum of contiguous weights. The SIMD code picks the float or double intrinsics by the size of
+   tmv_real, the other branch is dead code. Floats keep the four lanes in one SSE register. */
+TMV_API TMV_INLINE tmv_real tmv_sum(tmv_real *weights, unsigned long count)
+{
+#ifdef TMV_LANE_SUMS
+  tmv_real lanes[TMV_SUM_LANES] = {0, 0, 0, 0};
+  unsigned long vectorized = 0;
+  unsigned long i;
+
+#if defined(TMV_SIMD_AVX) || defined(TMV_SIMD_SSE2)
+  vectorized = count - count % TMV_SUM_LANES;
+
+  if (sizeof(tmv_real) == sizeof(float))
+  {
+    float *values = (float *)(void *)weights;
+    float sums[TMV_SUM_LANES];
+    __m128 sum = _mm_setzero_ps();
+    for (i = 0; i < vectorized; i += TMV_SUM_LANES)
+    {
+      sum = _mm_add_ps(sum, _mm_loadu_ps(&values[i]));
+    }
+    _mm_storeu_ps(sums, sum);
+
+    for (i = 0; i < TMV_SUM_LANES; ++i)
+    {
+      lanes[i] = (tmv_real)sums[i];
+    }
+  }
+  else
+  {
+    double *values = (double *)(void *)weights;
+    double sums[TMV_SUM_LANES];
+#if defined(TMV_SIMD_AVX)
+    __m256d sum = _mm256_setzero_pd();
+    for (i = 0; i < vectorized; i += TMV_SUM_LANES)
+    {
+      sum = _mm256_add_pd(sum, _mm256_loadu_pd(&values[i]));
+    }
+    _mm256_storeu_pd(sums, sum);
+#else
+    __m128d sum_low = _mm_setzero_pd();
+    __m128d sum_high = _mm_setzero_pd();
+    for (i = 0; i < vectorized; i += TMV_SUM_LANES)
+    {
+      sum_low = _mm_add_pd(sum_low, _mm_loadu_pd(&values[i]));
+      sum_high = _mm_add_pd(sum_high, _mm_loadu_pd(&values[i + 2]));
+    }
+    _mm_storeu_pd(sums, sum_low);
+    _mm_storeu_pd(&sums[2], sum_high);
+#endif
+
+    for (i = 0; i < TMV_SUM_LANES; ++i)
+    {
+      lanes[i] = (tmv_real)sums[i];
+    }
+  }
+#endif
+
+  for (i = vectorized; i < count; ++i)
+  {
+    lanes[i % TMV_SUM_LANES] += weights[i];
+  }
+
+  return tmv_sum_lanes(lanes);
+#else
+  return tmv_sum_scalar(weights, sizeof(tmv_real), count);
+#endif
+}
+
+TMV_API TMV_INLINE tmv_real tmv_total_weight_strided(tmv_real *weights, unsigned long stride, unsigned long count)
+{
+  return (stride == sizeof(tmv_real)) ? tmv_sum(weights, count) : tmv_sum_scalar(weights, stride, count);
+}
+
+TMV_API TMV_INLINE tmv_real tmv_total_weight(tmv_item *items, unsigned long count)
+{
+  return count ? tmv_total_weight_strided(&items->weight, sizeof(tmv_item), count) : 0;
+}
+
+/* sizes[i] = weights[i] * scale / side. Each size only depends on its own weight, so the SIMD and
+   scalar results are the same. */
+TMV_API TMV_INLINE void tmv_row_sizes_scalar(tmv_real *weights, unsigned long count, tmv_real scale, tmv_real side, tmv_real *sizes)
+{
+  unsigned long i;
+  for (i = 0; i < count; ++i)
+  {
+    sizes[i] = (weights[i] * scale) / side;
+  }
+}
+
+TMV_API TMV_INLINE void tmv_row_sizes(tmv_real *weights, unsigned long count, tmv_real scale, tmv_real side, tmv_real *sizes)
+{
+  unsigned long vectorized = 0;
+
+#if defined(TMV_SIMD_AVX) || defined(TMV_SIMD_SSE2)
+  unsigned long i;
+
+  if (sizeof(tmv_real) == sizeof(float))
+  {
+    float *values = (float *)(void *)weights;
+    float *out = (float *)(void *)sizes;
+#if defined(TMV_SIMD_AVX)
+    __m256 scale8 = _mm256_set1_ps((float)scale);
+    __m256 side8 = _mm256_set1_ps((float)side);
+    vectorized = count - count % 8;
+    for (i = 0; i < vectorized; i += 8)
+    {
+      _mm256_storeu_ps(&out[i], _mm256_div_ps(_mm256_mul_ps(_mm256_loadu_ps(&values[i]), scale8), side8));
+    }
+#else
+    __m128 scale4 = _mm_set1_ps((float)scale);
+    __m128 side4 = _mm_set1_ps((float)side);
+    vectorized = count - count % 4;
+    for (i = 0; i < vectorized; i += 4)
+    {
+      _mm_storeu_ps(&out[i], _mm_div_ps(_mm_mul_ps(_mm_loadu_ps(&values[i]), scale4), side4));
+    }
+#endif
+  }
+  else
+  {
+    double *values = (double *)(void *)weights;
+    double *out = (double *)(void *)sizes;
+#if defined(TMV_SIMD_AVX)
+    __m256d scale4 = _mm256_set1_pd((double)scale);
+    __m256d side4 = _mm256_set1_pd((double)side);
+    vectorized = count - count % 4;
+    for (i = 0; i < vectorized; i += 4)
+    {
+      _mm256_storeu_pd(&out[i], _mm256_div_pd(_mm256_mul_pd(_mm256_loadu_pd(&values[i]), scale4), side4));
+    }
+#else
+    __m128d scale2 = _mm_set1_pd((double)scale);
+    __m128d side2 = _mm_set1_pd((double)side);
+    vectorized = count - count % 2;
+    for (i = 0; i < vectorized; i += 2)
+    {
+      _mm_storeu_pd(&out[i], _mm_div_pd(_mm_mul_pd(_mm_loadu_pd(&values[i]), scale2), side2));
+    }
+#endif
+  }
+#endif
+
+  tmv_row_sizes_scalar(&weights[vectorized], count - vectorized, scale, side, &sizes[vectorized]);
+}
+
+TMV_API TMV_INLINE tmv_item *tmv_find_item_by_id(tmv_item *items, unsigned long count, long id)
+{
+  unsigned long i;
+
+  for (i = 0; i < count; ++i)
+  {
+    if (items[i].id == id)
+    {
+      return &items[i];
+    }
+  }
+
+  return 0;
+}
+
+TMV_API TMV_INLINE tmv_rect *tmv_find_rect_by_id(tmv_rect *rects, unsigned long count, long id)
+{
+  unsigned long i;
+  for (i = 0; i < count; ++i)
+  {
+    if (rects[i].id == id)
+    {
+      return &rects[i];
+    }
+  }
+  return 0;
+}
+
+#define TMV_DEPTH_UNKNOWN ((unsigned long)-1)
+#define TMV_DEPTH_VISITING ((unsigned long)-2)
+
+/* ########################################################## */
+/* # Id index                                                 */
+/* ########################################################## */
+#define TMV_INDEX_NONE ((unsigned long)-1)
+
+/* The number of entries of an index for count ids, a power of two with at most 50% load */
+TMV_API TMV_INLINE unsigned long tmv_index_capacity(unsigned long count)
+{
+  unsigned long capacity = 2;
+  while (capacity < 2 * count)
+  {
+    capacity <<= 1;
+  }
+  return capacity;
+}
+
+/* The memory in bytes an index for count ids needs */
+TMV_API TMV_INLINE unsigned long tmv_index_memory_size(unsigned long count)
+{
+  return tmv_index_capacity(count) * sizeof(tmv_index_entry);
+}
+
+/* Setup an index in caller provided memory, returns 0 if the memory cannot hold an index for count ids */
+TMV_API TMV_INLINE int tmv_index_init(tmv_index *index, void *memory, unsigned long memory_size, unsigned long count)
+{
+  if (!memory || memory_size < tmv_index_memory_size(count))
+  {
+    index->entries = 0;
+    index->capacity = 0;
+    index->dense = 0;
+    return 0;
+  }
+
+  index->entries = (tmv_index_entry *)memory;
+  index->capacity = tmv_index_capacity(count);
+  index->dense = 0;
+
+  return 1;
+}
+
+TMV_API TMV_INLINE unsigned long tmv_index_hash(long id)
+{
+  unsigned long h = (unsigned long)id;
+  h ^= (h >> 16) >> 16;
+  h = ((h >> 16) ^ h) & 0xFFFFFFFFUL;
+  h = (h * 0x45D9F3BUL) & 0xFFFFFFFFUL;
+  h = ((h >> 16) ^ h) & 0xFFFFFFFFUL;
+  return h;
+}
+
+TMV_API TMV_INLINE tmv_index_entry *tmv_index_find(tmv_index *index, long id)
+{
+  unsigned long mask = index->capacity - 1;
+  unsigned long slot;
+
+  if (!index->entries)
+  {
+    return 0;
+  }
+
+  if (index->dense)
+  {
+    if (id < 0 || (unsigned long)id >= index->capacity || index->entries[id].item == TMV_INDEX_NONE)
+    {
+      return 0;
+    }
+    return &index->entries[id];
+  }
+
+  /* Linear probing, the load is at most 50% so there is always an empty entry */
+  for (slot = tmv_index_hash(id) & mask;; slot = (slot + 1) & mask)
+  {
+    tmv_index_entry *entry = &index->entries[slot];
+    if (entry->item == TMV_INDEX_NONE)
+    {
+      return 0;
+    }
+    if (entry->id == id)
+    {
+      return entry;
+    }
+  }
+}
+
+/* Returns the entry for id, inserting it if needed. Only the first of duplicated ids is kept like a linear search would find it. */
+TMV_API TMV_INLINE tmv_index_entry *tmv_index_insert(tmv_index *index, long id, unsigned long item)
+{
+  unsigned long mask = index->capacity - 1;
+  unsigned long slot;
+
+  for (slot = tmv_index_hash(id) & mask;; slot = (slot + 1) & mask)
+  {
+    tmv_index_entry *entry = &index->entries[slot];
+    if (entry->item == TMV_INDEX_NONE)
+    {
+      entry->id = id;
+      entry->item = item;
+      entry->rect = TMV_INDEX_NONE;
+      return entry;
+    }
+    if (entry->id == id)
+    {
+      return entry;
+    }
+  }
+}
+
+TMV_API TMV_INLINE void tmv_index_clear(tmv_index *index)
+{
+  unsigned long i;
+  for (i = 0; i < index->capacity; ++i)
+  {
+    index->entries[i].item = TMV_INDEX_NONE;
+    index->entries[i].rect = TMV_INDEX_NONE;
+  }
+}
+
+/* Forgets the rect of every entry, the next layout assigns them again */
+TMV_API TMV_INLINE void tmv_index_clear_rects(tmv_index *index)
+{
+  unsigned long i;
+  for (i = 0; i < index->capacity; ++i)
+  {
+    index->entries[i].rect = TMV_INDEX_NONE;
+  }
+}
+
+/* (Re)build the index for the current items and rects of a model in O(n).
+   Dense ids 0..n-1 are stored directly at entries[id] without hashing. */
+TMV_API TMV_INLINE void tmv_index_build(tmv_index *index, tmv_model *model)
+{
+  unsigned long i;
+
+  if (!index->entries)
+  {
+    return;
+  }
+
+  tmv_index_clear(index);
+
+  /* (1) Dense fast path, falls back to hashing on the first id out of range or duplicate */
+  index->dense = 1;
+  for (i = 0; i < model->items_count; ++i)
+  {
+    long id = model->items[i].id;
+    if (id < 0 || (unsigned long)id >= model->items_count || index->entries[id].item != TMV_INDEX_NONE)
+    {
+      index->dense = 0;
+      break;
+    }
+    index->entries[id].id = id;
+    index->entries[id].item = i;
+  }
+
+  /* (2) Open addressing */
+  if (!index->dense)
+  {
+    tmv_index_clear(index);
+    for (i = 0; i < model->items_count; ++i)
+    {
+      tmv_index_insert(index, model->items[i].id, i);
+    }
+  }
+
+  /* (3) Rects of known items */
+  for (i = 0; i < model->rects_count; ++i)
+  {
+    tmv_index_entry *entry = tmv_index_find(index, model->rects[i].id);
+    if (entry && entry->rect == TMV_INDEX_NONE)
+    {
+      entry->rect = i;
+    }
+  }
+}
+
+/* Find an item by id using the model index if there is one, otherwise by a linear search */
+TMV_API TMV_INLINE tmv_item *tmv_model_find_item_by_id(tmv_model *model, long id)
+{
+  if (model->index && model->index->entries)
+  {
+    tmv_index_entry *entry = tmv_index_find(model->index, id);
+    return entry ? &model->items[entry->item] : 0;
+  }
+  return tmv_find_item_by_id(model->items, model->items_count, id);
+}
+
+/* Find a rect by id using the model index if there is one, otherwise by a linear search */
+TMV_API TMV_INLINE tmv_rect *tmv_model_find_rect_by_id(tmv_model *model, long id)
+{
+  tmv_rect *rect;
+
+  if (model->index && model->index->entries)
+  {
+    tmv_index_entry *entry = tmv_index_find(model->index, id);
+    unsigned long position;
+
+    TMV_PROFILE_COUNT(model->profile, search_probes, 1);
+
+    if (!entry)
+    {
+      return 0;
+    }
+
+    position = model->rects_aligned ? entry->item : entry->rect;
+    return (position < model->rects_count && model->rects[position].id == id) ? &model->rects[position] : 0;
+  }
+
+  rect = tmv_find_rect_by_id(model->rects, model->rects_count, id);
+
+  /* The linear search compared every rect up to the found one */
+  TMV_PROFILE_COUNT(model->profile, search_probes, rect ? (unsigned long)(rect - model->rects) + 1 : model->rects_count);
+
+  return rect;
+}
+
+TMV_API TMV_INLINE void tmv_item_swap(tmv_item *a, tmv_item *b)
+{
+  tmv_item tmp = *a;
+  *a = *b;
+  *b = tmp;
+}
+
+/* Orders by id (asc) and the original position stored in children_count (asc) */
+TMV_API TMV_INLINE int tmv_item_compare_id(tmv_item *a, tmv_item *b)
+{
+  if (a->id != b->id)
+  {
+    return (a->id < b->id) ? -1 : 1;
+  }
+  if (a->children_count != b->children_count)
+  {
+    return (a->children_count < b->children_count) ? -1 : 1;
+  }
+  return 0;
+}
+
+/* Orders by depth (asc), parent_id (asc) and the original position (asc) */
+TMV_API TMV_INLINE int tmv_item_compare_group(tmv_item *a, tmv_item *b)
+{
+  if (a->children_offset_index != b->children_offset_index)
+  {
+    return (a->children_offset_index < b->children_offset_index) ? -1 : 1;
+  }
+  if (a->parent_id != b->parent_id)
+  {
+    return (a->parent_id < b->parent_id) ? -1 : 1;
+  }
+  if (a->children_count != b->children_count)
+  {
+    return (a->children_count < b->children_count) ? -1 : 1;
+  }
+  return 0;
+}
+
+/* Orders by depth (asc), parent_id (asc), weight (desc) and the original position (asc) */
+TMV_API TMV_INLINE int tmv_item_compare_layout(tmv_item *a, tmv_item *b)
+{
+  if (a->children_offset_index != b->children_offset_index)
+  {
+    return (a->children_offset_index < b->children_offset_index) ? -1 : 1;
+  }
+  if (a->parent_id != b->parent_id)
+  {
+    return (a->parent_id < b->parent_id) ? -1 : 1;
+  }
+  if (a->weight != b->weight)
+  {
+    return (a->weight > b->weight) ? -1 : 1;
+  }
+  if (a->children_count != b->children_count)
+  {
+    return (a->children_count < b->children_count) ? -1 : 1;
+  }
+  return 0;
+}
+
+typedef int (*tmv_item_compare_function)(tmv_item *a, tmv_item *b);
+
+TMV_API TMV_INLINE void tmv_items_heap_sift_down(tmv_item *items, unsigned long start, unsigned long count, tmv_item_compare_function compare, tmv_profile *profile)
+{
+  unsigned long root = start;
+  unsigned long child;
+
+  while ((child = 2 * root + 1) < count)
+  {
+    if (child + 1 < count && compare(&items[child], &items[child + 1]) < 0)
+    {
+      ++child;
+    }
+    if (compare(&items[root], &items[child]) >= 0)
+    {
+      return;
+    }
+    tmv_item_swap(&items[root], &items[child]);
+    TMV_PROFILE_COUNT(profile, sort_moves, 2);
+    root = child;
+  }
+}
+
+/* In-place heap sort, O(n log n) without any additional memory */
+TMV_API TMV_INLINE void tmv_items_heap_sort(tmv_item *items, unsigned long count, tmv_item_compare_function compare, tmv_profile *profile)
+{
+  unsigned long i;
+
+  if (count < 2)
+  {
+    return;
+  }
+
+  for (i = count / 2; i > 0; --i)
+  {
+    tmv_items_heap_sift_down(items, i - 1, count, compare, profile);
+  }
+
+  for (i = count - 1; i > 0; --i)
+  {
+    tmv_item_swap(&items[0], &items[i]);
+    TMV_PROFILE_COUNT(profile, sort_moves, 2);
+    tmv_items_heap_sift_down(items, 0, i, compare, profile);
+  }
+}
+
+/* Returns the index of the first item with the given id in id sorted items or count if there is none */
+TMV_API TMV_INLINE unsigned long tmv_items_search_id(tmv_item *items, unsigned long count, long id, tmv_profile *profile)
+{
+  unsigned long lo = 0;
+  unsigned long hi = count;
+
+  while (lo < hi)
+  {
+    unsigned long mid = lo + (hi - lo) / 2;
+
+    TMV_PROFILE_COUNT(profile, search_probes, 1);
+
+    if (items[mid].id < id)
+    {
+      lo = mid + 1;
+    }
+    else
+    {
+      hi = mid;
+    }
+  }
+
+  return (lo < count && items[lo].id == id) ? lo : count;
+}
+
+/* Returns the parent index of an item in id sorted items or count for root and orphaned items */
+TMV_API TMV_INLINE unsigned long tmv_items_search_parent(tmv_item *items, unsigned long count, tmv_item *item, tmv_profile *profile)
+{
+  if (item->parent_id < TMV_FIRST_VALID_PARENT_ID)
+  {
+    return count;
+  }
+
+  TMV_PROFILE_COUNT(profile, parent_lookups, 1);
+
+  return tmv_items_search_id(items, count, item->parent_id, profile);
+}
+
+/* Compute the depth of each item into children_offset_index.
+   Items that are part of a parent cycle get depth 0 like orphaned items so neither they nor
+   their descendants are ever laid out. Returns 0 if a cycle has been found, 1 otherwise. */
+TMV_API TMV_INLINE int tmv_items_depth_profile(tmv_item *items, unsigned long count, tmv_profile *profile)
+{
+  unsigned long i, j, s;
+  int acyclic = 1;
+
+  /* (a) Build the parent index by sorting on id and remember the original position */
+  for (i = 0; i < count; ++i)
+  {
+    items[i].children_offset_index = TMV_DEPTH_UNKNOWN;
+    items[i].children_count = i;
+  }
+
+  tmv_items_heap_sort(items, count, tmv_item_compare_id, profile);
+
+  /* (b) Topological pass: walk up to the first known ancestor and assign depths on the way back */
+  for (i = 0; i < count; ++i)
+  {
+    unsigned long length = 0;
+    unsigned long top_depth = 0;
+    int cycle = 0;
+
+    j = i;
+    while (j < count)
+    {
+      unsigned long depth = items[j].children_offset_index;
+
+      if (depth == TMV_DEPTH_VISITING)
+      {
+        cycle = 1;
+        break;
+      }
+      if (depth != TMV_DEPTH_UNKNOWN)
+      {
+        top_depth = depth + 1;
+        break;
+      }
+
+      items[j].children_offset_index = TMV_DEPTH_VISITING;
+      ++length;
+
+      TMV_PROFILE_COUNT(profile, depth_steps, 1);
+
+      j = tmv_items_search_parent(items, count, &items[j], profile);
+    }
+
+    if (cycle)
+    {
+      acyclic = 0;
+    }
+
+    j = i;
+    for (s = 0; s < length; ++s)
+    {
+      items[j].children_offset_index = cycle ? 0 : top_depth + (length - 1 - s);
+      j = tmv_items_search_parent(items, count, &items[j], profile);
+    }
+  }
+
+  /* (c) Restore the original order, each swap moves one item to its final position */
+  for (i = 0; i < count; ++i)
+  {
+    while (items[i].children_count != i)
+    {
+      tmv_item_swap(&items[i], &items[items[i].children_count]);
+      TMV_PROFILE_COUNT(profile, sort_moves, 2);
+    }
+  }
+
+  return acyclic;
+}
+
+TMV_API TMV_INLINE int tmv_items_depth(tmv_item *items, unsigned long count)
+{
+  return tmv_items_depth_profile(items, count, 0);
+}
+
+/* Returns the first index in [start, count) whose (depth, parent_id) is not less than the given one */
+TMV_API TMV_INLINE unsigned long tmv_items_search_group(tmv_item *items, unsigned long start, unsigned long count, unsigned long depth, long parent_id, int upper, tmv_profile *profile)
+{
+  unsigned long lo = start;
+  unsigned long hi = count;
+
+  while (lo < hi)
+  {
+    unsigned long mid = lo + (hi - lo) / 2;
+    unsigned long mid_depth = items[mid].children_offset_index;
+    int before = (mid_depth < depth) ||
+                 (mid_depth == depth && (items[mid].parent_id < parent_id || (upper && items[mid].parent_id == parent_id)));
+
+    TMV_PROFILE_COUNT(profile, search_probes, 1);
+
+    if (before)
+    {
+      lo = mid + 1;
+    }
+    else
+    {
+      hi = mid;
+    }
+  }
+
+  return lo;
+}
+
+/* ########################################################## */
+/* # Radix sort of the layout order                           */
+/* ########################################################## */
+#define TMV_SORT_RADIX 256
+#define TMV_SORT_DIGITS 8
+
+/* A 64 bit sort key split into two 32 bit halves since C89 has no portable 64 bit integer */
+typedef struct tmv_sort_key
+{
+  unsigned long hi;
+  unsigned long lo;
+  unsigned long index; /* The item the key belongs to */
+
+} tmv_sort_key;
+
+/* The scratch memory in bytes tmv_items_sort_layout needs for the radix sort of count items */
+TMV_API TMV_INLINE unsigned long tmv_items_sort_scratch_size(unsigned long count)
+{
+  return 2 * count * sizeof(tmv_sort_key) + TMV_SORT_RADIX * sizeof(unsigned long);
+}
+
+TMV_API TMV_INLINE void tmv_sort_key_unsigned(tmv_sort_key *key, unsigned long value)
+{
+  key->hi = ((value >> 16) >> 16) & 0xFFFFFFFFUL;
+  key->lo = value & 0xFFFFFFFFUL;
+}
+
+/* Maps an id to a key with the order of the ids, the sign bit flipped puts negative ids in front */
+TMV_API TMV_INLINE void tmv_sort_key_id(tmv_sort_key *key, long id)
+{
+  tmv_sort_key_unsigned(key, (unsigned long)id ^ ((~0UL >> 1) + 1));
+}
+
+/* The number of bits needed for value */
+TMV_API TMV_INLINE unsigned long tmv_sort_bits(unsigned long value)
+{
+  unsigned long bits = 0;
+
+  while (value)
+  {
+    value >>= 1;
+    ++bits;
+  }
+
+  return bits;
+}
+
+/* Packs depth above a parent offset of parent_bits bits into one key, the bits of both add up to at most 64 */
+TMV_API TMV_INLINE void tmv_sort_key_group(tmv_sort_key *key, unsigned long depth, unsigned long parent, unsigned long parent_bits)
+{
+  tmv_sort_key_unsigned(key, parent);
+
+  if (parent_bits >= 32)
+  {
+    key->hi |= (depth << (parent_bits - 32)) & 0xFFFFFFFFUL;
+  }
+  else if (parent_bits > 0)
+  {
+    key->lo |= (depth << parent_bits) & 0xFFFFFFFFUL;
+    key->hi |= (depth >> (32 - parent_bits)) & 0xFFFFFFFFUL;
+  }
+  else
+  {
+    tmv_sort_key_unsigned(key, depth);
+  }
+}
+
+/* Maps a weight to a key with descending order of the weight (order preserving float bits, inverted) */
+TMV_API TMV_INLINE void tmv_sort_key_weight_desc(tmv_sort_key *key, double weight)
+{
+  union
+  {
+    double d;
+    unsigned char b[sizeof(double)];
+  } value, probe;
+
+  unsigned long hi = 0;
+  unsigned long lo = 0;
+  unsigned long i;
+  int little_endian;
+
+  probe.d = 1.0;
+  little_endian = (probe.b[sizeof(double) - 1] != 0);
+
+  /* -0.0 and 0.0 compare equal */
+  value.d = (weight == 0) ? 0 : weight;
+
+  /* Collect the bytes from the most to the least significant one */
+  for (i = 0; i < sizeof(double); ++i)
+  {
+    unsigned long byte = value.b[little_endian ? (sizeof(double) - 1 - i) : i];
+    hi = ((hi << 8) | (lo >> 24)) & 0xFFFFFFFFUL;
+    lo = ((lo << 8) | byte) & 0xFFFFFFFFUL;
+  }
+
+  /* Negative values have all bits flipped, positive ones only the sign bit */
+  if (hi & 0x80000000UL)
+  {
+    hi = ~hi;
+    lo = ~lo;
+  }
+  else
+  {
+    hi |= 0x80000000UL;
+  }
+
+  /* Descending */
+  key->hi = ~hi & 0xFFFFFFFFUL;
+  key->lo = ~lo & 0xFFFFFFFFUL;
+}
+
+TMV_API TMV_INLINE unsigned long tmv_sort_key_digit(tmv_sort_key *key, unsigned long digit)
+{
+  return (digit < 4) ? ((key->lo >> (8 * digit)) & 0xFF) : ((key->hi >> (8 * (digit - 4))) & 0xFF);
+}
+
+/* One stable LSD radix pass per key byte, bytes that are equal for all keys are skipped */
+TMV_API TMV_INLINE void tmv_sort_radix(tmv_sort_key **keys, tmv_sort_key **keys_tmp, unsigned long count, unsigned long *buckets)
+{
+  unsigned long digit, i;
+
+  for (digit = 0; digit < TMV_SORT_DIGITS; ++digit)
+  {
+    tmv_sort_key *src = *keys;
+    tmv_sort_key *dst = *keys_tmp;
+    unsigned long sum = 0;
+    int uniform = 0;
+
+    for (i = 0; i < TMV_SORT_RADIX; ++i)
+    {
+      buckets[i] = 0;
+    }
+
+    for (i = 0; i < count; ++i)
+    {
+      buckets[tmv_sort_key_digit(&src[i], digit)]++;
+    }
+
+    for (i = 0; i < TMV_SORT_RADIX; ++i)
+    {
+      unsigned long bucket = buckets[i];
+      if (bucket == count)
+      {
+        uniform = 1;
+        break;
+      }
+      buckets[i] = sum;
+      sum += bucket;
+    }
+
+    if (uniform)
+    {
+      continue;
+    }
+
+    for (i = 0; i < count; ++i)
+    {
+      dst[buckets[tmv_sort_key_digit(&src[i], digit)]++] = src[i];
+    }
+
+    *keys = dst;
+    *keys_tmp = src;
+  }
+}
+
+/* Moves items[perm[i]] to items[i] following the permutation cycles, perm is destroyed */
+TMV_API TMV_INLINE void tmv_items_permute(tmv_item *items, unsigned long count, unsigned long *perm, tmv_profile *profile)
+{
+  unsigned long i;
+
+  for (i = 0; i < count; ++i)
+  {
+    unsigned long dst = i;
+    tmv_item tmp;
+
+    if (perm[i] == i)
+    {
+      continue;
+    }
+
+    tmp = items[i];
+
+    for (;;)
+    {
+      unsigned long src = perm[dst];
+      perm[dst] = dst;
+
+      if (src == i)
+      {
+        items[dst] = tmp;
+        TMV_PROFILE_COUNT(profile, sort_moves, 1);
+        break;
+      }
+
+      items[dst] = items[src];
+      dst = src;
+
+      TMV_PROFILE_COUNT(profile, sort_moves, 1);
+    }
+  }
+}
+
+/* Sort items with the depth in children_offset_index and their position in children_count by
+   depth (asc), parent_id (asc), weight (desc), keeping the original order of equal items.
+   Without by_weight the weight is left out and each group keeps the original order.
+
+   With at least tmv_items_sort_scratch_size(count) bytes of scratch memory this is an O(n) LSD radix
+   sort on a permutation which is applied once at the end. Otherwise an in-place O(n log n) heap sort
+   with the original position as the last key is used.
+
+   The order preserving weight bits take a whole 64 bit key, so the radix sort runs two stable stages:
+   the weights, then depth and the parent_id offset from the smallest parent_id packed into one key.
+   Bytes that are equal for all keys are skipped, 1M items take about 4 passes for the packed key. */
+TMV_API TMV_INLINE void tmv_items_sort_layout_profile(tmv_item *items, unsigned long count, void *scratch, unsigned long scratch_size, int by_weight, tmv_profile *profile)
+{
+  tmv_sort_key *keys;
+  tmv_sort_key *keys_tmp;
+  unsigned long *buckets;
+  unsigned long *perm;
+  unsigned long parent_bits;
+  unsigned long depth_max = 0;
+  long parent_min;
+  long parent_max;
+  unsigned long i;
+
+  if (!scratch || scratch_size < tmv_items_sort_scratch_size(count))
+  {
+    tmv_items_heap_sort(items, count, by_weight ? tmv_item_compare_layout : tmv_item_compare_group, profile);
+    return;
+  }
+
+  keys = (tmv_sort_key *)scratch;
+  keys_tmp = keys + count;
+  buckets = (unsigned long *)(keys_tmp + count);
+
+  /* Least significant key first: weight, then depth and parent_id. Each stage keys the items in the current order */
+  parent_min = count ? items[0].parent_id : 0;
+  parent_max = parent_min;
+
+  for (i = 0; i < count; ++i)
+  {
+    keys[i].index = i;
+    tmv_sort_key_weight_desc(&keys[i], (double)items[i].weight);
+
+    parent_min = (items[i].parent_id < parent_min) ? items[i].parent_id : parent_min;
+    parent_max = (items[i].parent_id > parent_max) ? items[i].parent_id : parent_max;
+    depth_max = (items[i].children_offset_index > depth_max) ? items[i].children_offset_index : depth_max;
+  }
+
+  if (by_weight)
+  {
+    tmv_sort_radix(&keys, &keys_tmp, count, buckets);
+  }
+
+  /* Offsets from the smallest parent_id keep their order and need no more bits than the id range */
+  parent_bits = tmv_sort_bits((unsigned long)parent_max - (unsigned long)parent_min);
+
+  if (parent_bits + tmv_sort_bits(depth_max) <= 64)
+  {
+    for (i = 0; i < count; ++i)
+    {
+      tmv_item *item = &items[keys[i].index];
+      tmv_sort_key_group(&keys[i], item->children_offset_index, (unsigned long)item->parent_id - (unsigned long)parent_min, parent_bits);
+    }
+    tmv_sort_radix(&keys, &keys_tmp, count, buckets);
+  }
+  else
+  {
+    /* Ids spread over the whole long range leave no room for the depth */
+    for (i = 0; i < count; ++i)
+    {
+      tmv_sort_key_unsigned(&keys[i], (unsigned long)items[keys[i].index].parent_id - (unsigned long)parent_min);
+    }
+    tmv_sort_radix(&keys, &keys_tmp, count, buckets);
+
+    for (i = 0; i < count; ++i)
+    {
+      tmv_sort_key_unsigned(&keys[i], items[keys[i].index].children_offset_index);
+    }
+    tmv_sort_radix(&keys, &keys_tmp, count, buckets);
+  }
+
+  /* Apply the permutation once */
+  perm = (unsigned long *)keys_tmp;
+  for (i = 0; i < count; ++i)
+  {
+    perm[i] = keys[i].index;
+  }
+
+  tmv_items_permute(items, count, perm, profile);
+}
+
+TMV_API TMV_INLINE void tmv_items_sort_layout(tmv_item *items, unsigned long count, void *scratch, unsigned long scratch_size)
+{
+  tmv_items_sort_layout_profile(items, count, scratch, scratch_size, 1, 0);
+}
+
+/* Replaces the depths in children_offset_index of items sorted by tmv_items_sort_layout with the children
+   offsets and counts, the children of an item are the (depth + 1, id) group */
+TMV_API TMV_INLINE void tmv_items_children_offsets_profile(tmv_item *items, unsigned long count, tmv_profile *profile)
+{
+  unsigned long i;
+
+  for (i = 0; i < count; ++i)
+  {
+    unsigned long depth = items[i].children_offset_index;
+    unsigned long offset = tmv_items_search_group(items, i + 1, count, depth + 1, items[i].id, 0, profile);
+    unsigned long end = tmv_items_search_group(items, offset, count, depth + 1, items[i].id, 1, profile);
+
+    items[i].children_offset_index = (end > offset) ? offset : 0;
+    items[i].children_count = end - offset;
+
+    TMV_PROFILE_COUNT(profile, group_searches, 2);
+  }
+}
+
+TMV_API TMV_INLINE void tmv_items_children_offsets(tmv_item *items, unsigned long count)
+{
+  tmv_items_children_offsets_profile(items, count, 0);
+}
+
+/* The depth sort that counts into profile (if TMV_PROFILE is defined), profile can be 0.
+   Without by_weight the groups keep the original order, see tmv_layout_keeps_order. */
+TMV_API TMV_INLINE int tmv_items_depth_sort_offset_profile(tmv_item *items, unsigned long count, void *scratch, unsigned long scratch_size, int by_weight, tmv_profile *profile)
+{
+  int acyclic;
+
+  /* (1) Compute depths in one topological pass */
+  TMV_PROFILE_BEGIN(profile, TMV_PROFILE_DEPTH);
+  acyclic = tmv_items_depth_profile(items, count, profile);
+  TMV_PROFILE_END(profile, TMV_PROFILE_DEPTH);
+
+  /* (2) Stable sort by depth (asc), parent_id (asc), weight (desc) */
+  TMV_PROFILE_BEGIN(profile, TMV_PROFILE_SORT);
+  tmv_items_sort_layout_profile(items, count, scratch, scratch_size, by_weight, profile);
+  TMV_PROFILE_END(profile, TMV_PROFILE_SORT);
+
+  /* (3) Compute children offsets & counts */
+  TMV_PROFILE_BEGIN(profile, TMV_PROFILE_OFFSETS);
+  tmv_items_children_offsets_profile(items, count, profile);
+  TMV_PROFILE_END(profile, TMV_PROFILE_OFFSETS);
+
+  return acyclic;
+}
+
+TMV_API TMV_INLINE int tmv_items_depth_sort_offset_scratch(tmv_item *items, unsigned long count, void *scratch, unsigned long scratch_size)
+{
+  return tmv_items_depth_sort_offset_profile(items, count, scratch, scratch_size, 1, 0);
+}
+
+TMV_API TMV_INLINE int tmv_items_depth_sort_offset(tmv_item *items, unsigned long count)
+{
+  return tmv_items_depth_sort_offset_scratch(items, count, 0, 0);
+}
+
+/* Sorts one group of equal depth and parent_id with the original position in children_count,
+   a group that already is heaviest first is only checked */
+TMV_API TMV_INLINE void tmv_items_sort_group_layout(tmv_item *items, unsigned long count)
+{
+  unsigned long i;
+
+  for (i = 1; i < count; ++i)
+  {
+    if (items[i - 1].weight < items[i].weight)
+    {
+      tmv_items_heap_sort(items, count, tmv_item_compare_layout, 0);
+      return;
+    }
+  }
+}
+
+/* Returns the end of the depth 0 block of items in a layout order, the first children group or count.
+   Behind the roots the block holds the orphans and parent cycle members, which are nobody's children. */
+TMV_API TMV_INLINE unsigned long tmv_items_top_count(tmv_item *items, unsigned long count)
+{
+  unsigned long top_count = count;
+  unsigned long i;
+
+  for (i = 0; i < count; ++i)
+  {
+    if (items[i].children_count > 0 && items[i].children_offset_index < top_count)
+    {
+      top_count = items[i].children_offset_index;
+    }
+  }
+
+  return top_count;
+}
+
+/* Checks that items are in a layout order like the one of tmv_items_depth_sort_offset: the roots in front
+   and heaviest first, then the orphans and parent cycle members by parent_id (asc) which are never laid out,
+   each depth one block made of the children groups of the block before, each group heaviest first at the
+   children_offset_index and children_count of its parent. The order of the groups within a block is free.
+   The ids have to be unique. O(n), O(n log k) with k orphans and cycle members. Returns 1 if the items can be
+   laid out as they are. */
+TMV_API TMV_INLINE int tmv_items_layout_ordered(tmv_item *items, unsigned long count)
+{
+  unsigned long level_start = 0;
+  unsigned long level_end = 0;
+  unsigned long top_count;
+  unsigned long roots;
+  unsigned long children;
+  unsigned long i;
+  unsigned long j;
+
+  while (level_end < count && items[level_end].parent_id < TMV_FIRST_VALID_PARENT_ID)
+  {
+    if (level_end > 0 && items[level_end - 1].parent_id == items[level_end].parent_id && items[level_end - 1].weight < items[level_end].weight)
+    {
+      return 0;
+    }
+    ++level_end;
+  }
+
+  /* The items behind the roots up to the first children group are orphans or on a parent cycle */
+  roots = level_end;
+  top_count = tmv_items_top_count(items, count);
+
+  if (top_count < roots)
+  {
+    return 0;
+  }
+
+  for (i = roots; i < top_count; ++i)
+  {
+    if (items[i].parent_id < TMV_FIRST_VALID_PARENT_ID || (i > roots && items[i - 1].parent_id > items[i].parent_id))
+    {
+      return 0;
+    }
+  }
+
+  /* Their parents are neither laid out nor in a later block, the ids of those are searched among their parent ids */
+  for (i = 0; i < count && top_count > roots; ++i)
+  {
+    unsigned long low = roots;
+    unsigned long high = top_count;
+
+    if (i >= roots && i < top_count)
+    {
+      continue;
+    }
+
+    while (low < high)
+    {
+      unsigned long middle = low + (high - low) / 2;
+
+      if (items[middle].parent_id < items[i].id)
+      {
+        low = middle + 1;
+      }
+      else
+      {
+        high = middle;
+      }
+    }
+
+    if (low < top_count && items[low].parent_id == items[i].id)
+    {
+      return 0;
+    }
+  }
+
+  level_end = top_count;
+
+  while (level_start < level_end)
+  {
+    children = 0;
+    for (i = level_start; i < level_end; ++i)
+    {
+      children += items[i].children_count;
+    }
+
+    if (children > count - level_end)
+    {
+      return 0;
+    }
+
+    /* The groups are inside the next block and hold only their own children, so with unique
+       ids they tile it. The parents are in front of their children, there is no cycle. */
+    for (i = level_start; i < level_end; ++i)
+    {
+      unsigned long offset = items[i].children_offset_index;
+      unsigned long end = offset + items[i].children_count;
+
+      if (items[i].children_count == 0)
+      {
+        continue;
+      }
+
+      if (offset < level_end || end > level_end + children)
+      {
+        return 0;
+      }
+
+      for (j = offset; j < end; ++j)
+      {
+        if (items[j].parent_id != items[i].id || (j > offset && items[j - 1].weight < items[j].weight))
+        {
+          return 0;
+        }
+      }
+    }
+
+    level_start = level_end;
+    level_end += children;
+  }
+
+  /* Items after the last block are nobody's children */
+  return level_end == count;
+}
+
+/* Builds items in the layout order from a compressed sparse row tree, so producers that know the children
+   of each node skip the depth sort. The children of nodes[v] are nodes[child_indices[e]] for e in
+   [child_offsets[v], child_offsets[v + 1]), child_offsets has count + 1 entries. Only the id and weight of
+   the nodes are used, nodes that are nobody's child become roots (parent_id -1).
+
+   Each children group is sorted by weight (desc), equal weights keep the node order. O(n) for groups that
+   are given heaviest first, O(n log n) otherwise. Returns 0 if a node has two parents or is part of a
+   cycle, items is not in the layout order then. */
+TMV_API TMV_INLINE int tmv_items_from_csr(
+    tmv_item *items,              /* count items in the layout order, not overlapping nodes */
+    tmv_item *nodes,              /* count nodes */
+    unsigned long count,          /* The number of nodes */
+    unsigned long *child_offsets, /* count + 1 offsets into child_indices */
+    unsigned long *child_indices  /* child_offsets[count] node indices */
+)
+{
+  unsigned long roots = 0;
+  unsigned long tail;
+  unsigned long e;
+  unsigned long i;
+  unsigned long v;
+
+  /* (1) Mark the children in items[v].parent_id, the nodes without a mark are the roots */
+  for (v = 0; v < count; ++v)
+  {
+    items[v].parent_id = 0;
+  }
+
+  for (e = 0; e < child_offsets[count]; ++e)
+  {
+    if (child_indices[e] >= count || items[child_indices[e]].parent_id)
+    {
+      return 0;
+    }
+    items[child_indices[e]].parent_id = 1;
+  }
+
+  /* (2) Move the roots to the front, the mark of node v is read before items[v] is written.
+         children_count holds the node index or the child_indices entry until the item's children are added. */
+  for (v = 0; v < count; ++v)
+  {
+    if (!items[v].parent_id)
+    {
+      items[roots] = nodes[v];
+      items[roots].parent_id = -1;
+      items[roots].children_offset_index = 0;
+      items[roots].children_count = v;
+      ++roots;
+    }
+  }
+
+  tmv_items_sort_group_layout(items, roots);
+
+  /* (3) Breadth first, each group is appended and sorted before its items add their children */
+  tail = roots;
+
+  for (i = 0; i < tail; ++i)
+  {
+    unsigned long node = (i < roots) ? items[i].children_count : child_indices[items[i].children_count];
+    unsigned long offset = tail;
+
+    if (child_offsets[node + 1] - child_offsets[node] > count - tail)
+    {
+      return 0;
+    }
+
+    for (e = child_offsets[node]; e < child_offsets[node + 1]; ++e)
+    {
+      items[tail] = nodes[child_indices[e]];
+      items[tail].parent_id = items[i].id;
+      items[tail].children_offset_index = 0;
+      items[tail].children_count = e;
+      ++tail;
+    }
+
+    tmv_items_sort_group_layout(&items[offset], tail - offset);
+
+    items[i].children_offset_index = (tail > offset) ? offset : 0;
+    items[i].children_count = tail - offset;
+  }
+
+  /* Nodes on a cycle are never reached from a root */
+  return tail == count;
+}
+
+/* DFS preorder is an alternative order for storage: every subtree is the contiguous slice
+   preorder[i .. i + subtree_sizes[i]), the children of preorder[i] start at children_offset_index = i + 1
+   and follow each other by their subtree sizes, heaviest first. A slice can be copied, encoded or given
+   to a thread without touching the rest of the array. The layout works on the layout order, see
+   tmv_items_from_preorder. */
+
+/* Writes items that are in a layout order (tmv_items_layout_ordered) in DFS preorder with the subtree
+   size of each item. The subtrees of the orphans and parent cycle members follow the ones of the roots.
+   O(n), returns 0 and writes nothing if items are not in a layout order. */
+TMV_API TMV_INLINE int tmv_items_preorder(
+    tmv_item *items,              /* count items in a layout order */
+    unsigned long count,          /* The number of items */
+    tmv_item *preorder,           /* count items in DFS preorder, not overlapping items */
+    unsigned long *subtree_sizes  /* count subtree sizes of the preorder items */
+)
+{
+  unsigned long position = 0;
+  unsigned long top_count;
+  unsigned long i;
+  unsigned long j;
+
+  if (!tmv_items_layout_ordered(items, count))
+  {
+    return 0;
+  }
+
+  top_count = tmv_items_top_count(items, count);
+
+  /* (1) Subtree sizes in the layout order, children are behind their parent */
+  for (i = count; i-- > 0;)
+  {
+    subtree_sizes[i] = 1;
+    for (j = items[i].children_offset_index; j < items[i].children_offset_index + items[i].children_count; ++j)
+    {
+      subtree_sizes[i] += subtree_sizes[j];
+    }
+  }
+
+  /* (2) Each item places its children behind itself and their siblings' subtrees. The size of an
+         item is replaced by its position once placed, the preorder item keeps the size meanwhile. */
+  for (i = 0; i < top_count; ++i)
+  {
+    unsigned long size = subtree_sizes[i];
+
+    subtree_sizes[i] = position;
+    preorder[position] = items[i];
+    preorder[position].children_offset_index = size;
+    position += size;
+  }
+
+  for (i = 0; i < count; ++i)
+  {
+    position = subtree_sizes[i] + 1;
+
+    for (j = items[i].children_offset_index; j < items[i].children_offset_index + items[i].children_count; ++j)
+    {
+      unsigned long size = subtree_sizes[j];
+
+      subtree_sizes[j] = position;
+      preorder[position] = items[j];
+      preorder[position].children_offset_index = size;
+      position += size;
+    }
+  }
+
+  /* (3) The sizes move to the preorder positions */
+  for (i = 0; i < count; ++i)
+  {
+    subtree_sizes[i] = preorder[i].children_offset_index;
+    preorder[i].children_offset_index = (preorder[i].children_count > 0) ? i + 1 : 0;
+  }
+
+  return 1;
+}
+
+/* Builds items in the layout order from a DFS preorder slice, the whole tree or one subtree. The items at
+   the top of the slice become roots (parent_id -1), so a subtree is laid out on its own. A slice that starts
+   with a root is the whole tree, its other top items that have a parent_id are orphans or parent cycle
+   members, they keep it and follow the roots. Groups that are heaviest first stay in their order, others
+   are sorted. O(n), returns 0 if the subtree sizes do not describe a forest of count items. */
+TMV_API TMV_INLINE int tmv_items_from_preorder(
+    tmv_item *preorder,           /* count items in DFS preorder */
+    unsigned long *subtree_sizes, /* count subtree sizes of the preorder items */
+    unsigned long count,          /* The number of items in the slice */
+    tmv_item *items               /* count items in the layout order, not overlapping preorder */
+)
+{
+  unsigned long roots = 0;
+  unsigned long top_count;
+  unsigned long tail;
+  unsigned long i;
+  unsigned long q;
+  int tree = (count > 0 && preorder[0].parent_id < TMV_FIRST_VALID_PARENT_ID);
+
+  /* (1) The top of the slice, children_count holds the preorder position until the children are added */
+  for (q = 0; q < count; q += subtree_sizes[q])
+  {
+    if (subtree_sizes[q] == 0 || subtree_sizes[q] > count - q)
+    {
+      return 0;
+    }
+
+    if (!tree || preorder[q].parent_id < TMV_FIRST_VALID_PARENT_ID)
+    {
+      items[roots] = preorder[q];
+      items[roots].parent_id = -1;
+      items[roots].children_offset_index = 0;
+      items[roots].children_count = q;
+      ++roots;
+    }
+  }
+
+  /* The orphans and parent cycle members of a whole tree by parent_id (asc) like the depth sort */
+  top_count = roots;
+
+  for (q = 0; tree && q < count; q += subtree_sizes[q])
+  {
+    if (preorder[q].parent_id >= TMV_FIRST_VALID_PARENT_ID)
+    {
+      items[top_count] = preorder[q];
+      items[top_count].children_offset_index = 0;
+      items[top_count].children_count = q;
+      ++top_count;
+    }
+  }
+
+  tmv_items_sort_group_layout(items, roots);
+  tmv_items_heap_sort(&items[roots], top_count - roots, tmv_item_compare_layout, 0);
+
+  /* (2) Breadth first like tmv_items_from_csr, the children of preorder[q] tile (q, q + subtree_sizes[q]) */
+  tail = top_count;
+
+  for (i = 0; i < tail; ++i)
+  {
+    unsigned long offset = tail;
+    unsigned long end;
+
+    q = items[i].children_count;
+    end = q + subtree_sizes[q];
+
+    for (q = q + 1; q < end; q += subtree_sizes[q])
+    {
+      if (subtree_sizes[q] == 0 || subtree_sizes[q] > end - q || tail >= count)
+      {
+        return 0;
+      }
+
+      items[tail] = preorder[q];
+      items[tail].parent_id = items[i].id;
+      items[tail].children_offset_index = 0;
+      items[tail].children_count = q;
+      ++tail;
+    }
+
+    tmv_items_sort_group_layout(&items[offset], tail - offset);
+
+    items[i].children_offset_index = (tail > offset) ? offset : 0;
+    items[i].children_count = tail - offset;
+  }
+
+  return tail == count;
+}
+
+/* ########################################################## */
+/* # Memory                                                   */
+/* ########################################################## */
+#define TMV_ARENA_ALIGN 16
+
+/* The parts of a model tmv_model_arena_init sets up */
+#define TMV_MEMORY_RECTS 0x01   /* One rect per item, sets rects_capacity */
+#define TMV_MEMORY_SCRATCH 0x02 /* Sort scratch for the radix sort */
+#define TMV_MEMORY_INDEX 0x04   /* The id index */
+#define TMV_MEMORY_DIRTY 0x08   /* The dirty flags for tmv_update_weight */
+#define TMV_MEMORY_SUBTREE 0x10 /* The subtree sizes of tmv_aggregate_weights */
+
+/* A bump allocator over caller provided memory, nothing is freed but the whole arena at once */
+typedef struct tmv_arena
+{
+  unsigned char *memory; /* Caller provided memory, aligned like a double (as from malloc) */
+  unsigned long size;    /* The size of the memory in bytes */
+  unsigned long used;    /* The bytes that have been handed out */
+
+} tmv_arena;
+
+/* The bytes an allocation of size takes from an arena */
+TMV_API TMV_INLINE unsigned long tmv_arena_align(unsigned long size)
+{
+  return (size + (TMV_ARENA_ALIGN - 1)) & ~(unsigned long)(TMV_ARENA_ALIGN - 1);
+}
+
+TMV_API TMV_INLINE void tmv_arena_init(tmv_arena *arena, void *memory, unsigned long size)
+{
+  arena->memory = (unsigned char *)memory;
+  arena->size = memory ? size : 0;
+  arena->used = 0;
+}
+
+/* Returns size bytes from the arena or 0 if there are not enough left */
+TMV_API TMV_INLINE void *tmv_arena_alloc(tmv_arena *arena, unsigned long size)
+{
+  unsigned long aligned = tmv_arena_align(size);
+  void *block;
+
+  if (!arena->memory || aligned < size || aligned > arena->size - arena->used)
+  {
+    return 0;
+  }
+
+  block = arena->memory + arena->used;
+  arena->used += aligned;
+
+  return block;
+}
+
+TMV_API TMV_INLINE void tmv_arena_reset(tmv_arena *arena)
+{
+  arena->used = 0;
+}
+
+/* The exact arena size in bytes tmv_model_arena_init needs for count items and the TMV_MEMORY_* flags */
+TMV_API TMV_INLINE unsigned long tmv_memory_requirements(unsigned long count, unsigned long flags)
+{
+  unsigned long size = 0;
+
+  if (flags & TMV_MEMORY_RECTS)
+  {
+    size += tmv_arena_align(count * sizeof(tmv_rect));
+  }
+
+  if (flags & TMV_MEMORY_SCRATCH)
+  {
+    size += tmv_arena_align(tmv_items_sort_scratch_size(count));
+  }
+
+  if (flags & TMV_MEMORY_INDEX)
+  {
+    size += tmv_arena_align(sizeof(tmv_index)) + tmv_arena_align(tmv_index_memory_size(count));
+  }
+
+  if (flags & TMV_MEMORY_DIRTY)
+  {
+    size += tmv_arena_align(count);
+  }
+
+  if (flags & TMV_MEMORY_SUBTREE)
+  {
+    size += tmv_arena_align(count * sizeof(unsigned long));
+  }
+
+  return size;
+}
+
+/* Takes the memory of the TMV_MEMORY_* flags for model->items_count items from the arena and
+   sets it up in the model. Returns 0 if the arena is too small, see tmv_memory_requirements. */
+TMV_API TMV_INLINE int tmv_model_arena_init(tmv_model *model, tmv_arena *arena, unsigned long flags)
+{
+  unsigned long count = model->items_count;
+  unsigned long i;
+
+  if (flags & TMV_MEMORY_RECTS)
+  {
+    tmv_rect *rects = (tmv_rect *)tmv_arena_alloc(arena, count * sizeof(tmv_rect));
+
+    if (!rects)
+    {
+      return 0;
+    }
+
+    model->rects = rects;
+    model->rects_capacity = count;
+  }
+
+  if (flags & TMV_MEMORY_SCRATCH)
+  {
+    unsigned long scratch_size = tmv_items_sort_scratch_size(count);
+    void *scratch = tmv_arena_alloc(arena, scratch_size);
+
+    if (!scratch)
+    {
+      return 0;
+    }
+
+    model->scratch = scratch;
+    model->scratch_size = scratch_size;
+  }
+
+  if (flags & TMV_MEMORY_INDEX)
+  {
+    tmv_index *index = (tmv_index *)tmv_arena_alloc(arena, sizeof(tmv_index));
+    void *entries = tmv_arena_alloc(arena, tmv_index_memory_size(count));
+
+    if (!index || !tmv_index_init(index, entries, tmv_index_memory_size(count), count))
+    {
+      return 0;
+    }
+
+    model->index = index;
+  }
+
+  if (flags & TMV_MEMORY_DIRTY)
+  {
+    unsigned char *dirty = (unsigned char *)tmv_arena_alloc(arena, count);
+
+    if (!dirty)
+    {
+      return 0;
+    }
+
+    for (i = 0; i < count; ++i)
+    {
+      dirty[i] = 0;
+    }
+
+    model->dirty = dirty;
+  }
+
+  if (flags & TMV_MEMORY_SUBTREE)
+  {
+    unsigned long *subtree_sizes = (unsigned long *)tmv_arena_alloc(arena, count * sizeof(unsigned long));
+
+    if (!subtree_sizes)
+    {
+      return 0;
+    }
+
+    model->subtree_sizes = subtree_sizes;
+  }
+
+  return 1;
+}
+
+/* Flags of tmv_model.dirty */
+#define TMV_DIRTY_WEIGHT 0x01 /* The weight changed, the sibling group has to be sorted and laid out again */
+#define TMV_DIRTY_RECT 0x02   /* The rect changed, the children have to be laid out again */
+
+TMV_API TMV_INLINE void tmv_stats_reset(tmv_stats *stats)
+{
+  stats->weigth_min = -1;
+  stats->weigth_max = -1;
+  stats->weigth_sum = 0;
+  stats->count = 0;
+}
+
+/* Leaf weights are added in layout emission order, callers that lay out out of order
+   have to replay that order to get the same weigth_sum */
+TMV_API TMV_INLINE void tmv_stats_add(tmv_stats *stats, tmv_real weight)
+{
+  if (stats->weigth_min < 0 || weight < stats->weigth_min)
+  {
+    stats->weigth_min = weight;
+  }
+
+  if (stats->weigth_max < 0 || weight > stats->weigth_max)
+  {
+    stats->weigth_max = weight;
+  }
+
+  stats->weigth_sum += weight;
+  stats->count += 1;
+}
+
+TMV_API TMV_INLINE void tmv_layout_row(
+    tmv_model *model,
+    tmv_rect row_area,
+    tmv_item *row_items,
+    unsigned long row_count)
+{
+  unsigned long i;
+  unsigned long r;
+  tmv_real area = row_area.width * row_area.height;
+  tmv_real total_weight = tmv_total_weight(row_items, row_count);
+  tmv_real scale = (total_weight > 0) ? (area / total_weight) : 0;
+
+  int horizontal = (row_area.width >= row_area.height);
+  tmv_real offset = 0;
+
+  TMV_PROFILE_COUNT(model->profile, rows, 1);
+
+  for (i = 0; i < row_count; ++i)
+  {
+    tmv_item row_item = row_items[i];
+
+    tmv_real item_area = row_item.weight * scale;
+    tmv_rect rect;
+
+    /* Add rects, either at the position of the item or appended in emission order */
+    r = model->rects_aligned ? (unsigned long)(row_items - model->items) + i : model->rects_count;
+
+    if (horizontal)
+    {
+      rect.x = row_area.x + offset;
+      rect.y = row_area.y;
+      rect.width = item_area / row_area.height;
+      rect.height = row_area.height;
+      offset += rect.width;
+    }
+    else
+    {
+      rect.x = row_area.x;
+      rect.y = row_area.y + offset;
+      rect.width = row_area.width;
+      rect.height = item_area / row_area.width;
+      offset += rect.height;
+    }
+
+    rect.id = row_item.id;
+
+    /* Collect statistics, a collapsed subtree counts as one leaf */
+    if (row_item.children_count == 0 || tmv_collapsed(model->min_side, rect.width, rect.height))
+    {
+      tmv_stats_add(&model->stats, row_item.weight);
+    }
+
+    if (model->rects_aligned)
+    {
+      /* The children of a moved rect have to be laid out again by tmv_relayout_dirty */
+      if (model->dirty && (model->rects[r].id != rect.id ||
+                           model->rects[r].x != rect.x || model->rects[r].y != rect.y ||
+                           model->rects[r].width != rect.width || model->rects[r].height != rect.height))
+      {
+        model->dirty[r] |= TMV_DIRTY_RECT;
+      }
+
+      model->rects[r] = rect;
+      continue;
+    }
+
+    /* Rects beyond the capacity are dropped and so are their subtrees */
+    if (model->rects_capacity && r >= model->rects_capacity)
+    {
+      model->rects_dropped++;
+      continue;
+    }
+
+    model->rects[r] = rect;
+
+    if (model->index && model->index->entries)
+    {
+      /* Keep the first rect of an id, entries left over from a previous layout are replaced */
+      tmv_index_entry *entry = tmv_index_find(model->index, row_item.id);
+      if (entry && (entry->rect >= model->rects_count || model->rects[entry->rect].id != row_item.id))
+      {
+        entry->rect = model->rects_count;
+      }
+    }
+
+    model->rects_count++;
+  }
+}
+
+/* Returns the end of the row starting at start. Items are added as long as the worst aspect ratio
+   of the row does not get worse, row_weight receives the summed weight of the row. */
+TMV_API TMV_INLINE unsigned long tmv_squarify_row_end(
+    tmv_real *weights,
+    unsigned long stride, /* The distance between two weights in bytes */
+    unsigned long start,
+    unsigned long count,
+    tmv_real scale,
+    tmv_real side,
+    tmv_real *row_weight,
+    tmv_profile *profile)
+{
+  unsigned long end = start;
+  tmv_real weight_sum = 0;
+  tmv_real worst = (tmv_real)1e9;
+
+  /* Scaled min/max of items[start..end], each candidate only updates them with its own weight
+     so a row costs O(1) per candidate and each item is a candidate at most twice */
+  tmv_real max_w = (tmv_real)-1e9;
+  tmv_real min_w = (tmv_real)1e9;
+
+  /* Try to add items[start..end] */
+  while (end < count)
+  {
+    tmv_real weight = tmv_weight_at(weights, stride, end);
+    tmv_real w_scaled = weight * scale;
+
+    tmv_real row_area;
+    tmv_real r1;
+    tmv_real r2;
+    tmv_real new_worst;
+
+    TMV_PROFILE_COUNT(profile, row_candidates, 1);
+
+    weight_sum += weight;
+
+    if (w_scaled > max_w)
+    {
+      max_w = w_scaled;
+    }
+    if (w_scaled < min_w)
+    {
+      min_w = w_scaled;
+    }
+
+    /* Calculate the new worst aspect ratio s*/
+    row_area = weight_sum * scale;
+    r1 = (side * side * max_w) / (row_area * row_area);
+    r2 = (row_area * row_area) / (side * side * min_w);
+    new_worst = (r1 > r2) ? r1 : r2;
+
+    /* Stop if aspect ratio would worsen, a row always takes its first item (tiny float rects overflow the ratio) */
+    if (end > start && new_worst > worst)
+    {
+      weight_sum -= weight;
+      break;
+    }
+
+    worst = new_worst;
+    ++end;
+  }
+
+  *row_weight = weight_sum;
+
+  return end;
+}
+
+/* Cuts the row of row_length off the front of the render area */
+TMV_API TMV_INLINE tmv_rect tmv_squarify_cut(tmv_rect *render_area, int horizontal, tmv_real row_length)
+{
+  tmv_rect row_area = *render_area;
+
+  if (horizontal)
+  {
+    row_area.width = row_length;
+    render_area->x += row_length;
+    render_area->width -= row_length;
+  }
+  else
+  {
+    row_area.height = row_length;
+    render_area->y += row_length;
+    render_area->height -= row_length;
+  }
+
+  return row_area;
+}
+
+/* ########################################################## */
+/* # Layout engines                                           */
+/* ########################################################## */
+#define TMV_LAYOUT_SQUARIFY 0   /* Rows with the best aspect ratios, the default */
+#define TMV_LAYOUT_SLICE_DICE 1 /* One row along the long side of the parent, the fastest */
+#define TMV_LAYOUT_STRIP 2      /* Squarified rows that are always stacked top to bottom */
+#define TMV_LAYOUT_PIVOT 3      /* Ordered treemap split around the middle item of a group */
+
+/* Squarify gets each sibling group sorted by descending weight. The other engines lay out a group in the
+   order the items had when they were sorted, a model that already has been sorted keeps its order. */
+TMV_API TMV_INLINE int tmv_layout_keeps_order(int layout_engine)
+{
+  return layout_engine == TMV_LAYOUT_SLICE_DICE || layout_engine == TMV_LAYOUT_STRIP || layout_engine == TMV_LAYOUT_PIVOT;
+}
+
+TMV_API TMV_INLINE void tmv_layout_squarify(
+    tmv_model *model,
+    tmv_rect render_area /* The area on which the squarified treemap should be aligned */
+)
+{
+  tmv_item *items = model->items;
+  unsigned long items_count = model->items_count;
+
+  unsigned long start = 0;
+  tmv_real total_weight = tmv_total_weight(items, items_count);
+  tmv_real area = render_area.width * render_area.height;
+  tmv_real scale = (total_weight > 0) ? (area / total_weight) : 0;
+
+  int horizontal = (render_area.width >= render_area.height);
+  tmv_real side = horizontal ? render_area.height : render_area.width;
+
+  while (start < items_count)
+  {
+    tmv_real row_weight;
+    unsigned long end = tmv_squarify_row_end(&items->weight, sizeof(tmv_item), start, items_count, scale, side, &row_weight, model->profile);
+
+    /* Compute row size in layout direction */
+    tmv_real row_length = (row_weight / total_weight) * (area / side);
+    tmv_rect row_area = tmv_squarify_cut(&render_area, horizontal, row_length);
+
+    tmv_layout_row(model, row_area, &items[start], end - start);
+
+    start = end;
+  }
+}
+
+/* Like tmv_layout_squarify but every row spans the width of the area */
+TMV_API TMV_INLINE void tmv_layout_strip(tmv_model *model, tmv_rect render_area)
+{
+  tmv_item *items = model->items;
+  unsigned long items_count = model->items_count;
+
+  unsigned long start = 0;
+  tmv_real total_weight = tmv_total_weight(items, items_count);
+  tmv_real area = render_area.width * render_area.height;
+  tmv_real scale = (total_weight > 0) ? (area / total_weight) : 0;
+  tmv_real side = render_area.width;
+
+  while (start < items_count)
+  {
+    tmv_real row_weight;
+    unsigned long end = tmv_squarify_row_end(&items->weight, sizeof(tmv_item), start, items_count, scale, side, &row_weight, model->profile);
+
+    tmv_real row_length = (row_weight / total_weight) * (area / side);
+    tmv_rect row_area = tmv_squarify_cut(&render_area, 0, row_length);
+
+    tmv_layout_row(model, row_area, &items[start], end - start);
+
+    start = end;
+  }
+}
+
+/* The aspect ratio of a pivot of pivot_weight in a column of column_weight across side */
+TMV_API TMV_INLINE tmv_real tmv_layout_pivot_ratio(tmv_real pivot_weight, tmv_real column_weight, tmv_real scale, tmv_real side)
+{
+  tmv_real column = column_weight * scale / side;
+  tmv_real length = (column > 0) ? (pivot_weight * scale / column) : 0;
+
+  if (column <= 0 || length <= 0)
+  {
+    return (tmv_real)1e9;
+  }
+
+  return (column > length) ? (column / length) : (length / column);
+}
+
+/* A part of a sibling group that tmv_layout_pivot has still to lay out */
+typedef struct tmv_pivot_frame
+{
+  tmv_rect area;          /* The area of items[start..start + count) */
+  tmv_real weight;        /* The total weight of the items without the pivot */
+  unsigned long start;    /* The first item */
+  unsigned long count;    /* The number of items */
+  int pivot;              /* The first item is a pivot which is cut off the area first */
+  int pivot_horizontal;   /* The direction of the pivot cut, see tmv_squarify_cut */
+
+} tmv_pivot_frame;
+
+/* A part holds at most half of the items of the part it was split from and each split leaves two parts
+   on the stack, so any group fits */
+#define TMV_PIVOT_STACK_MAX (2 * 8 * sizeof(unsigned long))
+
+/* Pivot by middle layout of the group model->items, which keeps the order of the items. The middle item
+   is the pivot, the items before it go into the area in front of it. The pivot heads a column with the
+   following items as long as that makes the pivot more square, the items after the column go into the
+   area behind it. Each part is split the same way, iteratively on a bounded stack. O(n log n), the rects
+   are written in item order. */
+TMV_API TMV_INLINE void tmv_layout_pivot(tmv_model *model, tmv_rect render_area)
+{
+  tmv_item *items = model->items;
+  tmv_pivot_frame stack[TMV_PIVOT_STACK_MAX];
+  unsigned long stack_count = 0;
+  tmv_pivot_frame part;
+
+  part.area = render_area;
+  part.weight = tmv_total_weight(items, model->items_count);
+  part.start = 0;
+  part.count = model->items_count;
+  part.pivot = 0;
+  part.pivot_horizontal = 0;
+
+  for (;;)
+  {
+    if (part.pivot)
+    {
+      tmv_real column_weight = items[part.start].weight + part.weight;
+      tmv_real length = part.pivot_horizontal ? part.area.width : part.area.height;
+      tmv_rect pivot_area = tmv_squarify_cut(&part.area, part.pivot_horizontal, (column_weight > 0) ? (items[part.start].weight / column_weight) * length : 0);
+
+      tmv_layout_row(model, pivot_area, &items[part.start], 1);
+
+      part.start += 1;
+      part.count -= 1;
+      part.pivot = 0;
+    }
+
+    if (part.count == 1)
+    {
+      tmv_layout_row(model, part.area, &items[part.start], 1);
+    }
+
+    if (part.count > 1)
+    {
+      unsigned long end = part.start + part.count;
+      unsigned long middle = part.start + (part.count - 1) / 2;
+      unsigned long column_end = middle + 1;
+
+      tmv_real area = part.area.width * part.area.height;
+      tmv_real scale = (part.weight > 0) ? (area / part.weight) : 0;
+
+      int horizontal = (part.area.width >= part.area.height);
+      tmv_real side = horizontal ? part.area.height : part.area.width;
+
+      tmv_real front_weight = tmv_total_weight(&items[part.start], middle - part.start);
+      tmv_real pivot_weight = items[middle].weight;
+      tmv_real column_weight = pivot_weight;
+      tmv_real rest_weight = 0;
+      tmv_real best = tmv_layout_pivot_ratio(pivot_weight, column_weight, scale, side);
+
+      tmv_rect front = tmv_squarify_cut(&part.area, horizontal, (part.weight > 0) ? (front_weight / part.weight) * (area / side) : 0);
+      tmv_rect column;
+
+      /* Grow the column while the pivot gets closer to a square */
+      while (column_end < end)
+      {
+        tmv_real ratio = tmv_layout_pivot_ratio(pivot_weight, column_weight + items[column_end].weight, scale, side);
+
+        if (ratio >= best)
+        {
+          break;
+        }
+
+        best = ratio;
+        column_weight += items[column_end].weight;
+        rest_weight += items[column_end].weight;
+        ++column_end;
+      }
+
+      column = tmv_squarify_cut(&part.area, horizontal, (part.weight > 0) ? (column_weight / part.weight) * (area / side) : 0);
+
+      /* Behind the column, then the column, in front of the pivot goes on right away. The weights of the
+         parts are summed up, subtracting them from the weight of the whole loses small parts to rounding. */
+      if (column_end < end)
+      {
+        tmv_pivot_frame *behind = &stack[stack_count++];
+        behind->area = part.area;
+        behind->weight = tmv_total_weight(&items[column_end], end - column_end);
+        behind->start = column_end;
+        behind->count = end - column_end;
+        behind->pivot = 0;
+        behind->pivot_horizontal = 0;
+      }
+
+      stack[stack_count].area = column;
+      stack[stack_count].weight = rest_weight;
+      stack[stack_count].start = middle;
+      stack[stack_count].count = column_end - middle;
+      stack[stack_count].pivot = 1;
+      stack[stack_count].pivot_horizontal = !horizontal;
+      ++stack_count;
+
+      if (middle > part.start)
+      {
+        part.area = front;
+        part.weight = front_weight;
+        part.count = middle - part.start;
+        continue;
+      }
+    }
+
+    if (stack_count == 0)
+    {
+      break;
+    }
+
+    part = stack[--stack_count];
+  }
+}
+
+/* Lays out the sibling group model->items into render_area with the engine of the model */
+TMV_API TMV_INLINE void tmv_squarify_current(
+    tmv_model *model,
+    tmv_rect render_area /* The area on which the squarified treemap should be aligned */
+)
+{
+  switch (model->layout_engine)
+  {
+  case TMV_LAYOUT_SLICE_DICE:
+    tmv_layout_row(model, render_area, model->items, model->items_count);
+    break;
+  case TMV_LAYOUT_STRIP:
+    tmv_layout_strip(model, render_area);
+    break;
+  case TMV_LAYOUT_PIVOT:
+    tmv_layout_pivot(model, render_area);
+    break;
+  default:
+    tmv_layout_squarify(model, render_area);
+    break;
+  }
+}
+
+TMV_API TMV_INLINE void tmv_model_span(tmv_model *model, const char *name, tmv_item *item, int begin)
+{
+  if (model->span)
+  {
+    model->span(model->span_user_data, name, item, begin);
+  }
+}
+
+/* Sorts the items unless they are sorted already and builds the index, returns 1 if they have been sorted */
+TMV_API TMV_INLINE int tmv_model_sort(tmv_model *model)
+{
+  if (model->items_sorted)
+  {
+    return 0;
+  }
+
+  tmv_model_span(model, "sort", 0, 1);
+  tmv_items_depth_sort_offset_profile(model->items, model->items_count, model->scratch, model->scratch_size, !tmv_layout_keeps_order(model->layout_engine), model->profile);
+  tmv_model_span(model, "sort", 0, 0);
+
+  model->items_sorted = 1;
+
+  if (model->index)
+  {
+    tmv_model_span(model, "index", 0, 1);
+    tmv_index_build(model->index, model);
+    tmv_model_span(model, "index", 0, 0);
+  }
+
+  return 1;
+}
+
+/* Marks items that a producer already put into the layout order (see tmv_items_layout_ordered and
+   tmv_items_from_csr) as sorted and builds the index, so the layout skips the depth sort.
+   Returns 0 and leaves the model to be sorted by the next layout if the order does not hold. */
+TMV_API TMV_INLINE int tmv_model_presorted(tmv_model *model)
+{
+  if (!tmv_items_layout_ordered(model->items, model->items_count))
+  {
+    model->items_sorted = 0;
+    return 0;
+  }
+
+  model->items_sorted = 1;
+
+  if (model->index)
+  {
+    tmv_index_build(model->index, model);
+  }
+
+  return 1;
+}
+
+/* Sorts the items (once) and builds the index, then resets the stats and rects of a previous layout */
+TMV_API TMV_INLINE void tmv_squarify_prepare(tmv_model *model)
+{
+  unsigned long i;
+
+  tmv_stats_reset(&model->stats);
+  model->rects_count = 0;
+  model->rects_dropped = 0;
+  model->collapsed_count = 0;
+
+  if (!tmv_model_sort(model) && model->index && model->index->entries)
+  {
+    tmv_index_clear_rects(model->index);
+  }
+
+  /* Rects of items that are never laid out (orphans, parent cycles) keep a zero size
+     and the id -1 - item id, so rects[i].id == items[i].id tells if items[i] has a rect */
+  if (model->rects_aligned)
+  {
+    for (i = 0; i < model->items_count; ++i)
+    {
+      tmv_rect none = {0};
+      none.id = -1 - model->items[i].id;
+      model->rects[i] = none;
+    }
+    model->rects_count = model->items_count;
+  }
+}
+
+/* Lays out the root-level items (sorted to the front) and returns their count */
+TMV_API TMV_INLINE unsigned long tmv_squarify_roots(tmv_model *model, tmv_rect area)
+{
+  unsigned long root_count = 0;
+
+  /* Count number of root items */
+  while (root_count < model->items_count &&
+         model->items[root_count].parent_id < TMV_FIRST_VALID_PARENT_ID)
+  {
+    ++root_count;
+  }
+
+  if (root_count > 0)
+  {
+    tmv_model root_model = *model;
+    root_model.items_count = root_count;
+
+    tmv_squarify_current(&root_model, area);
+
+    model->rects_count = root_model.rects_count;
+    model->rects_dropped = root_model.rects_dropped;
+    model->stats = root_model.stats;
+  }
+
+  return root_count;
+}
+
+/* Lays out the children of items[i] into parent_rect, the rect of items[i] or 0 if it has none */
+TMV_API TMV_INLINE int tmv_squarify_children_rect(tmv_model *model, unsigned long i, tmv_rect *parent_rect)
+{
+  tmv_item *item = &model->items[i];
+  tmv_model child_model;
+
+  if (!parent_rect || parent_rect->id != item->id)
+  {
+    return 0;
+  }
+
+  /* Below the level of detail the parent rect is all that is shown */
+  if (tmv_collapsed(model->min_side, parent_rect->width, parent_rect->height))
+  {
+    model->collapsed_count++;
+    return 0;
+  }
+
+  /* Setup child model view */
+  child_model = *model;
+  child_model.items = &model->items[item->children_offset_index];
+  child_model.items_count = item->children_count;
+
+  if (model->rects_aligned)
+  {
+    child_model.rects = &model->rects[item->children_offset_index];
+    child_model.dirty = model->dirty ? &model->dirty[item->children_offset_index] : 0;
+  }
+
+  /* Layout children directly in shared rect buffer */
+  tmv_squarify_current(&child_model, *parent_rect);
+
+  /* Update parent model state */
+  model->rects_count = child_model.rects_count;
+  model->rects_dropped = child_model.rects_dropped;
+  model->stats = child_model.stats;
+
+  return 1;
+}
+
+/* Lays out the children of items[i] into its rect, the rects of its parents have to be laid out already.
+   Returns 0 if there was nothing to lay out, no children, no rect or a collapsed rect. */
+TMV_API TMV_INLINE int tmv_squarify_children(tmv_model *model, unsigned long i)
+{
+  tmv_item *item = &model->items[i];
+  tmv_rect *parent_rect;
+
+  if (item->children_count == 0)
+  {
+    return 0;
+  }
+
+  /* Find parent rect, in aligned mode it is at the position of the item */
+  parent_rect = model->rects_aligned ? &model->rects[i] : tmv_model_find_rect_by_id(model, item->id);
+
+  TMV_PROFILE_COUNT(model->profile, parent_lookups, 1);
+
+  return tmv_squarify_children_rect(model, i, parent_rect);
+}
+
+/* The emission order rect of items[i], positions[i] is where the group of its parent put it.
+   Positions past the rects belong to items that have not been laid out. */
+TMV_API TMV_INLINE tmv_rect *tmv_squarify_emitted_rect(tmv_model *model, unsigned long *positions, unsigned long i)
+{
+  unsigned long position = positions[i];
+
+  TMV_PROFILE_COUNT(model->profile, parent_lookups, 1);
+  TMV_PROFILE_COUNT(model->profile, search_probes, 1);
+
+  if (position >= model->rects_count)
+  {
+    return 0;
+  }
+
+  /* A layout engine that wrote the group out of order falls back to the search */
+  return (model->rects[position].id == model->items[i].id) ? &model->rects[position] : tmv_model_find_rect_by_id(model, model->items[i].id);
+}
+
+/* Returns 0 if the rects did not fit into rects_capacity, see rects_dropped */
+TMV_API TMV_INLINE int tmv_squarify(
+    tmv_model *model,
+    tmv_rect area /* The area on which the squarified treemap should be aligned */
+)
+{
+  unsigned long *positions = 0;
+  unsigned long root_count;
+  unsigned long i = 0;
+  unsigned long j;
+
+  if (model->items_count == 0)
+  {
+    return 1;
+  }
+
+  /* Aligned rects need one rect per item */
+  if (model->rects_aligned && model->rects_capacity && model->rects_capacity < model->items_count)
+  {
+    return 0;
+  }
+
+  tmv_squarify_prepare(model);
+
+  /* Without an index the emission order rects are found by the position their group put them at. The
+     positions live in model->scratch, which the sort is done with, without it the rects are searched. */
+  if (!model->rects_aligned && !(model->index && model->index->entries) &&
+      model->scratch && model->scratch_size / sizeof(unsigned long) >= model->items_count)
+  {
+    positions = (unsigned long *)model->scratch;
+  }
+
+  TMV_PROFILE_BEGIN(model->profile, TMV_PROFILE_LAYOUT);
+
+  /* Layout only root-level items at first */
+  tmv_model_span(model, "root layout", 0, 1);
+  root_count = tmv_squarify_roots(model, area);
+  tmv_model_span(model, "root layout", 0, 0);
+
+  for (i = 0; positions && i < model->items_count; ++i)
+  {
+    positions[i] = (i < root_count) ? i : TMV_INDEX_NONE;
+  }
+
+  /* Layout children for each node (already depth-sorted) */
+  for (i = 0; i < model->items_count; ++i)
+  {
+    tmv_item *item = &model->items[i];
+    unsigned long start = model->rects_count;
+    int laid_out;
+
+    if (item->children_count == 0)
+    {
+      continue;
+    }
+
+    tmv_model_span(model, "children layout", item, 1);
+    laid_out = positions ? tmv_squarify_children_rect(model, i, tmv_squarify_emitted_rect(model, positions, i)) : tmv_squarify_children(model, i);
+    tmv_model_span(model, "children layout", item, 0);
+
+    /* The group is written in item order, the children of a group that is not laid out have no rects */
+    for (j = 0; positions && j < item->children_count; ++j)
+    {
+      positions[item->children_offset_index + j] = laid_out ? start + j : TMV_INDEX_NONE;
+    }
+  }
+
+  TMV_PROFILE_END(model->profile, TMV_PROFILE_LAYOUT);
+
+  /* Everything is laid out, nothing is left for tmv_relayout_dirty */
+  if (model->dirty)
+  {
+    for (i = 0; i < model->items_count; ++i)
+    {
+      model->dirty[i] = 0;
+    }
+  }
+
+  return model->rects_dropped == 0;
+}
+
+/* ########################################################## */
+/* # Weight aggregation                                       */
+/* ########################################################## */
+
+/* Sets the weight of every item with children to the sum of its children, the leaves keep theirs.
+   Sorts the items first and, if the new weights change the order of siblings, once more afterwards.
+   Also counts the subtree_sizes (if set) and depth_max. O(n) with sort scratch memory.
+
+   Sorting again moves the items, so call it before a layout and not in between tmv_update_weight
+   and tmv_relayout_dirty. */
+TMV_API TMV_INLINE void tmv_aggregate_weights(tmv_model *model)
+{
+  tmv_item *items = model->items;
+  unsigned long count = model->items_count;
+  unsigned long level_start;
+  unsigned long level_end;
+  unsigned long children;
+  unsigned long pass;
+  unsigned long i;
+  unsigned long j;
+
+  for (pass = 0; pass < 2; ++pass)
+  {
+    int ordered = 1;
+
+    tmv_model_sort(model);
+
+    /* Children are sorted behind their parent, so going backwards sums each child before its parent */
+    children = 0;
+    for (i = count; i-- > 0;)
+    {
+      tmv_item *item = &items[i];
+      unsigned long size = 1;
+
+      if (item->children_count > 0)
+      {
+        item->weight = tmv_total_weight(&items[item->children_offset_index], item->children_count);
+
+        for (j = item->children_offset_index; j < item->children_offset_index + item->children_count; ++j)
+        {
+          if (model->subtree_sizes)
+          {
+            size += model->subtree_sizes[j];
+          }
+          if (j > item->children_offset_index && items[j - 1].weight < items[j].weight)
+          {
+            ordered = 0;
+          }
+        }
+
+        children += item->children_count;
+      }
+
+      if (model->subtree_sizes)
+      {
+        model->subtree_sizes[i] = size;
+      }
+    }
+
+    /* The items that are nobody's child are the depth 0 groups in front */
+    for (i = 1; i < count - children; ++i)
+    {
+      if (items[i - 1].parent_id == items[i].parent_id && items[i - 1].weight < items[i].weight)
+      {
+        ordered = 0;
+      }
+    }
+
+    if (ordered)
+    {
+      break;
+    }
+
+    model->items_sorted = 0;
+  }
+
+  /* Each depth is one block whose children form the next block */
+  model->depth_max = 0;
+  level_start = 0;
+  level_end = count - children;
+
+  while (level_end < count)
+  {
+    children = 0;
+    for (i = level_start; i < level_end; ++i)
+    {
+      children += items[i].children_count;
+    }
+
+    level_start = level_end;
+    level_end += children;
+    model->depth_max++;
+  }
+}
+
+/* ########################################################## */
+/* # Incremental layout                                       */
+/* ########################################################## */
+
+/* Sets the weight of an item and adds the difference to all of its ancestors, so parents that
+   weigh the sum of their children stay so. Returns 0 if there is no item with the id.
+
+   With model->dirty the changed items are flagged for tmv_relayout_dirty, otherwise the
+   model is sorted again by the next layout. */
+TMV_API TMV_INLINE int tmv_update_weight(tmv_model *model, long id, tmv_real weight)
+{
+  tmv_item *item = tmv_model_find_item_by_id(model, id);
+  tmv_real delta;
+  unsigned long steps = 0;
+
+  if (!item)
+  {
+    return 0;
+  }
+
+  delta = weight - item->weight;
+
+  /* A parent cycle would loop forever, no chain is longer than the number of items */
+  while (item && steps++ < model->items_count)
+  {
+    item->weight = (steps == 1) ? weight : item->weight + delta;
+
+    if (model->dirty && model->items_sorted)
+    {
+      model->dirty[item - model->items] |= TMV_DIRTY_WEIGHT;
+    }
+
+    item = (item->parent_id < TMV_FIRST_VALID_PARENT_ID) ? 0 : tmv_model_find_item_by_id(model, item->parent_id);
+  }
+
+  if (!model->dirty)
+  {
+    model->items_sorted = 0;
+  }
+
+  return 1;
+}
+
+/* Sorts the group items[offset..offset + count) by weight (desc) again after weight updates.
+   Equal weights keep their current order. The dirty flags and aligned rects move with their
+   items and the index follows. The children of the group stay where they are, they are found by
+   their parent id. Insertion sort, so O(count) for a group that only had a few updates.
+   Groups of an engine that keeps the order stay as they are. */
+TMV_API TMV_INLINE void tmv_items_sort_group(tmv_model *model, unsigned long offset, unsigned long count)
+{
+  tmv_item *items = &model->items[offset];
+  unsigned long i;
+  unsigned long j;
+  int moved = 0;
+
+  if (tmv_layout_keeps_order(model->layout_engine))
+  {
+    return;
+  }
+
+  for (i = 1; i < count; ++i)
+  {
+    tmv_item item = items[i];
+    unsigned char flags = model->dirty ? model->dirty[offset + i] : 0;
+    unsigned long size = model->subtree_sizes ? model->subtree_sizes[offset + i] : 0;
+    tmv_rect rect;
+
+    if (model->rects_aligned)
+    {
+      rect = model->rects[offset + i];
+    }
+
+    for (j = i; j > 0 && items[j - 1].weight < item.weight; --j)
+    {
+      items[j] = items[j - 1];
+      TMV_PROFILE_COUNT(model->profile, sort_moves, 1);
+
+      if (model->dirty)
+      {
+        model->dirty[offset + j] = model->dirty[offset + j - 1];
+      }
+      if (model->subtree_sizes)
+      {
+        model->subtree_sizes[offset + j] = model->subtree_sizes[offset + j - 1];
+      }
+      if (model->rects_aligned)
+      {
+        model->rects[offset + j] = model->rects[offset + j - 1];
+      }
+    }
+
+    if (j == i)
+    {
+      continue;
+    }
+
+    items[j] = item;
+    moved = 1;
+    TMV_PROFILE_COUNT(model->profile, sort_moves, 1);
+
+    if (model->dirty)
+    {
+      model->dirty[offset + j] = flags;
+    }
+    if (model->subtree_sizes)
+    {
+      model->subtree_sizes[offset + j] = size;
+    }
+    if (model->rects_aligned)
+    {
+      model->rects[offset + j] = rect;
+    }
+  }
+
+  if (moved && model->index && model->index->entries)
+  {
+    for (i = 0; i < count; ++i)
+    {
+      tmv_index_entry *entry = tmv_index_find(model->index, items[i].id);
+      if (entry)
+      {
+        entry->item = offset + i;
+      }
+    }
+  }
+}
+
+/* Adds the stats of the leaves and collapsed items of the aligned group items[offset..offset + count) */
+TMV_API TMV_INLINE void tmv_stats_add_leaves(tmv_model *model, unsigned long offset, unsigned long count)
+{
+  unsigned long i;
+  for (i = offset; i < offset + count; ++i)
+  {
+    if (model->items[i].children_count == 0 || tmv_collapsed(model->min_side, model->rects[i].width, model->rects[i].height))
+    {
+      tmv_stats_add(&model->stats, model->items[i].weight);
+    }
+  }
+}
+
+/* Recomputes the stats and the collapsed count of aligned rects in the order tmv_squarify lays them out */
+TMV_API TMV_INLINE void tmv_squarify_stats(tmv_model *model, unsigned long root_count)
+{
+  unsigned long i;
+
+  tmv_stats_reset(&model->stats);
+  model->collapsed_count = 0;
+
+  tmv_stats_add_leaves(model, 0, root_count);
+
+  for (i = 0; i < model->items_count; ++i)
+  {
+    tmv_item *item = &model->items[i];
+
+    if (item->children_count == 0 || model->rects[i].id != item->id)
+    {
+      continue;
+    }
+
+    if (tmv_collapsed(model->min_side, model->rects[i].width, model->rects[i].height))
+    {
+      model->collapsed_count++;
+    }
+    else
+    {
+      tmv_stats_add_leaves(model, item->children_offset_index, item->children_count);
+    }
+  }
+}
+
+/* Clears the aligned rects of items[offset..offset + count) after their parent lost its rect or got collapsed.
+   Items that had a rect are flagged, so their children follow. Returns 1 if a rect has been cleared. */
+TMV_API TMV_INLINE int tmv_rects_clear(tmv_model *model, unsigned long offset, unsigned long count)
+{
+  unsigned long i;
+  int cleared = 0;
+
+  for (i = offset; i < offset + count; ++i)
+  {
+    if (model->rects[i].id == model->items[i].id)
+    {
+      tmv_rect none = {0};
+      none.id = -1 - model->items[i].id;
+      model->rects[i] = none;
+      model->dirty[i] |= TMV_DIRTY_RECT;
+      cleared = 1;
+    }
+  }
+
+  return cleared;
+}
+
+/* Records a written range, merged with the previous one if they touch. Returns the ranges count. */
+TMV_API TMV_INLINE unsigned long tmv_rect_ranges_add(tmv_rect_range *ranges, unsigned long ranges_capacity, unsigned long ranges_count, unsigned long offset, unsigned long count)
+{
+  if (ranges_count > 0 && ranges_count <= ranges_capacity &&
+      ranges[ranges_count - 1].offset + ranges[ranges_count - 1].count == offset)
+  {
+    ranges[ranges_count - 1].count += count;
+    return ranges_count;
+  }
+
+  if (ranges_count < ranges_capacity)
+  {
+    ranges[ranges_count].offset = offset;
+    ranges[ranges_count].count = count;
+  }
+
+  return ranges_count + 1;
+}
+
+/* Lays out the model again after tmv_update_weight calls. The area has to be the one of the
+   previous layout, use tmv_squarify for a new one.
+
+   For aligned rects with model->dirty only the sibling groups with changed weights are sorted
+   again, and only the groups of a changed weight or below a rect that moved are laid out again
+   (or cleared, if the rect is collapsed now).
+   A single pass over the dirty flags replays the stats in layout order, so rects and stats match
+   a full tmv_squarify of the updated items. Other models are laid out completely.
+
+   The rewritten rects are reported in ranges (at most ranges_capacity of them). Returns the
+   number of ranges, which can be larger than ranges_capacity. */
+TMV_API TMV_INLINE unsigned long tmv_relayout_dirty(
+    tmv_model *model,
+    tmv_rect area, /* The area of the previous layout */
+    tmv_rect_range *ranges,
+    unsigned long ranges_capacity)
+{
+  unsigned char *dirty = model->dirty;
+  unsigned long ranges_count = 0;
+  unsigned long root_count = 0;
+  int roots_dirty = 0;
+  unsigned long i;
+
+  if (model->items_count == 0)
+  {
+    return 0;
+  }
+
+  if (!dirty || !model->items_sorted || !model->rects_aligned)
+  {
+    /* Emission order rects move with the sibling order, only the sort can be kept short */
+    if (dirty && model->items_sorted)
+    {
+      while (root_count < model->items_count && model->items[root_count].parent_id < TMV_FIRST_VALID_PARENT_ID)
+      {
+        ++root_count;
+      }
+
+      tmv_items_sort_group(model, 0, root_count);
+
+      for (i = 0; i < model->items_count; ++i)
+      {
+        if ((dirty[i] & TMV_DIRTY_WEIGHT) && model->items[i].children_count > 0)
+        {
+          tmv_items_sort_group(model, model->items[i].children_offset_index, model->items[i].children_count);
+        }
+      }
+    }
+
+    tmv_squarify(model, area);
+
+    return tmv_rect_ranges_add(ranges, ranges_capacity, 0, 0, model->rects_count);
+  }
+
+  TMV_PROFILE_BEGIN(model->profile, TMV_PROFILE_LAYOUT);
+
+  while (root_count < model->items_count && model->items[root_count].parent_id < TMV_FIRST_VALID_PARENT_ID)
+  {
+    roots_dirty |= (dirty[root_count] & TMV_DIRTY_WEIGHT);
+    ++root_count;
+  }
+
+  if (roots_dirty)
+  {
+    tmv_items_sort_group(model, 0, root_count);
+    tmv_squarify_roots(model, area);
+    ranges_count = tmv_rect_ranges_add(ranges, ranges_capacity, ranges_count, 0, root_count);
+  }
+
+  /* The children are behind their parent, so the flags a layout sets are seen later on */
+  tmv_stats_reset(&model->stats);
+  tmv_stats_add_leaves(model, 0, root_count);
+  model->collapsed_count = 0;
+
+  for (i = 0; i < model->items_count; ++i)
+  {
+    tmv_item *item = &model->items[i];
+    unsigned long offset = item->children_offset_index;
+    int shown = (model->rects[i].id == item->id);
+    int collapsed = shown && tmv_collapsed(model->min_side, model->rects[i].width, model->rects[i].height);
+
+    if (item->children_count == 0)
+    {
+      dirty[i] = 0;
+      continue;
+    }
+
+    if (dirty[i] & TMV_DIRTY_WEIGHT)
+    {
+      tmv_items_sort_group(model, offset, item->children_count);
+    }
+
+    if (shown && !collapsed)
+    {
+      if (dirty[i])
+      {
+        tmv_model child_model = *model;
+        child_model.items = &model->items[offset];
+        child_model.items_count = item->children_count;
+        child_model.rects = &model->rects[offset];
+        child_model.dirty = &dirty[offset];
+
+        tmv_squarify_current(&child_model, model->rects[i]);
+
+        ranges_count = tmv_rect_ranges_add(ranges, ranges_capacity, ranges_count, offset, item->children_count);
+      }
+
+      tmv_stats_add_leaves(model, offset, item->children_count);
+    }
+    else
+    {
+      model->collapsed_count += (unsigned long)collapsed;
+
+      if (dirty[i] && tmv_rects_clear(model, offset, item->children_count))
+      {
+        ranges_count = tmv_rect_ranges_add(ranges, ranges_capacity, ranges_count, offset, item->children_count);
+      }
+    }
+
+    dirty[i] = 0;
+  }
+
+  TMV_PROFILE_END(model->profile, TMV_PROFILE_LAYOUT);
+
+  return ranges_count;
+}
+
+/* ########################################################## */
+/* # Subtree layout                                           */
+/* ########################################################## */
+
+#define TMV_SUBTREE_PATH_MAX 64 /* The path length of a subtree layout without model->scratch */
+
+/* A sibling group on the path of tmv_squarify_subtree_children */
+typedef struct tmv_subtree_frame
+{
+  unsigned long child; /* The index of the item of the group whose subtree is next */
+  unsigned long first; /* The first rect of the group */
+
+} tmv_subtree_frame;
+
+/* Lays out the children of item into parent_rect and passes them on to the sink, if any.
+   Returns 0 if the rects did not fit into rects_capacity or the sink stopped, else the first rect in *first. */
+TMV_API TMV_INLINE int tmv_squarify_subtree_group(
+    tmv_model *model,
+    tmv_item *item,
+    tmv_rect parent_rect,
+    tmv_rect_sink sink,
+    void *user_data,
+    unsigned long *first)
+{
+  unsigned long offset = item->children_offset_index;
+  unsigned long count = item->children_count;
+
+  tmv_model child_model;
+
+  *first = model->rects_aligned ? offset : model->rects_count;
+
+  if (!model->rects_aligned && model->rects_capacity && *first + count > model->rects_capacity)
+  {
+    model->rects_dropped += count;
+    return 0;
+  }
+
+  /* Setup child model view, a subtree layout is a view and leaves the dirty flags alone */
+  child_model = *model;
+  child_model.items = &model->items[offset];
+  child_model.items_count = count;
+  child_model.dirty = 0;
+
+  if (model->rects_aligned)
+  {
+    child_model.rects = &model->rects[offset];
+  }
+
+  /* Streamed rects are released again, there is nothing to index */
+  if (sink)
+  {
+    child_model.index = 0;
+  }
+
+  tmv_squarify_current(&child_model, parent_rect);
+
+  model->rects_count = child_model.rects_count;
+  model->stats = child_model.stats;
+
+  return !sink || sink(user_data, &model->rects[*first], child_model.items, count);
+}
+
+/* Lays out the children of item into parent_rect and their subtrees depth first for depth - 1 more levels.
+   With a sink each group is passed on once it is laid out and its rects are released after its subtrees.
+   Returns 0 if the rects did not fit into rects_capacity, the sink stopped or the path was too deep.
+
+   The path is an explicit stack of one tmv_subtree_frame per level. It lives in model->scratch, which the
+   sort is done with and which fits any path, without scratch paths deeper than TMV_SUBTREE_PATH_MAX fail. */
+TMV_API TMV_INLINE int tmv_squarify_subtree_children(
+    tmv_model *model,
+    tmv_item *item,
+    tmv_rect parent_rect,
+    unsigned long depth,
+    tmv_rect_sink sink,
+    void *user_data)
+{
+  tmv_subtree_frame path_local[TMV_SUBTREE_PATH_MAX];
+  tmv_subtree_frame *path = path_local;
+  unsigned long path_capacity = TMV_SUBTREE_PATH_MAX;
+  unsigned long level = 0;
+  unsigned long first;
+
+  if (model->scratch && model->scratch_size / sizeof(tmv_subtree_frame) > path_capacity)
+  {
+    path = (tmv_subtree_frame *)model->scratch;
+    path_capacity = model->scratch_size / sizeof(tmv_subtree_frame);
+  }
+
+  if (!tmv_squarify_subtree_group(model, item, parent_rect, sink, user_data, &first))
+  {
+    return 0;
+  }
+
+  path[0].child = item->children_offset_index;
+  path[0].first = first;
+
+  for (;;)
+  {
+    tmv_subtree_frame *frame = &path[level];
+    tmv_item *parent = level ? &model->items[path[level - 1].child] : item;
+    tmv_item *child;
+    tmv_rect rect;
+
+    /* The group is done, continue with the next sibling of its parent */
+    if (frame->child == parent->children_offset_index + parent->children_count)
+    {
+      if (level == 0)
+      {
+        return 1;
+      }
+
+      /* The group was laid out right behind the rects of the parent group */
+      if (sink)
+      {
+        model->rects_count = frame->first;
+      }
+
+      level--;
+      path[level].child++;
+      continue;
+    }
+
+    /* The rects of the group are rects[first..first + count) in both modes */
+    child = &model->items[frame->child];
+    rect = model->rects[frame->first + (frame->child - parent->children_offset_index)];
+
+    if (child->children_count == 0)
+    {
+      frame->child++;
+    }
+    else if (tmv_collapsed(model->min_side, rect.width, rect.height))
+    {
+      model->collapsed_count++;
+      frame->child++;
+    }
+    else if (level + 1 >= depth)
+    {
+      /* At the depth limit a parent stands in for its subtree like a collapsed one */
+      tmv_stats_add(&model->stats, child->weight);
+      frame->child++;
+    }
+    else if (level + 1 == path_capacity || !tmv_squarify_subtree_group(model, child, rect, sink, user_data, &first))
+    {
+      return 0;
+    }
+    else
+    {
+      level++;
+      path[level].child = child->children_offset_index;
+      path[level].first = first;
+    }
+  }
+}
+
+/* Lays out the descendants of the item with the given id into area, down to max_depth levels below it
+   (1 lays out the children only). Returns 0 if there is no item with the id or the rects did not fit.
+
+   The sort of a previous layout is reused, so with an index the cost only depends on the number of
+   rects that are laid out. In aligned mode only the rects of those descendants are written and all
+   other rects keep their previous content, in emission mode the rects are replaced by the descendants.
+   The item itself gets no rect, area is its rect. See tmv_squarify_subtree_children for the path memory. */
+TMV_API TMV_INLINE int tmv_squarify_subtree(
+    tmv_model *model,
+    long id,
+    tmv_rect area,
+    unsigned long max_depth)
+{
+  tmv_item *item;
+
+  if (model->rects_aligned && model->rects_capacity && model->rects_capacity < model->items_count)
+  {
+    return 0;
+  }
+
+  if (!model->items_sorted)
+  {
+    tmv_squarify_prepare(model);
+  }
+  else
+  {
+    tmv_stats_reset(&model->stats);
+    model->rects_count = model->rects_aligned ? model->items_count : 0;
+    model->rects_dropped = 0;
+    model->collapsed_count = 0;
+  }
+
+  item = tmv_model_find_item_by_id(model, id);
+
+  if (!item)
+  {
+    return 0;
+  }
+
+  if (item->children_count == 0 || max_depth == 0)
+  {
+    tmv_stats_add(&model->stats, item->weight);
+    return 1;
+  }
+
+  if (tmv_collapsed(model->min_side, area.width, area.height))
+  {
+    tmv_stats_add(&model->stats, item->weight);
+    model->collapsed_count = 1;
+    return 1;
+  }
+
+  return tmv_squarify_subtree_children(model, item, area, max_depth, 0, 0);
+}
+
+/* ########################################################## */
+/* # Streaming layout                                         */
+/* ########################################################## */
+
+/* Lays out the model like tmv_squarify but hands every sibling group to sink as soon as it is laid out,
+   the roots first and then depth first. The rects only hold the groups on the current path, so
+   rects_capacity can be far below the number of items. Returns 0 if the path did not fit into
+   rects_capacity (see rects_dropped), the path was too deep or the sink stopped the layout.
+
+   Emission mode only, the rects are scratch memory afterwards and rects_count is 0. The memory is
+   bounded, the rects hold the groups on the deepest path and model->scratch one frame per level of
+   it (see tmv_squarify_subtree_children). */
+TMV_API TMV_INLINE int tmv_squarify_stream(
+    tmv_model *model,
+    tmv_rect area,
+    tmv_rect_sink sink,
+    void *user_data)
+{
+  /* The roots are the children of an item in front of the sorted items */
+  tmv_item roots = {0};
+  int result;
+
+  if (model->rects_aligned || !sink)
+  {
+    return 0;
+  }
+
+  if (model->items_count == 0)
+  {
+    return 1;
+  }
+
+  tmv_squarify_prepare(model);
+
+  while (roots.children_count < model->items_count &&
+         model->items[roots.children_count].parent_id < TMV_FIRST_VALID_PARENT_ID)
+  {
+    ++roots.children_count;
+  }
+
+  if (roots.children_count == 0)
+  {
+    return 1;
+  }
+
+  result = tmv_squarify_subtree_children(model, &roots, area, (unsigned long)-1, sink, user_data);
+
+  model->rects_count = 0;
+
+  return result;
+}
+
+/* ########################################################## */
+/* # Hit testing                                              */
+/* ########################################################## */
+
+/* Rects are half open, a point on an edge shared by two rects hits only one of them */
+TMV_API TMV_INLINE int tmv_rect_contains(tmv_rect *rect, tmv_real x, tmv_real y)
+{
+  return x >= rect->x && x < rect->x + rect->width &&
+         y >= rect->y && y < rect->y + rect->height;
+}
+
+/* Returns the rect of items[i] or 0 if it has not been laid out */
+TMV_API TMV_INLINE tmv_rect *tmv_model_rect_at(tmv_model *model, unsigned long i)
+{
+  if (model->rects_aligned)
+  {
+    return (model->rects[i].id == model->items[i].id) ? &model->rects[i] : 0;
+  }
+  return tmv_model_find_rect_by_id(model, model->items[i].id);
+}
+
+/* Finds the deepest laid out item whose rect contains (x, y). Children lie inside their parent, so it
+   descends from the roots and only tests the children of the item that has been hit last.
+
+   path receives the item indices from the root down. If the path is deeper than path_capacity the last
+   entry is replaced, so it always ends with the deepest item. Returns the length of the path, 0 if nothing
+   has been hit. Needs the sorted items of a layout, emission order rects are found in O(1) with an index. */
+TMV_API TMV_INLINE unsigned long tmv_hit_test(
+    tmv_model *model,
+    tmv_real x,
+    tmv_real y,
+    unsigned long *path,
+    unsigned long path_capacity)
+{
+  unsigned long offset = 0;
+  unsigned long count = 0;
+  unsigned long depth = 0;
+
+  if (!model->items_sorted)
+  {
+    return 0;
+  }
+
+  /* The roots are sorted to the front */
+  while (count < model->items_count && model->items[count].parent_id < TMV_FIRST_VALID_PARENT_ID)
+  {
+    ++count;
+  }
 
-  /* User provided fields */
-  long id;        /* The id of this item that is also used for the computed tmv_rect */
-  long parent_id; /* The parent id of this item */
-  double weight;  /* The weight of the item */
+  while (count > 0)
+  {
+    unsigned long hit = offset + count;
+    unsigned long i;
 
-  /* Computed fields */
-  unsigned long children_offset_index; /* The tmv_item index where the childrens are located */
-  unsigned long children_count;        /* The number of childrens */
+    for (i = offset; i < offset + count; ++i)
+    {
+      tmv_rect *rect = tmv_model_rect_at(model, i);
 
-} tmv_item;
+      if (rect && tmv_rect_contains(rect, x, y))
+      {
+        hit = i;
+        break;
+      }
+    }
 
-typedef struct tmv_rect
-{
-  long id;
+    if (hit == offset + count)
+    {
+      break;
+    }
 
-  double x;
-  double y;
-  double width;
-  double height;
+    if (path && path_capacity > 0)
+    {
+      path[(depth < path_capacity) ? depth : path_capacity - 1] = hit;
+    }
 
-} tmv_rect;
+    ++depth;
 
-typedef struct tmv_stats
-{
-  double weigth_min;
-  double weigth_max;
-  double weigth_sum;
-  unsigned long count;
+    offset = model->items[hit].children_offset_index;
+    count = model->items[hit].children_count;
+  }
 
-} tmv_stats;
+  return depth;
+}
 
-typedef struct tmv_model
-{
-  tmv_stats stats;                    /* The calculated stats and metrics  */
-  int items_sorted;                   /* Did the items have been sorted */
-  unsigned long items_count;          /* The number of items */
-  unsigned long items_user_data_size; /* The user_data size per item */
-  unsigned long rects_count;          /* The output rects that have been computed */
-  tmv_item *items;                    /* The descending by weight sorted treemap items*/
-  tmv_rect *rects;                    /* The output rects that have been computed */
+/* ########################################################## */
+/* # Layout diff                                              */
+/* ########################################################## */
+#define TMV_CHANGE_ADDED 0x01   /* The item has a rect only in the new layout */
+#define TMV_CHANGE_REMOVED 0x02 /* The item has a rect only in the old layout */
+#define TMV_CHANGE_MOVED 0x04   /* x or y differ by more than the tolerance */
+#define TMV_CHANGE_RESIZED 0x08 /* width or height differ by more than the tolerance */
 
-} tmv_model;
+TMV_API TMV_INLINE int tmv_real_differs(tmv_real a, tmv_real b, tmv_real tolerance)
+{
+  return (a > b) ? (a - b > tolerance) : (b - a > tolerance);
+}
 
-TMV_API TMV_INLINE double tmv_total_weight(tmv_item *items, unsigned long count)
+TMV_API TMV_INLINE int tmv_change_flags(tmv_rect *old_rect, tmv_rect *new_rect, tmv_real tolerance)
 {
-  double sum = 0.0;
-  unsigned long i;
-  for (i = 0; i < count; ++i)
+  int flags = 0;
+
+  if (tmv_real_differs(old_rect->x, new_rect->x, tolerance) || tmv_real_differs(old_rect->y, new_rect->y, tolerance))
   {
-    sum += items[i].weight;
+    flags |= TMV_CHANGE_MOVED;
   }
-  return sum;
+  if (tmv_real_differs(old_rect->width, new_rect->width, tolerance) || tmv_real_differs(old_rect->height, new_rect->height, tolerance))
+  {
+    flags |= TMV_CHANGE_RESIZED;
+  }
+
+  return flags;
 }
 
-TMV_API TMV_INLINE tmv_item *tmv_find_item_by_id(tmv_item *items, unsigned long count, long id)
+/* Sorts the ids of the rects of a model in scratch (see tmv_items_sort_scratch_size of its rects_count),
+   each key holds the rect position. Returns the keys or 0 if the scratch is too small. The other half of
+   the scratch becomes one matched flag per rect, cleared. */
+TMV_API TMV_INLINE tmv_sort_key *tmv_layout_diff_keys(tmv_model *model, void *scratch, unsigned long scratch_size, unsigned long *keys_count, unsigned long **matched)
 {
+  tmv_sort_key *keys;
+  tmv_sort_key *keys_tmp;
+  unsigned long count = 0;
   unsigned long i;
 
-  for (i = 0; i < count; ++i)
+  if (!scratch || scratch_size < tmv_items_sort_scratch_size(model->rects_count))
   {
-    if (items[i].id == id)
+    return 0;
+  }
+
+  keys = (tmv_sort_key *)scratch;
+  keys_tmp = keys + model->rects_count;
+
+  for (i = 0; i < model->rects_count; ++i)
+  {
+    tmv_rect *rect = model->rects_aligned ? tmv_model_rect_at(model, i) : &model->rects[i];
+
+    if (!rect)
     {
-      return &items[i];
+      continue;
     }
+
+    tmv_sort_key_id(&keys[count], rect->id);
+    keys[count].index = i;
+    ++count;
   }
 
-  return 0;
+  tmv_sort_radix(&keys, &keys_tmp, count, (unsigned long *)(((tmv_sort_key *)scratch) + 2 * model->rects_count));
+
+  *matched = (unsigned long *)keys_tmp;
+  for (i = 0; i < model->rects_count; ++i)
+  {
+    (*matched)[i] = 0;
+  }
+
+  *keys_count = count;
+  return keys;
 }
 
-TMV_API TMV_INLINE tmv_rect *tmv_find_rect_by_id(tmv_rect *rects, unsigned long count, long id)
+/* Returns the position of the rect with the id in keys sorted by tmv_layout_diff_keys or TMV_INDEX_NONE */
+TMV_API TMV_INLINE unsigned long tmv_layout_diff_search(tmv_sort_key *keys, unsigned long count, long id, tmv_profile *profile)
 {
-  unsigned long i;
-  for (i = 0; i < count; ++i)
+  tmv_sort_key key;
+  unsigned long low = 0;
+  unsigned long high = count;
+
+  tmv_sort_key_id(&key, id);
+
+  while (low < high)
   {
-    if (rects[i].id == id)
+    unsigned long middle = low + (high - low) / 2;
+
+    TMV_PROFILE_COUNT(profile, search_probes, 1);
+
+    if (keys[middle].hi < key.hi || (keys[middle].hi == key.hi && keys[middle].lo < key.lo))
     {
-      return &rects[i];
+      low = middle + 1;
+    }
+    else
+    {
+      high = middle;
     }
   }
-  return 0;
+
+  return (low < count && keys[low].hi == key.hi && keys[low].lo == key.lo) ? keys[low].index : TMV_INDEX_NONE;
 }
 
-TMV_API TMV_INLINE void tmv_items_depth_sort_offset(tmv_item *items, unsigned long count)
+/* Compares two layouts of the same items by id, for example before and after weight updates, so a renderer
+   only has to redraw what changed. Both models can be aligned or in emission order.
+
+   The added, moved and resized rects are reported in the order of the new rects, then the removed ones in
+   the order of the old rects. Rects are joined with the model indices in O(n). Unless both models have one,
+   the ids of the old rects are radix sorted in the scratch of the old model (or else of the new one) and
+   the new rects search them in O(n log n). Without index and scratch the rects are searched linearly.
+   At most changes_capacity changes are written, returns the number of changes, which can be larger than
+   changes_capacity. */
+TMV_API TMV_INLINE unsigned long tmv_layout_diff(
+    tmv_model *old_model,
+    tmv_model *new_model,
+    tmv_real tolerance, /* Coordinates that differ by at most this are equal */
+    tmv_change *changes,
+    unsigned long changes_capacity)
 {
-  unsigned long i, j;
-  int changed;
-  unsigned long iteration;
+  tmv_sort_key *keys = 0;
+  unsigned long *matched = 0;
+  unsigned long keys_count = 0;
+  unsigned long changes_count = 0;
+  unsigned long i;
 
-  /* (1) Compute depths (iterative) */
-  for (iteration = 0; iteration < count; ++iteration)
+  if (!old_model->index || !old_model->index->entries || !new_model->index || !new_model->index->entries)
   {
-    changed = 0;
-    for (i = 0; i < count; i++)
-    {
-      tmv_item *item = &items[i];
-      if (item->parent_id < TMV_FIRST_VALID_PARENT_ID)
-      {
-        if (item->children_offset_index != 0)
-        {
-          item->children_offset_index = 0;
-          changed = 1;
-        }
-      }
-      else
-      {
-        for (j = 0; j < count; ++j)
-        {
-          if (items[j].id == item->parent_id)
-          {
-            unsigned long new_depth = items[j].children_offset_index + 1;
-            if (item->children_offset_index != new_depth)
-            {
-              item->children_offset_index = new_depth;
-              changed = 1;
-            }
-            break;
-          }
-        }
-      }
-    }
-    if (!changed)
+    keys = tmv_layout_diff_keys(old_model, old_model->scratch, old_model->scratch_size, &keys_count, &matched);
+
+    if (!keys)
     {
-      break;
+      keys = tmv_layout_diff_keys(old_model, new_model->scratch, new_model->scratch_size, &keys_count, &matched);
     }
   }
 
-  /* 2) Stable insertion sort by depth (asc), parent_id (asc), weight (desc) */
-  for (i = 1; i < count; ++i)
+  /* (1) Added, moved and resized, the aligned rects of items without one are skipped */
+  for (i = 0; i < new_model->rects_count; ++i)
   {
-    tmv_item key = items[i];
-    j = i;
+    tmv_rect *new_rect = new_model->rects_aligned ? tmv_model_rect_at(new_model, i) : &new_model->rects[i];
+    tmv_rect *old_rect;
+    tmv_rect none = {0};
+    int flags;
 
-    while (j > 0)
+    if (!new_rect)
     {
-      tmv_item *prev = &items[j - 1];
+      continue;
+    }
 
-      int depth_cmp = (int)prev->children_offset_index - (int)key.children_offset_index;
-      int parent_cmp = (prev->parent_id < key.parent_id) ? -1 : (prev->parent_id > key.parent_id) ? 1
-                                                                                                  : 0;
-      int weight_cmp = (prev->weight < key.weight) ? 1 : (prev->weight > key.weight) ? -1
-                                                                                     : 0;
+    if (keys)
+    {
+      unsigned long position = tmv_layout_diff_search(keys, keys_count, new_rect->id, new_model->profile);
 
-      int should_swap = 0;
+      old_rect = (position != TMV_INDEX_NONE) ? &old_model->rects[position] : 0;
 
-      if (depth_cmp > 0)
-        should_swap = 1;
-      else if (depth_cmp == 0)
+      if (old_rect)
       {
-        if (parent_cmp > 0)
-          should_swap = 1;
-        else if (parent_cmp == 0 && weight_cmp > 0)
-          should_swap = 1;
+        matched[position] = 1;
       }
+    }
+    else
+    {
+      old_rect = tmv_model_find_rect_by_id(old_model, new_rect->id);
+    }
 
-      if (!should_swap)
-        break;
+    flags = old_rect ? tmv_change_flags(old_rect, new_rect, tolerance) : TMV_CHANGE_ADDED;
 
-      items[j] = items[j - 1];
-      j--;
+    if (!flags)
+    {
+      continue;
     }
 
-    items[j] = key;
+    if (changes_count < changes_capacity)
+    {
+      changes[changes_count].id = new_rect->id;
+      changes[changes_count].flags = flags;
+      changes[changes_count].old_rect = old_rect ? *old_rect : none;
+      changes[changes_count].new_rect = *new_rect;
+    }
+    ++changes_count;
   }
 
-  /* (3) Compute children offsets & counts in one pass */
-  for (i = 0; i < count; ++i)
+  /* (2) Removed, with the sorted ids the old rects no new rect found */
+  for (i = 0; i < old_model->rects_count; ++i)
   {
-    long pid = items[i].id;
-    unsigned long offset = 0;
-    unsigned long ccount = 0;
+    tmv_rect *old_rect = old_model->rects_aligned ? tmv_model_rect_at(old_model, i) : &old_model->rects[i];
+    tmv_rect none = {0};
 
-    for (j = i + 1; j < count; ++j)
+    if (!old_rect || (keys ? matched[i] != 0 : tmv_model_find_rect_by_id(new_model, old_rect->id) != 0))
     {
-      if (items[j].parent_id == pid)
-      {
-        if (ccount == 0)
-        {
-          offset = j;
-        }
-        ccount++;
-      }
-      else if (ccount > 0)
-      {
-        break;
-      }
+      continue;
+    }
+
+    if (changes_count < changes_capacity)
+    {
+      changes[changes_count].id = old_rect->id;
+      changes[changes_count].flags = TMV_CHANGE_REMOVED;
+      changes[changes_count].old_rect = *old_rect;
+      changes[changes_count].new_rect = none;
     }
-    items[i].children_offset_index = (ccount > 0) ? offset : 0;
-    items[i].children_count = ccount;
+    ++changes_count;
   }
+
+  return changes_count;
 }
 
-TMV_API TMV_INLINE void tmv_layout_row(
-    tmv_model *model,
-    tmv_rect row_area,
-    tmv_item *row_items,
-    unsigned long row_count)
+/* ########################################################## */
+/* # Structure of arrays model                                */
+/* ########################################################## */
+TMV_API TMV_INLINE unsigned long tmv_model_soa_memory_size(unsigned long count)
 {
-  unsigned long i;
-  double area = row_area.width * row_area.height;
-  double total_weight = tmv_total_weight(row_items, row_count);
-  double scale = (total_weight > 0.0) ? (area / total_weight) : 0.0;
+  return count * (5 * sizeof(tmv_real) + 2 * sizeof(long) + 2 * sizeof(unsigned long));
+}
 
-  int horizontal = (row_area.width >= row_area.height);
-  double offset = 0.0;
+/* Points the arrays of the model into memory, which needs tmv_model_soa_memory_size(count) bytes */
+TMV_API TMV_INLINE int tmv_model_soa_init(tmv_model_soa *model, void *memory, unsigned long memory_size, unsigned long count)
+{
+  tmv_real *reals;
+  long *ids;
+  unsigned long *offsets;
 
-  for (i = 0; i < row_count; ++i)
+  if (!memory || memory_size < tmv_model_soa_memory_size(count))
   {
-    tmv_item row_item = row_items[i];
+    return 0;
+  }
 
-    double item_area = row_item.weight * scale;
-    double w, h;
+  /* The wider type first, so both stay aligned (float reals behind the longs on LP64) */
+  if (sizeof(tmv_real) >= sizeof(long))
+  {
+    reals = (tmv_real *)memory;
+    ids = (long *)(void *)(reals + 5 * count);
+    offsets = (unsigned long *)(void *)(ids + 2 * count);
+  }
+  else
+  {
+    ids = (long *)memory;
+    offsets = (unsigned long *)(void *)(ids + 2 * count);
+    reals = (tmv_real *)(void *)(offsets + 2 * count);
+  }
 
-    /* Collect statistics */
-    if (row_item.children_count == 0)
-    {
-      double weight = row_item.weight;
+  model->items_count = count;
+  model->weights = reals;
+  model->x = reals + count;
+  model->y = reals + 2 * count;
+  model->w = reals + 3 * count;
+  model->h = reals + 4 * count;
+  model->ids = ids;
+  model->parent_ids = ids + count;
+  model->children_offsets = offsets;
+  model->children_counts = offsets + count;
+
+  return 1;
+}
 
-      if (model->stats.weigth_min < 0.0 || weight < model->stats.weigth_min)
-      {
-        model->stats.weigth_min = weight;
-      }
+/* Copies items that are in the order of tmv_items_depth_sort_offset into the model */
+TMV_API TMV_INLINE void tmv_model_soa_from_items(tmv_model_soa *model, tmv_item *items, unsigned long count)
+{
+  unsigned long i;
 
-      if (model->stats.weigth_max < 0.0 || weight > model->stats.weigth_max)
-      {
-        model->stats.weigth_max = weight;
-      }
+  model->items_count = count;
 
-      model->stats.weigth_sum += weight;
-      model->stats.count += 1;
-    }
+  for (i = 0; i < count; ++i)
+  {
+    model->ids[i] = items[i].id;
+    model->parent_ids[i] = items[i].parent_id;
+    model->weights[i] = items[i].weight;
+    model->children_offsets[i] = items[i].children_offset_index;
+    model->children_counts[i] = items[i].children_count;
+  }
+}
 
-    /* Add rects */
-    if (horizontal)
+TMV_API TMV_INLINE void tmv_model_soa_to_items(tmv_model_soa *model, tmv_item *items)
+{
+  unsigned long i;
+
+  for (i = 0; i < model->items_count; ++i)
+  {
+    items[i].id = model->ids[i];
+    items[i].parent_id = model->parent_ids[i];
+    items[i].weight = model->weights[i];
+    items[i].children_offset_index = model->children_offsets[i];
+    items[i].children_count = model->children_counts[i];
+  }
+}
+
+/* Writes rects like the aligned mode of tmv_model, items without a rect get the id -1 - item id */
+TMV_API TMV_INLINE void tmv_model_soa_to_rects(tmv_model_soa *model, tmv_rect *rects)
+{
+  unsigned long i;
+
+  for (i = 0; i < model->items_count; ++i)
+  {
+    tmv_rect rect = {0};
+
+    if (model->w[i] < 0)
     {
-      w = item_area / row_area.height;
-      h = row_area.height;
-      model->rects[model->rects_count].x = row_area.x + offset;
-      model->rects[model->rects_count].y = row_area.y;
-      model->rects[model->rects_count].width = w;
-      model->rects[model->rects_count].height = h;
-      offset += w;
+      rect.id = -1 - model->ids[i];
     }
     else
     {
-      w = row_area.width;
-      h = item_area / row_area.width;
-      model->rects[model->rects_count].x = row_area.x;
-      model->rects[model->rects_count].y = row_area.y + offset;
-      model->rects[model->rects_count].width = w;
-      model->rects[model->rects_count].height = h;
-      offset += h;
+      rect.id = model->ids[i];
+      rect.x = model->x[i];
+      rect.y = model->y[i];
+      rect.width = model->w[i];
+      rect.height = model->h[i];
     }
 
-    model->rects[model->rects_count].id = row_item.id;
-    model->rects_count++;
+    rects[i] = rect;
   }
 }
 
-TMV_API TMV_INLINE void tmv_squarify_current(
-    tmv_model *model,
-    tmv_rect render_area /* The area on which the squarified treemap should be aligned */
-)
+TMV_API TMV_INLINE void tmv_layout_row_soa(
+    tmv_model_soa *model,
+    tmv_rect row_area,
+    unsigned long start,
+    unsigned long row_count)
 {
-  tmv_item *items = model->items;
-  unsigned long items_count = model->items_count;
-
-  unsigned long start = 0;
-  double total_weight = tmv_total_weight(items, items_count);
-  double area = render_area.width * render_area.height;
-  double scale = (total_weight > 0.0) ? (area / total_weight) : 0.0;
+  unsigned long i;
+  tmv_real area = row_area.width * row_area.height;
+  tmv_real total_weight = tmv_sum(&model->weights[start], row_count);
+  tmv_real scale = (total_weight > 0) ? (area / total_weight) : 0;
 
-  int horizontal = (render_area.width >= render_area.height);
-  double side = horizontal ? render_area.height : render_area.width;
+  int horizontal = (row_area.width >= row_area.height);
+  tmv_real offset = 0;
 
-  while (start < items_count)
-  {
-    unsigned long end = start;
-    double row_weight = 0.0;
-    double worst = 1e9;
-    unsigned long i;
+  /* The sizes along the row are computed in one (SIMD) pass, the offsets are a prefix sum of them */
+  tmv_real side = horizontal ? row_area.height : row_area.width;
+  tmv_real along = horizontal ? row_area.x : row_area.y;
+  tmv_real across = horizontal ? row_area.y : row_area.x;
+  tmv_real *sizes = horizontal ? &model->w[start] : &model->h[start];
+  tmv_real *sides = horizontal ? &model->h[start] : &model->w[start];
+  tmv_real *alongs = horizontal ? &model->x[start] : &model->y[start];
+  tmv_real *acrosses = horizontal ? &model->y[start] : &model->x[start];
 
-    double row_length;
-    unsigned long row_count;
+  TMV_PROFILE_COUNT(model->profile, rows, 1);
 
-    /* Try to add items[start..end] */
-    while (end < items_count)
-    {
-      double max_w = -1e9;
-      double min_w = 1e9;
-      double w_scaled;
+  tmv_row_sizes(&model->weights[start], row_count, scale, side, sizes);
 
-      double row_area;
-      double r1;
-      double r2;
-      double new_worst;
+  for (i = 0; i < row_count; ++i)
+  {
+    alongs[i] = along + offset;
+    acrosses[i] = across;
+    sides[i] = side;
+    offset += sizes[i];
+  }
 
-      row_weight += items[end].weight;
+  /* Collect statistics, a collapsed subtree counts as one leaf */
+  for (i = start; i < start + row_count; ++i)
+  {
+    if (model->children_counts[i] == 0 || tmv_collapsed(model->min_side, model->w[i], model->h[i]))
+    {
+      tmv_stats_add(&model->stats, model->weights[i]);
+    }
+  }
+}
 
-      /* Compute scaled weights and track min/max */
-      for (i = start; i <= end; ++i)
-      {
-        w_scaled = items[i].weight * scale;
-        if (w_scaled > max_w)
-        {
-          max_w = w_scaled;
-        }
-        if (w_scaled < min_w)
-        {
-          min_w = w_scaled;
-        }
-      }
+/* Lays out the items start..start+count (one children group) in render_area */
+TMV_API TMV_INLINE void tmv_squarify_current_soa(
+    tmv_model_soa *model,
+    unsigned long start,
+    unsigned long count,
+    tmv_rect render_area)
+{
+  tmv_real *weights = &model->weights[start];
 
-      /* Calculate the new worst aspect ratio s*/
-      row_area = row_weight * scale;
-      r1 = (side * side * max_w) / (row_area * row_area);
-      r2 = (row_area * row_area) / (side * side * min_w);
-      new_worst = (r1 > r2) ? r1 : r2;
+  unsigned long row_start = 0;
+  tmv_real total_weight = tmv_total_weight_strided(weights, sizeof(tmv_real), count);
+  tmv_real area = render_area.width * render_area.height;
+  tmv_real scale = (total_weight > 0) ? (area / total_weight) : 0;
 
-      /* Stop if aspect ratio would worsen */
-      if (new_worst > worst)
-      {
-        row_weight -= items[end].weight;
-        break;
-      }
+  int horizontal = (render_area.width >= render_area.height);
+  tmv_real side = horizontal ? render_area.height : render_area.width;
 
-      worst = new_worst;
-      ++end;
-    }
+  while (row_start < count)
+  {
+    tmv_real row_weight;
+    unsigned long row_end = tmv_squarify_row_end(weights, sizeof(tmv_real), row_start, count, scale, side, &row_weight, model->profile);
 
     /* Compute row size in layout direction */
-    row_length = (row_weight / total_weight) * (area / side);
-    row_count = end - start;
-
-    if (horizontal)
-    {
-      tmv_rect row_area = render_area;
-      row_area.width = row_length;
-
-      tmv_layout_row(model, row_area, &items[start], row_count);
-      render_area.x += row_length;
-      render_area.width -= row_length;
-    }
-    else
-    {
-      tmv_rect row_area = render_area;
-      row_area.height = row_length;
+    tmv_real row_length = (row_weight / total_weight) * (area / side);
+    tmv_rect row_area = tmv_squarify_cut(&render_area, horizontal, row_length);
 
-      tmv_layout_row(model, row_area, &items[start], row_count);
-      render_area.y += row_length;
-      render_area.height -= row_length;
-    }
+    tmv_layout_row_soa(model, row_area, start + row_start, row_end - row_start);
 
-    start = end;
+    row_start = row_end;
   }
 }
 
-TMV_API TMV_INLINE void tmv_squarify(
-    tmv_model *model,
+/* Same layout as tmv_squarify in aligned mode bit for bit, both add up the weights in the same order (see TMV_LANE_SUMS).
+   The items have to be in the order of tmv_items_depth_sort_offset. */
+TMV_API TMV_INLINE void tmv_squarify_soa(
+    tmv_model_soa *model,
     tmv_rect area /* The area on which the squarified treemap should be aligned */
 )
 {
-  unsigned long i = 0;
-  unsigned long root_start = 0;
   unsigned long root_count = 0;
+  unsigned long i;
 
-  if (model->items_count == 0)
-  {
-    return;
-  }
+  tmv_stats_reset(&model->stats);
+  model->collapsed_count = 0;
 
-  if (!model->items_sorted)
+  for (i = 0; i < model->items_count; ++i)
   {
-    model->stats.weigth_min = -1.0;
-    model->stats.weigth_max = -1.0;
-    model->stats.weigth_sum = 0.0;
-    model->stats.count = 0;
-    model->rects_count = 0;
-
-    tmv_items_depth_sort_offset(model->items, model->items_count);
-
-    model->items_sorted = 1;
+    model->x[i] = 0;
+    model->y[i] = 0;
+    model->w[i] = -1;
+    model->h[i] = 0;
   }
 
-  /* Count number of root items */
-  while ((root_start + root_count) < model->items_count &&
-         model->items[root_start + root_count].parent_id < TMV_FIRST_VALID_PARENT_ID)
+  while (root_count < model->items_count && model->parent_ids[root_count] < TMV_FIRST_VALID_PARENT_ID)
   {
     ++root_count;
   }
 
-  /* Layout only root-level items at first */
+  TMV_PROFILE_BEGIN(model->profile, TMV_PROFILE_LAYOUT);
+
   if (root_count > 0)
   {
-    tmv_model root_model = *model;
-    root_model.items = &model->items[root_start];
-    root_model.items_count = root_count;
-
-    tmv_squarify_current(&root_model, area);
-
-    model->rects_count = root_model.rects_count;
-    model->stats = root_model.stats;
+    tmv_squarify_current_soa(model, 0, root_count, area);
   }
 
-  /* Layout children for each node (already depth-sorted) */
+  /* Children of items that have not been laid out or are collapsed are skipped */
   for (i = 0; i < model->items_count; ++i)
   {
-    tmv_item *item = &model->items[i];
-
-    if (item->children_count > 0)
+    if (model->children_counts[i] > 0 && model->w[i] >= 0)
     {
-      tmv_model child_model;
+      tmv_rect parent_rect;
 
-      /* Find parent rect */
-      tmv_rect *parent_rect = tmv_find_rect_by_id(model->rects, model->rects_count, item->id);
-
-      if (!parent_rect)
+      if (tmv_collapsed(model->min_side, model->w[i], model->h[i]))
       {
+        model->collapsed_count++;
         continue;
       }
 
-      /* Setup child model view */
-      child_model = *model;
-      child_model.items = &model->items[item->children_offset_index];
-      child_model.items_count = item->children_count;
-
-      /* Layout children directly in shared rect buffer */
-      tmv_squarify_current(&child_model, *parent_rect);
+      parent_rect.id = model->ids[i];
+      parent_rect.x = model->x[i];
+      parent_rect.y = model->y[i];
+      parent_rect.width = model->w[i];
+      parent_rect.height = model->h[i];
 
-      /* Update parent model state */
-      model->rects_count = child_model.rects_count;
-      model->stats = child_model.stats;
+      tmv_squarify_current_soa(model, model->children_offsets[i], model->children_counts[i], parent_rect);
     }
   }
+
+  TMV_PROFILE_END(model->profile, TMV_PROFILE_LAYOUT);
 }
 
 /* ########################################################## */
 /* # Binary En-/Decoding of tmv data                          */
 /* ########################################################## */
 #define TMV_BINARY_SIZE_MAGIC 4
-#define TMV_BINARY_VERSION 1
+#define TMV_BINARY_VERSION 3
+#define TMV_BINARY_FLAG_RECTS_ALIGNED 0x01
 #define TMV_BINARY_SIZE_VERSION 4
 #define TMV_BINARY_SIZE_COUNTS 28
 #define TMV_BINARY_SIZE_HEADER (TMV_BINARY_SIZE_MAGIC + TMV_BINARY_SIZE_VERSION + TMV_BINARY_SIZE_COUNTS)
@@ -522,10 +3856,10 @@ TMV_API TMV_INLINE void tmv_binary_encode(
   ptr[2] = 'V';
   ptr[3] = '\0';
 
-  /* 1 byte version + 3 byte padding */
+  /* 1 byte version + 1 byte flags + 1 byte sizeof(tmv_real) + 1 byte padding */
   ptr[4] = TMV_BINARY_VERSION;
-  ptr[5] = 0;
-  ptr[6] = 0;
+  ptr[5] = model->rects_aligned ? TMV_BINARY_FLAG_RECTS_ALIGNED : 0;
+  ptr[6] = (unsigned char)sizeof(tmv_real);
   ptr[7] = 0;
 
   ptr += TMV_BINARY_SIZE_MAGIC + TMV_BINARY_SIZE_VERSION;
@@ -597,18 +3931,26 @@ TMV_API TMV_INLINE void tmv_binary_decode(
     /* no right magic */
     return;
   }
-  if (in_binary[4] != TMV_BINARY_VERSION)
+  if (in_binary[4] != TMV_BINARY_VERSION && in_binary[4] != 2 && in_binary[4] != 1)
   {
     /* no right version */
     return;
   }
 
-  if (in_binary[5] != 0 || in_binary[6] != 0 || in_binary[7] != 0)
+  if ((in_binary[4] == 1 && in_binary[5] != 0) || (in_binary[4] < 3 && in_binary[6] != 0) || in_binary[7] != 0)
+  {
+    /* no right padding (version 1 has no flags, versions before 3 no real size) */
+    return;
+  }
+
+  if (((in_binary[4] < 3) ? sizeof(double) : in_binary[6]) != sizeof(tmv_real))
   {
-    /* no right padding */
+    /* written with another TMV_REAL (versions before 3 always used double) */
     return;
   }
 
+  model->rects_aligned = (in_binary[5] & TMV_BINARY_FLAG_RECTS_ALIGNED) ? 1 : 0;
+
   binary_ptr = in_binary + (TMV_BINARY_SIZE_MAGIC + TMV_BINARY_SIZE_VERSION);
 
   /* area size */
@@ -627,6 +3969,13 @@ TMV_API TMV_INLINE void tmv_binary_decode(
   size_struct_rect = tmv_binary_read_ul(binary_ptr);
   binary_ptr += 4;
 
+  if (size_struct_area != sizeof(tmv_rect) || size_struct_stats != sizeof(tmv_stats) ||
+      size_struct_item != sizeof(tmv_item) || size_struct_rect != sizeof(tmv_rect))
+  {
+    /* struct layout differs from this build */
+    return;
+  }
+
   model->items_count = tmv_binary_read_ul(binary_ptr);
   binary_ptr += 4;
 
@@ -0,0 +1,1047 @@
+/* tmv_parallel.h - v0.1 - public domain data structures - nickscha 2025
+
+A C89 standard compliant, single header, multi-threaded layout for tmv.h using POSIX threads.
+
+Unlike tmv.h this header depends on the C Standard Library (malloc) and pthreads.
+
+Only the root level is laid out serially. The emission order rects are reserved level by level
+with a prefix sum over the children counts of fixed size blocks that all threads take part in.
+Each block sums its own leaf statistics, merged in block order, so weigth_sum is the same for
+any threads count but may differ from tmv_squarify in the last bits.
+
+USAGE
+    tmv_model model = {0};
+    model.items = items;
+    model.items_count = items_count;
+    model.rects = rects;
+
+    // Lays out the subtrees on 8 threads, the rects match tmv_squarify bit for bit
+    if (!tmv_squarify_parallel(&model, area, 8))
+    {
+        // Out of memory
+    }
+
+    // Many small models at once, each one is laid out serially by one of 8 threads
+    if (!tmv_squarify_batch(models, areas, models_count, 8, seconds))
+    {
+        // Out of memory or a model did not fit into its rects_capacity
+    }
+
+LICENSE
+
+  Placed in the public domain and also MIT licensed.
+  See end of file for detailed license information.
+
+*/
+#ifndef TMV_PARALLEL_H
+#define TMV_PARALLEL_H
+
+#include "tmv.h"
+#include "tmv_platform_io.h" /* tmv_platform_time_us */
+
+#include <pthread.h>  /* pthread_create, pthread_join, pthread_mutex_*, pthread_cond_* */
+#include <stdlib.h>   /* malloc, realloc, free */
+#include <string.h>   /* memcpy, memmove, memset */
+
+/* #############################################################################
+ * # COMPILER SETTINGS
+ * #############################################################################
+ */
+/* Check if using C99 or later (inline is supported) */
+#if __STDC_VERSION__ >= 199901L
+#define TMV_PARALLEL_INLINE inline
+#elif defined(__GNUC__) || defined(__clang__)
+#define TMV_PARALLEL_INLINE __inline__
+#elif defined(_MSC_VER)
+#define TMV_PARALLEL_INLINE __inline
+#else
+#define TMV_PARALLEL_INLINE
+#endif
+#define TMV_PARALLEL_API static
+
+/* Ranges above this many parents are split in halves so idle threads can steal one */
+#define TMV_PARALLEL_GRAIN 64
+/* A busy worker shares half of its ranges every that many ranges if its deque ran dry */
+#define TMV_PARALLEL_SHARE_INTERVAL 32
+/* The ranges a stack holds in the arena memory of the pool, a stack that outgrows it moves to the heap */
+#define TMV_PARALLEL_STACK_CAPACITY 1024
+#define TMV_PARALLEL_SLOT_NONE ((unsigned long)-1)
+/* The number of models a batch worker takes at once */
+#define TMV_PARALLEL_BATCH_GRAIN 8
+/* Below this many items the heap sort beats the radix sort, a batch gives those models no scratch */
+#define TMV_PARALLEL_BATCH_SCRATCH_MIN_ITEMS 1024
+/* The items of a level a thread reserves the children rects for at once */
+#define TMV_PARALLEL_RESERVE_BLOCK 1024
+
+/* The jobs of the reservation, each one runs over the blocks of an items range */
+#define TMV_PARALLEL_RESERVE_INIT 0   /* Marks the roots as laid out and every other item as not reached */
+#define TMV_PARALLEL_RESERVE_COUNT 1  /* Counts the children and sums the leaves of the reached items */
+#define TMV_PARALLEL_RESERVE_ASSIGN 2 /* Hands out the rects of the children from the prefix sum */
+
+/* A range of items whose children groups still have to be laid out */
+typedef struct tmv_parallel_task
+{
+    unsigned long start;
+    unsigned long count;
+
+} tmv_parallel_task;
+
+typedef struct tmv_parallel_stack
+{
+    tmv_parallel_task *tasks;
+    unsigned long capacity;
+    unsigned long count;
+    int heap; /* The tasks outgrew the arena memory and have been moved to the heap */
+
+} tmv_parallel_stack;
+
+/* The shared part of a worker's ranges, the owner pops at the end, thieves take the oldest
+   (largest) ranges at the head */
+typedef struct tmv_parallel_deque
+{
+    pthread_mutex_t lock;
+    tmv_parallel_stack shared;
+    unsigned long head;
+
+} tmv_parallel_deque;
+
+/* A block of a level, the statistics only sum its own leaves */
+typedef struct tmv_parallel_block
+{
+    unsigned long count;  /* The children of the reached parents */
+    unsigned long offset; /* The rect of the first of them, the sum of the counts of the blocks before */
+    unsigned long first;  /* The range of the children, the next level is the union of these ranges */
+    unsigned long last;
+    tmv_stats stats;
+
+} tmv_parallel_block;
+
+typedef struct tmv_parallel_pool
+{
+    tmv_model *model;
+    unsigned long *slots; /* Rect position of each item, only read by the workers if the rects are not aligned */
+    tmv_parallel_block *blocks;
+    unsigned long root_count;
+
+    tmv_parallel_deque *deques;
+    unsigned long deques_count;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;   /* Signaled when ranges are shared, the work is done or failed */
+    unsigned long shares;  /* Counts the tmv_parallel_share calls, an idle worker only sleeps if it did not change */
+    unsigned long pending; /* Shared ranges whose subtrees are not done yet */
+    int failed;
+
+    /* The job the calling thread posted, the others take its blocks until preparing is cleared */
+    int preparing;
+    unsigned long job;
+    unsigned long job_start;
+    unsigned long job_end;
+    unsigned long job_blocks;
+    unsigned long job_next; /* The first block no thread has taken yet */
+    unsigned long job_done;
+
+} tmv_parallel_pool;
+
+typedef struct tmv_parallel_worker
+{
+    tmv_parallel_pool *pool;
+    unsigned long index;
+    tmv_parallel_stack local; /* Ranges only this worker sees, no locking needed */
+
+} tmv_parallel_worker;
+
+/* The bytes of the arena of tmv_squarify_parallel for the slots, the blocks and the work queues */
+TMV_PARALLEL_API TMV_PARALLEL_INLINE unsigned long tmv_parallel_memory_size(unsigned long items_count, unsigned long threads_count)
+{
+    return tmv_arena_align(items_count * sizeof(unsigned long)) +
+           tmv_arena_align((items_count / TMV_PARALLEL_RESERVE_BLOCK + 1) * sizeof(tmv_parallel_block)) +
+           tmv_arena_align(threads_count * sizeof(tmv_parallel_deque)) +
+           tmv_arena_align(threads_count * sizeof(tmv_parallel_worker)) +
+           tmv_arena_align(threads_count * sizeof(pthread_t)) +
+           2 * threads_count * tmv_arena_align(TMV_PARALLEL_STACK_CAPACITY * sizeof(tmv_parallel_task));
+}
+
+TMV_PARALLEL_API TMV_PARALLEL_INLINE void tmv_parallel_stack_init(tmv_parallel_stack *stack, tmv_arena *arena)
+{
+    stack->tasks = (tmv_parallel_task *)tmv_arena_alloc(arena, TMV_PARALLEL_STACK_CAPACITY * sizeof(tmv_parallel_task));
+    stack->capacity = TMV_PARALLEL_STACK_CAPACITY;
+    stack->count = 0;
+    stack->heap = 0;
+}
+
+TMV_PARALLEL_API TMV_PARALLEL_INLINE int tmv_parallel_stack_reserve(tmv_parallel_stack *stack, unsigned long count)
+{
+    unsigned long capacity = stack->capacity;
+    tmv_parallel_task *tasks;
+
+    if (count <= stack->capacity)
+    {
+        return 1;
+    }
+
+    while (capacity < count)
+    {
+        capacity *= 2;
+    }
+
+    if (stack->heap)
+    {
+        tasks = (tmv_parallel_task *)realloc(stack->tasks, capacity * sizeof(tmv_parallel_task));
+    }
+    else
+    {
+        tasks = (tmv_parallel_task *)malloc(capacity * sizeof(tmv_parallel_task));
+
+        if (tasks)
+        {
+            memcpy(tasks, stack->tasks, stack->count * sizeof(tmv_parallel_task));
+        }
+    }
+
+    if (!tasks)
+    {
+        return 0;
+    }
+
+    stack->tasks = tasks;
+    stack->capacity = capacity;
+    stack->heap = 1;
+
+    return 1;
+}
+
+TMV_PARALLEL_API TMV_PARALLEL_INLINE int tmv_parallel_stack_push(tmv_parallel_stack *stack, unsigned long start, unsigned long count)
+{
+    if (!tmv_parallel_stack_reserve(stack, stack->count + 1))
+    {
+        return 0;
+    }
+
+    stack->tasks[stack->count].start = start;
+    stack->tasks[stack->count].count = count;
+    stack->count++;
+
+    return 1;
+}
+
+/* Pops the newest shared range of the worker or steals the oldest one of another worker */
+TMV_PARALLEL_API TMV_PARALLEL_INLINE int tmv_parallel_take(tmv_parallel_pool *pool, unsigned long worker, tmv_parallel_task *task)
+{
+    unsigned long i;
+
+    for (i = 0; i < pool->deques_count; ++i)
+    {
+        tmv_parallel_deque *deque = &pool->deques[(worker + i) % pool->deques_count];
+        int result = 0;
+
+        pthread_mutex_lock(&deque->lock);
+
+        if (deque->shared.count > deque->head)
+        {
+            *task = (i == 0) ? deque->shared.tasks[--deque->shared.count] : deque->shared.tasks[deque->head++];
+            result = 1;
+        }
+
+        if (deque->shared.count == deque->head)
+        {
+            deque->shared.count = 0;
+            deque->head = 0;
+        }
+
+        pthread_mutex_unlock(&deque->lock);
+
+        if (result)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Moves the older half of the local ranges into the deque of the worker once it ran dry.
+   Pending is raised before the ranges become visible, so it only drops to zero once every
+   shared range is done. */
+TMV_PARALLEL_API TMV_PARALLEL_INLINE void tmv_parallel_share(tmv_parallel_pool *pool, tmv_parallel_worker *worker)
+{
+    tmv_parallel_deque *deque = &pool->deques[worker->index];
+    unsigned long count = worker->local.count / 2;
+
+    pthread_mutex_lock(&deque->lock);
+
+    if (deque->shared.count == 0 && tmv_parallel_stack_reserve(&deque->shared, count))
+    {
+        pthread_mutex_lock(&pool->lock);
+        pool->pending += count;
+        pthread_mutex_unlock(&pool->lock);
+
+        memcpy(deque->shared.tasks, worker->local.tasks, count * sizeof(tmv_parallel_task));
+        deque->shared.count = count;
+
+        worker->local.count -= count;
+        memmove(worker->local.tasks, &worker->local.tasks[count], worker->local.count * sizeof(tmv_parallel_task));
+    }
+
+    pthread_mutex_unlock(&deque->lock);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shares++;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* Lays out the children groups of all parents in the range and pushes the children ranges */
+TMV_PARALLEL_API TMV_PARALLEL_INLINE int tmv_parallel_run(tmv_parallel_pool *pool, tmv_parallel_worker *worker, tmv_parallel_task task)
+{
+    tmv_model *model = pool->model;
+    unsigned long i;
+    int ok = 1;
+
+    while (task.count > TMV_PARALLEL_GRAIN)
+    {
+        ok &= tmv_parallel_stack_push(&worker->local, task.start + task.count / 2, task.count - task.count / 2);
+        task.count /= 2;
+    }
+
+    for (i = task.start; i < task.start + task.count; ++i)
+    {
+        tmv_item *item = &model->items[i];
+        tmv_rect parent_rect;
+        tmv_model child_model;
+
+        if (item->children_count == 0)
+        {
+            continue;
+        }
+
+        /* The group writes its own reserved rects, the index is already updated */
+        child_model = *model;
+        child_model.items = &model->items[item->children_offset_index];
+        child_model.items_count = item->children_count;
+        child_model.rects_count = 0;
+        child_model.rects_aligned = 0;
+        child_model.index = 0;
+        child_model.profile = 0; /* Not thread-safe, the workers leave it alone */
+
+        if (model->rects_aligned)
+        {
+            parent_rect = model->rects[i];
+            child_model.rects = &model->rects[item->children_offset_index];
+        }
+        else
+        {
+            parent_rect = model->rects[pool->slots[i]];
+            child_model.rects = &model->rects[pool->slots[item->children_offset_index]];
+        }
+
+        /* The parent rect of a collapsed subtree is shown on its own, its children are never pushed */
+        if (tmv_collapsed(model->min_side, parent_rect.width, parent_rect.height))
+        {
+            continue;
+        }
+
+        tmv_squarify_current(&child_model, parent_rect);
+
+        ok &= tmv_parallel_stack_push(&worker->local, item->children_offset_index, item->children_count);
+    }
+
+    return ok;
+}
+
+TMV_PARALLEL_API TMV_PARALLEL_INLINE void *tmv_parallel_worker_main(void *argument)
+{
+    tmv_parallel_worker *worker = (tmv_parallel_worker *)argument;
+    tmv_parallel_pool *pool = worker->pool;
+
+    for (;;)
+    {
+        tmv_parallel_task task;
+        unsigned long runs = 0;
+        unsigned long shares;
+        int ok = 1;
+        int done;
+
+        pthread_mutex_lock(&pool->lock);
+        shares = pool->shares;
+        pthread_mutex_unlock(&pool->lock);
+
+        if (!tmv_parallel_take(pool, worker->index, &task))
+        {
+            /* Sleep until a busy worker shares ranges, ranges shared since the take show up in shares */
+            pthread_mutex_lock(&pool->lock);
+            done = (pool->pending == 0 || pool->failed);
+            if (!done && pool->shares == shares)
+            {
+                pthread_cond_wait(&pool->wake, &pool->lock);
+            }
+            pthread_mutex_unlock(&pool->lock);
+
+            if (done)
+            {
+                break;
+            }
+
+            continue;
+        }
+
+        /* Every range is only reachable through a laid out parent, the subtree is done
+           depth first and shares work while it goes */
+        ok &= tmv_parallel_stack_push(&worker->local, task.start, task.count);
+
+        while (ok && worker->local.count > 0)
+        {
+            task = worker->local.tasks[--worker->local.count];
+            ok &= tmv_parallel_run(pool, worker, task);
+
+            if (++runs % TMV_PARALLEL_SHARE_INTERVAL == 0 && worker->local.count > 1)
+            {
+                tmv_parallel_share(pool, worker);
+            }
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        pool->pending -= 1;
+        pool->failed |= !ok;
+        if (pool->pending == 0 || pool->failed)
+        {
+            pthread_cond_broadcast(&pool->wake);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    return 0;
+}
+
+/* Adds the statistics of a block. Min, max and count do not depend on the order, the sum does,
+   so the blocks are always merged in the order of the items. */
+TMV_PARALLEL_API TMV_PARALLEL_INLINE void tmv_parallel_stats_merge(tmv_stats *stats, tmv_stats *block)
+{
+    if (block->count == 0)
+    {
+        return;
+    }
+
+    if (stats->weigth_min < 0 || block->weigth_min < stats->weigth_min)
+    {
+        stats->weigth_min = block->weigth_min;
+    }
+
+    if (stats->weigth_max < 0 || block->weigth_max > stats->weigth_max)
+    {
+        stats->weigth_max = block->weigth_max;
+    }
+
+    stats->weigth_sum += block->weigth_sum;
+    stats->count += block->count;
+}
+
+/* Runs a job on the items of block b of [start, end). An item has been reached if its parent
+   has a rect, only the reached parents get rects for their children. */
+TMV_PARALLEL_API TMV_PARALLEL_INLINE void tmv_parallel_reserve_block(tmv_parallel_pool *pool, unsigned long job, unsigned long start, unsigned long end, unsigned long b)
+{
+    tmv_model *model = pool->model;
+    tmv_parallel_block *block = &pool->blocks[b];
+    unsigned long *slots = pool->slots;
+    unsigned long begin = start + b * TMV_PARALLEL_RESERVE_BLOCK;
+    unsigned long stop = (end - begin > TMV_PARALLEL_RESERVE_BLOCK) ? begin + TMV_PARALLEL_RESERVE_BLOCK : end;
+    int update_index = !model->rects_aligned && model->index && model->index->entries;
+    unsigned long cursor = block->offset;
+    unsigned long i;
+    unsigned long j;
+
+    if (job == TMV_PARALLEL_RESERVE_INIT)
+    {
+        for (i = begin; i < stop; ++i)
+        {
+            slots[i] = (i < pool->root_count) ? i : TMV_PARALLEL_SLOT_NONE;
+        }
+
+        return;
+    }
+
+    if (job == TMV_PARALLEL_RESERVE_COUNT)
+    {
+        block->count = 0;
+        block->first = model->items_count;
+        block->last = 0;
+        tmv_stats_reset(&block->stats);
+    }
+
+    for (i = begin; i < stop; ++i)
+    {
+        tmv_item *item = &model->items[i];
+
+        if (slots[i] == TMV_PARALLEL_SLOT_NONE)
+        {
+            continue;
+        }
+
+        if (job == TMV_PARALLEL_RESERVE_COUNT)
+        {
+            if (item->children_count == 0)
+            {
+                tmv_stats_add(&block->stats, item->weight);
+                continue;
+            }
+
+            block->count += item->children_count;
+
+            if (item->children_offset_index < block->first)
+            {
+                block->first = item->children_offset_index;
+            }
+
+            if (item->children_offset_index + item->children_count > block->last)
+            {
+                block->last = item->children_offset_index + item->children_count;
+            }
+
+            continue;
+        }
+
+        for (j = 0; j < item->children_count; ++j)
+        {
+            unsigned long child = item->children_offset_index + j;
+
+            slots[child] = model->rects_aligned ? child : cursor;
+
+            if (update_index)
+            {
+                tmv_index_entry *entry = tmv_index_find(model->index, model->items[child].id);
+
+                if (entry && entry->rect == TMV_INDEX_NONE)
+                {
+                    entry->rect = cursor;
+                }
+            }
+
+            ++cursor;
+        }
+    }
+}
+
+/* Takes blocks of the posted job until none is left, called and returns with the pool lock held */
+TMV_PARALLEL_API TMV_PARALLEL_INLINE void tmv_parallel_reserve_help(tmv_parallel_pool *pool)
+{
+    while (pool->job_next < pool->job_blocks)
+    {
+        unsigned long job = pool->job;
+        unsigned long start = pool->job_start;
+        unsigned long end = pool->job_end;
+        unsigned long b = pool->job_next++;
+
+        pthread_mutex_unlock(&pool->lock);
+        tmv_parallel_reserve_block(pool, job, start, end, b);
+        pthread_mutex_lock(&pool->lock);
+
+        if (++pool->job_done == pool->job_blocks)
+        {
+            pthread_cond_broadcast(&pool->wake);
+        }
+    }
+}
+
+/* Runs a job on [start, end) with every thread and returns once all its blocks are done */
+TMV_PARALLEL_API TMV_PARALLEL_INLINE void tmv_parallel_reserve_job(tmv_parallel_pool *pool, unsigned long job, unsigned long start, unsigned long end)
+{
+    unsigned long blocks_count = (end - start + TMV_PARALLEL_RESERVE_BLOCK - 1) / TMV_PARALLEL_RESERVE_BLOCK;
+
+    /* A single block is not worth waking the others, deep and narrow levels take no lock */
+    if (blocks_count == 1)
+    {
+        tmv_parallel_reserve_block(pool, job, start, end, 0);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+
+    pool->job = job;
+    pool->job_start = start;
+    pool->job_end = end;
+    pool->job_blocks = blocks_count;
+    pool->job_next = 0;
+    pool->job_done = 0;
+    pthread_cond_broadcast(&pool->wake);
+
+    tmv_parallel_reserve_help(pool);
+
+    while (pool->job_done < pool->job_blocks)
+    {
+        pthread_cond_wait(&pool->wake, &pool->lock);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* Reserves the rects in emission order of tmv_squarify. The depth-sorted items hold each level
+   as one range, the children groups of a level tile the next one. The rects of a level are handed
+   out by a prefix sum over the children counts of its blocks, the parents of a block in item order.
+   Requires unique item ids, like the rect lookup of the serial layout. Returns the rects count. */
+TMV_PARALLEL_API TMV_PARALLEL_INLINE unsigned long tmv_parallel_reserve(tmv_parallel_pool *pool, unsigned long root_count, tmv_stats *stats)
+{
+    unsigned long start = 0;
+    unsigned long end = root_count;
+    unsigned long cursor = root_count;
+    unsigned long i;
+
+    tmv_stats_reset(stats);
+
+    pool->root_count = root_count;
+
+    tmv_parallel_reserve_job(pool, TMV_PARALLEL_RESERVE_INIT, 0, pool->model->items_count);
+
+    while (start < end)
+    {
+        unsigned long blocks_count = (end - start + TMV_PARALLEL_RESERVE_BLOCK - 1) / TMV_PARALLEL_RESERVE_BLOCK;
+        unsigned long first = pool->model->items_count;
+        unsigned long last = 0;
+
+        tmv_parallel_reserve_job(pool, TMV_PARALLEL_RESERVE_COUNT, start, end);
+
+        for (i = 0; i < blocks_count; ++i)
+        {
+            tmv_parallel_block *block = &pool->blocks[i];
+
+            block->offset = cursor;
+            cursor += block->count;
+
+            tmv_parallel_stats_merge(stats, &block->stats);
+
+            first = (block->first < first) ? block->first : first;
+            last = (block->last > last) ? block->last : last;
+        }
+
+        if (first < last)
+        {
+            tmv_parallel_reserve_job(pool, TMV_PARALLEL_RESERVE_ASSIGN, start, end);
+        }
+
+        start = first;
+        end = last;
+    }
+
+    return cursor;
+}
+
+/* The entry of the other threads, they help with the reservation before they lay out */
+TMV_PARALLEL_API TMV_PARALLEL_INLINE void *tmv_parallel_thread_main(void *argument)
+{
+    tmv_parallel_worker *worker = (tmv_parallel_worker *)argument;
+    tmv_parallel_pool *pool = worker->pool;
+
+    pthread_mutex_lock(&pool->lock);
+
+    while (pool->preparing)
+    {
+        tmv_parallel_reserve_help(pool);
+
+        if (pool->preparing && pool->job_next == pool->job_blocks)
+        {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+    return tmv_parallel_worker_main(argument);
+}
+
+/* Lays out the model like tmv_squarify with the subtrees spread over threads_count threads
+   (including the calling thread). Returns 0 if the pool could not be allocated or the rects
+   did not fit into rects_capacity.
+
+   Emission order rects with a min_side or a rects_capacity below the items count are laid out
+   serially, which subtrees collapse or get dropped (and so where the rects go) is only known
+   during the layout. */
+TMV_PARALLEL_API TMV_PARALLEL_INLINE int tmv_squarify_parallel(
+    tmv_model *model,
+    tmv_rect area, /* The area on which the squarified treemap should be aligned */
+    unsigned long threads_count)
+{
+    tmv_parallel_pool pool;
+    tmv_parallel_worker *workers;
+    pthread_t *threads;
+    tmv_arena arena;
+    void *memory;
+    tmv_stats stats;
+    unsigned long threads_started = 0;
+    unsigned long root_count;
+    unsigned long rects_count = 0;
+    unsigned long i;
+    int reserve = !model->rects_aligned || model->min_side <= 0;
+
+    if (model->items_count == 0)
+    {
+        return 1;
+    }
+
+    if (model->rects_capacity && model->rects_capacity < model->items_count)
+    {
+        return tmv_squarify(model, area);
+    }
+
+    if (!model->rects_aligned && model->min_side > 0)
+    {
+        tmv_squarify(model, area);
+        return 1;
+    }
+
+    if (threads_count == 0)
+    {
+        threads_count = 1;
+    }
+
+    pool.model = model;
+    pool.deques_count = threads_count;
+    pool.shares = 0;
+    pool.pending = 0;
+    pool.failed = 0;
+    pool.preparing = 1;
+    pool.job_blocks = 0;
+    pool.job_next = 0;
+
+    /* The slots, the blocks and the work queues are one allocation */
+    memory = malloc(tmv_parallel_memory_size(model->items_count, threads_count));
+
+    if (!memory)
+    {
+        return 0;
+    }
+
+    tmv_arena_init(&arena, memory, tmv_parallel_memory_size(model->items_count, threads_count));
+
+    pool.slots = (unsigned long *)tmv_arena_alloc(&arena, model->items_count * sizeof(unsigned long));
+    pool.blocks = (tmv_parallel_block *)tmv_arena_alloc(&arena, (model->items_count / TMV_PARALLEL_RESERVE_BLOCK + 1) * sizeof(tmv_parallel_block));
+    pool.deques = (tmv_parallel_deque *)tmv_arena_alloc(&arena, threads_count * sizeof(tmv_parallel_deque));
+    workers = (tmv_parallel_worker *)tmv_arena_alloc(&arena, threads_count * sizeof(tmv_parallel_worker));
+    threads = (pthread_t *)tmv_arena_alloc(&arena, threads_count * sizeof(pthread_t));
+
+    for (i = 0; i < threads_count; ++i)
+    {
+        pthread_mutex_init(&pool.deques[i].lock, 0);
+        tmv_parallel_stack_init(&pool.deques[i].shared, &arena);
+        pool.deques[i].head = 0;
+
+        workers[i].pool = &pool;
+        workers[i].index = i;
+        tmv_parallel_stack_init(&workers[i].local, &arena);
+    }
+
+    pthread_mutex_init(&pool.lock, 0);
+    pthread_cond_init(&pool.wake, 0);
+
+    /* The root level is laid out serially, every subtree below only reads its parent rect */
+    tmv_squarify_prepare(model);
+
+    root_count = tmv_squarify_roots(model, area);
+
+    /* The others help with the reservation until the roots are pushed */
+    for (i = 1; i < threads_count && root_count > 0; ++i)
+    {
+        if (pthread_create(&threads[threads_started], 0, tmv_parallel_thread_main, &workers[i]) != 0)
+        {
+            break;
+        }
+        ++threads_started;
+    }
+
+    /* The workers need the reserved ranges, aligned rects are reserved at the item positions
+       and only need the statistics unless they depend on the collapsed subtrees */
+    if (reserve)
+    {
+        rects_count = tmv_parallel_reserve(&pool, root_count, &stats);
+    }
+
+    if (root_count > 0 && tmv_parallel_stack_push(&pool.deques[0].shared, 0, root_count))
+    {
+        pool.pending = 1;
+    }
+    else
+    {
+        pool.failed = (root_count > 0);
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    pool.preparing = 0;
+    pthread_cond_broadcast(&pool.wake);
+    pthread_mutex_unlock(&pool.lock);
+
+    tmv_parallel_worker_main(&workers[0]);
+
+    for (i = 0; i < threads_started; ++i)
+    {
+        pthread_join(threads[i], 0);
+    }
+
+    model->rects_count = model->rects_aligned ? model->items_count : rects_count;
+
+    if (reserve)
+    {
+        model->stats = stats;
+    }
+    else
+    {
+        tmv_squarify_stats(model, root_count);
+    }
+
+    if (model->dirty)
+    {
+        memset(model->dirty, 0, model->items_count);
+    }
+
+    for (i = 0; i < threads_count; ++i)
+    {
+        pthread_mutex_destroy(&pool.deques[i].lock);
+
+        if (pool.deques[i].shared.heap)
+        {
+            free(pool.deques[i].shared.tasks);
+        }
+
+        if (workers[i].local.heap)
+        {
+            free(workers[i].local.tasks);
+        }
+    }
+
+    pthread_mutex_destroy(&pool.lock);
+    pthread_cond_destroy(&pool.wake);
+
+    free(memory);
+
+    return !pool.failed;
+}
+
+typedef struct tmv_parallel_batch
+{
+    tmv_model *models;
+    tmv_rect *areas;
+    double *seconds;
+    unsigned long models_count;
+
+    pthread_mutex_t lock;
+    unsigned long next; /* The first model no worker has taken yet */
+    int failed;
+
+} tmv_parallel_batch;
+
+typedef struct tmv_parallel_batch_worker
+{
+    tmv_parallel_batch *batch;
+    void *scratch; /* Sort scratch for the models without their own */
+    unsigned long scratch_size;
+
+} tmv_parallel_batch_worker;
+
+TMV_PARALLEL_API TMV_PARALLEL_INLINE void *tmv_parallel_batch_main(void *argument)
+{
+    tmv_parallel_batch_worker *worker = (tmv_parallel_batch_worker *)argument;
+    tmv_parallel_batch *batch = worker->batch;
+
+    for (;;)
+    {
+        unsigned long start;
+        unsigned long end;
+        unsigned long i;
+        int ok = 1;
+
+        pthread_mutex_lock(&batch->lock);
+        start = batch->next;
+        end = (batch->models_count - start > TMV_PARALLEL_BATCH_GRAIN) ? start + TMV_PARALLEL_BATCH_GRAIN : batch->models_count;
+        batch->next = end;
+        pthread_mutex_unlock(&batch->lock);
+
+        if (start == end)
+        {
+            break;
+        }
+
+        for (i = start; i < end; ++i)
+        {
+            tmv_model *model = &batch->models[i];
+            int shared_scratch = (!model->scratch && model->items_count >= TMV_PARALLEL_BATCH_SCRATCH_MIN_ITEMS);
+            double begin = batch->seconds ? tmv_platform_time_us() : 0.0;
+
+            if (shared_scratch)
+            {
+                model->scratch = worker->scratch;
+                model->scratch_size = worker->scratch_size;
+            }
+
+            ok &= tmv_squarify(model, batch->areas[i]) != 0;
+
+            if (shared_scratch)
+            {
+                model->scratch = 0;
+                model->scratch_size = 0;
+            }
+
+            if (batch->seconds)
+            {
+                batch->seconds[i] = (tmv_platform_time_us() - begin) * 1e-6;
+            }
+        }
+
+        if (!ok)
+        {
+            pthread_mutex_lock(&batch->lock);
+            batch->failed = 1;
+            pthread_mutex_unlock(&batch->lock);
+        }
+    }
+
+    return 0;
+}
+
+/* Lays out many independent models with tmv_squarify, each one on a single thread. Small models
+   gain nothing from tmv_squarify_parallel, so the models themselves are spread over threads_count
+   threads (including the calling thread) in chunks of TMV_PARALLEL_BATCH_GRAIN.
+
+   Models of at least TMV_PARALLEL_BATCH_SCRATCH_MIN_ITEMS items without scratch memory share one
+   allocation, a scratch for the largest of them per thread, so they get the radix sort. If seconds
+   is not 0 it receives the layout time of every model. Returns 0 if the scratch could not be
+   allocated or a model did not fit into its rects_capacity, the other models are still laid out. */
+TMV_PARALLEL_API TMV_PARALLEL_INLINE int tmv_squarify_batch(
+    tmv_model *models,
+    tmv_rect *areas, /* The area of each model */
+    unsigned long models_count,
+    unsigned long threads_count,
+    double *seconds)
+{
+    tmv_parallel_batch batch;
+    tmv_parallel_batch_worker *workers;
+    pthread_t *threads;
+    tmv_arena arena;
+    void *memory;
+    unsigned long memory_size;
+    unsigned long scratch_size = 0;
+    unsigned long threads_started = 0;
+    unsigned long i;
+
+    if (models_count == 0)
+    {
+        return 1;
+    }
+
+    if (threads_count == 0)
+    {
+        threads_count = 1;
+    }
+
+    /* More threads than chunks would only wait for the lock */
+    if (threads_count > (models_count + TMV_PARALLEL_BATCH_GRAIN - 1) / TMV_PARALLEL_BATCH_GRAIN)
+    {
+        threads_count = (models_count + TMV_PARALLEL_BATCH_GRAIN - 1) / TMV_PARALLEL_BATCH_GRAIN;
+    }
+
+    for (i = 0; i < models_count; ++i)
+    {
+        unsigned long size = tmv_items_sort_scratch_size(models[i].items_count);
+
+        if (!models[i].scratch && models[i].items_count >= TMV_PARALLEL_BATCH_SCRATCH_MIN_ITEMS && size > scratch_size)
+        {
+            scratch_size = size;
+        }
+    }
+
+    scratch_size = tmv_arena_align(scratch_size);
+    memory_size = threads_count * scratch_size +
+                  tmv_arena_align(threads_count * sizeof(tmv_parallel_batch_worker)) +
+                  tmv_arena_align(threads_count * sizeof(pthread_t));
+
+    /* The scratch memory and the workers are one allocation */
+    memory = malloc(memory_size);
+
+    if (!memory)
+    {
+        return 0;
+    }
+
+    tmv_arena_init(&arena, memory, memory_size);
+
+    workers = (tmv_parallel_batch_worker *)tmv_arena_alloc(&arena, threads_count * sizeof(tmv_parallel_batch_worker));
+    threads = (pthread_t *)tmv_arena_alloc(&arena, threads_count * sizeof(pthread_t));
+
+    batch.models = models;
+    batch.areas = areas;
+    batch.seconds = seconds;
+    batch.models_count = models_count;
+    batch.next = 0;
+    batch.failed = 0;
+
+    pthread_mutex_init(&batch.lock, 0);
+
+    for (i = 0; i < threads_count; ++i)
+    {
+        workers[i].batch = &batch;
+        workers[i].scratch = scratch_size ? tmv_arena_alloc(&arena, scratch_size) : 0;
+        workers[i].scratch_size = scratch_size;
+    }
+
+    for (i = 1; i < threads_count; ++i)
+    {
+        if (pthread_create(&threads[threads_started], 0, tmv_parallel_batch_main, &workers[i]) != 0)
+        {
+            break;
+        }
+        ++threads_started;
+    }
+
+    tmv_parallel_batch_main(&workers[0]);
+
+    for (i = 0; i < threads_started; ++i)
+    {
+        pthread_join(threads[i], 0);
+    }
+
+    pthread_mutex_destroy(&batch.lock);
+
+    free(memory);
+
+    return !batch.failed;
+}
+
+#endif /* TMV_PARALLEL_H */
+
+/*
+   ------------------------------------------------------------------------------
+   This software is available under 2 licenses -- choose whichever you prefer.
+   ------------------------------------------------------------------------------
+   ALTERNATIVE A - MIT License
+   Copyright (c) 2025 nickscha
+   Permission is hereby granted, free of charge, to any person obtaining a copy of
+   this software and associated documentation files (the "Software"), to deal in
+   the Software without restriction, including without limitation the rights to
+   use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+   of the Software, and to permit persons to whom the Software is furnished to do
+   so, subject to the following conditions:
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   ------------------------------------------------------------------------------
+   ALTERNATIVE B - Public Domain (www.unlicense.org)
+   This is free and unencumbered software released into the public domain.
+   Anyone is free to copy, modify, publish, use, compile, sell, or distribute this
+   software, either in source code form or as a compiled binary, for any purpose,
+   commercial or non-commercial, and by any means.
+   In jurisdictions that recognize copyright laws, the author or authors of this
+   software dedicate any and all copyright interest in the software to the public
+   domain. We make this dedication for the benefit of the public at large and to
+   the detriment of our heirs and successors. We intend this dedication to be an
+   overt act of relinquishment in perpetuity of all present and future rights to
+   this software under copyright law.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+   WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+   ------------------------------------------------------------------------------
+*/
@@ -1,6 +1,6 @@
 /* tmv_platform_io.h - v0.1 - public domain data structures - nickscha 2025
 
-A C89 standard compliant, single header, nostdlib (no C Standard Library) utility to read/write a file using OS-specific APIs.
+A C89 standard compliant, single header, nostdlib (no C Standard Library) utility to read/write a file and measure time using OS-specific APIs.
 
 Supports:
  - Windows (Win32 API)
@@ -73,6 +73,14 @@ typedef struct TMV_PLATFORM_WIN32_FIND_DATAA
 
 } TMV_PLATFORM_WIN32_FIND_DATAA;
 
+/* Time */
+typedef struct TMV_PLATFORM_WIN32_LARGE_INTEGER
+{
+    unsigned long LowPart;
+    long HighPart;
+
+} TMV_PLATFORM_WIN32_LARGE_INTEGER;
+
 #ifndef _WINDOWS_
 #define TMV_PLATFORM_WIN32_API(r) __declspec(dllimport) r __stdcall
 
@@ -121,6 +129,13 @@ FindNextFileA(void *hFindFile, TMV_PLATFORM_WIN32_FIND_DATAA *lpFindFileData);
 TMV_PLATFORM_WIN32_API(int)
 FindClose(void *hFindFile);
 
+/* Time */
+TMV_PLATFORM_WIN32_API(int)
+QueryPerformanceCounter(void *lpPerformanceCount);
+
+TMV_PLATFORM_WIN32_API(int)
+QueryPerformanceFrequency(void *lpFrequency);
+
 #endif /* _WINDOWS_ */
 
 TMV_PLATFORM_API TMV_PLATFORM_INLINE int tmv_platform_write(char *filename, unsigned char *buffer, unsigned long size)
@@ -184,12 +199,33 @@ TMV_PLATFORM_API TMV_PLATFORM_INLINE int tmv_platform_read(char *filename, unsig
     return 1;
 }
 
+/* Microseconds since an arbitrary point in time, only the difference of two calls is meaningful */
+TMV_PLATFORM_API TMV_PLATFORM_INLINE double tmv_platform_time_us(void)
+{
+    TMV_PLATFORM_WIN32_LARGE_INTEGER counter;
+    TMV_PLATFORM_WIN32_LARGE_INTEGER frequency;
+    double ticks;
+    double ticks_per_second;
+
+    if (!QueryPerformanceCounter((void *)&counter) || !QueryPerformanceFrequency((void *)&frequency))
+    {
+        return 0.0;
+    }
+
+    ticks = (double)counter.HighPart * 4294967296.0 + (double)counter.LowPart;
+    ticks_per_second = (double)frequency.HighPart * 4294967296.0 + (double)frequency.LowPart;
+
+    return ticks_per_second > 0.0 ? ticks * 1000000.0 / ticks_per_second : 0.0;
+}
+
 #elif defined(__linux__) || defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__HAIKU__)
 
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/time.h> /* gettimeofday */
+#include <time.h>     /* clock_gettime */
 
 TMV_PLATFORM_API TMV_PLATFORM_INLINE int tmv_platform_write(char *filename, unsigned char *buffer, unsigned long size)
 {
@@ -232,7 +268,7 @@ TMV_PLATFORM_API TMV_PLATFORM_INLINE int tmv_platform_read(char *filename, unsig
         return 0;
     }
 
-    bytes_read = read(fd, file_buffer, st.st_size);
+    bytes_read = read(fd, file_buffer, (size_t)st.st_size);
     if (bytes_read != st.st_size)
     {
         close(fd);
@@ -240,12 +276,27 @@ TMV_PLATFORM_API TMV_PLATFORM_INLINE int tmv_platform_read(char *filename, unsig
     }
 
     file_buffer[st.st_size] = '\0'; /* Optional: null-terminate */
-    *file_buffer_size = st.st_size;
+    *file_buffer_size = (unsigned long)st.st_size;
 
     close(fd);
     return 1;
 }
 
+/* Microseconds since an arbitrary point in time, only the difference of two calls is meaningful.
+   The monotonic clock is only declared with _POSIX_C_SOURCE, strict C89 builds use the wall clock. */
+TMV_PLATFORM_API TMV_PLATFORM_INLINE double tmv_platform_time_us(void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec * 1000000.0 + (double)now.tv_nsec / 1000.0;
+#else
+    struct timeval now;
+    gettimeofday(&now, 0);
+    return (double)now.tv_sec * 1000000.0 + (double)now.tv_usec;
+#endif
+}
+
 #else
 #error "tmv_platform_io: unsupported operating system. please provide your own write binary file implementation"
 #endif
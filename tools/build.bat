@@ -4,7 +4,11 @@ set DEF_FLAGS_COMPILER=-std=c89 -pedantic -Wall -Wextra -Werror -Wconversion -Wv
 set DEF_FLAGS_LINKER=
 set SOURCE_NAME=tmv_tools
 
+REM Add -DTMV_PROFILE to print the work counters of the layouts
 cc -s -O2 %DEF_FLAGS_COMPILER% -o %SOURCE_NAME%.exe %SOURCE_NAME%.c %DEF_FLAGS_LINKER%
 %SOURCE_NAME%.exe --cmd=files_to_tmv --input=..                   --output=test.tmv
 %SOURCE_NAME%.exe --cmd=tmv_to_svg   --input=test.tmv             --output=test.svg
 %SOURCE_NAME%.exe --cmd=tmv_to_svg   --input=tmv_tools_binary.tmv --output=tmv_tools_binary.svg
+%SOURCE_NAME%.exe --cmd=files_to_svg --input=..                   --output=test_stream.svg
+%SOURCE_NAME%.exe --cmd=query_point  --input=test.tmv             --x=400 --y=150
+%SOURCE_NAME%.exe --cmd=files_to_tmv --input=..                   --output=test_trace.tmv --trace=test_trace.json
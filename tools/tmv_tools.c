@@ -13,6 +13,8 @@ LICENSE
 #include "tmv_tools.h" /* Developer api for tmv tools */
 #include "deps/clp.h"  /* Command Line Parser         SS*/
 
+#include <stdlib.h>
+
 typedef struct tmv_tools_memory
 {
   unsigned char *vgg_buffer;
@@ -27,15 +29,57 @@ typedef struct tmv_tools_memory
   unsigned long items_buffer_size;
   unsigned long items_buffer_capacity;
 
-  tmv_rect *rects_buffer;
-  unsigned long rects_buffer_size;
-  unsigned long rects_buffer_capacity;
+  /* Rects, index and sort scratch, sized by tmv_memory_requirements once the items are known */
+  void *model_buffer;
+  tmv_arena model_arena;
+
+  /* Work counters of the layouts, printed by builds with TMV_PROFILE */
+  tmv_profile profile;
+
+  /* Timed spans of the command, 0 unless --trace is given */
+  tmv_tools_trace_buffer *trace;
 
 } tmv_tools_memory;
 
+int tmv_tools_model_memory(tmv_tools_memory *memory, tmv_model *model, unsigned long flags)
+{
+  unsigned long size = tmv_memory_requirements(model->items_count, flags);
+
+  free(memory->model_buffer);
+  memory->model_buffer = malloc(size);
+
+  tmv_arena_init(&memory->model_arena, memory->model_buffer, size);
+
+  return tmv_model_arena_init(model, &memory->model_arena, flags);
+}
+
+/* Grows the SVG buffer to capacity bytes, it is sized by the output instead of up front */
+int tmv_tools_vgg_memory(tmv_tools_memory *memory, unsigned long capacity)
+{
+  unsigned char *buffer;
+
+  if (capacity <= memory->vgg_buffer_capacity)
+  {
+    return 1;
+  }
+
+  buffer = (unsigned char *)realloc(memory->vgg_buffer, capacity);
+
+  if (!buffer)
+  {
+    return 0;
+  }
+
+  memory->vgg_buffer = buffer;
+  memory->vgg_buffer_capacity = capacity;
+
+  return 1;
+}
+
 void tmv_tools_files_to_tmv(tmv_tools_memory *memory, char *input_path, char *output_tmv_file, tmv_rect area)
 {
   char *exts[] = {".c", ".h"};
+  unsigned long span;
 
   tmv_model model = {0};
 
@@ -46,12 +90,31 @@ void tmv_tools_files_to_tmv(tmv_tools_memory *memory, char *input_path, char *ou
       memory->items_buffer_capacity,
       -1,
       exts,
-      0);
+      0,
+      memory->trace);
 
   model.items = memory->items_buffer;
   model.items_count = memory->items_buffer_size;
-  model.rects = memory->rects_buffer;
-  model.rects_count = memory->rects_buffer_size;
+  model.rects_aligned = 1;
+  model.profile = &memory->profile;
+
+  /* Subtrees smaller than a pixel of the SVG are drawn as one rect */
+  model.min_side = 1;
+
+  /* The id index is built after sorting and used for the parent rect lookups */
+  if (!tmv_tools_model_memory(memory, &model, TMV_MEMORY_RECTS | TMV_MEMORY_SCRATCH | TMV_MEMORY_INDEX))
+  {
+    printf("[tmv_tools][memory] out of memory\n");
+    return;
+  }
+
+  /* The sort and every laid out group get a span */
+  tmv_tools_trace_model(&model, memory->trace);
+
+  /* Directories weigh the sum of their files */
+  span = tmv_tools_trace_begin(memory->trace, "aggregate", 0);
+  tmv_aggregate_weights(&model);
+  tmv_tools_trace_end(memory->trace, span);
 
   /* Build squarified recursive treemap view */
   tmv_squarify(
@@ -59,29 +122,171 @@ void tmv_tools_files_to_tmv(tmv_tools_memory *memory, char *input_path, char *ou
       area);
 
   /* (2) Decode tmv file to tmv_model and tmv_rect area */
+  span = tmv_tools_trace_begin(memory->trace, "encode", 0);
   tmv_binary_encode(memory->io_buffer, memory->io_buffer_capacity, &memory->io_buffer_size, &model, area);
+  tmv_tools_trace_end(memory->trace, span);
 
+  span = tmv_tools_trace_begin(memory->trace, "write", output_tmv_file);
   tmv_platform_write(output_tmv_file, memory->io_buffer, memory->io_buffer_size);
+  tmv_tools_trace_end(memory->trace, span);
+}
+
+void tmv_tools_files_to_svg(tmv_tools_memory *memory, char *input_path, char *output_svg_file, tmv_rect area)
+{
+  char *exts[] = {".c", ".h"};
+  unsigned long span;
+
+  tmv_model model = {0};
+
+  tmv_tools_scan_files(
+      input_path,
+      memory->items_buffer,
+      &memory->items_buffer_size,
+      memory->items_buffer_capacity,
+      -1,
+      exts,
+      0,
+      memory->trace);
+
+  model.items = memory->items_buffer;
+  model.items_count = memory->items_buffer_size;
+  model.min_side = 1;
+  model.profile = &memory->profile;
+
+  /* The rects are only a stack for the streamed groups, one per item always fits */
+  if (!tmv_tools_model_memory(memory, &model, TMV_MEMORY_RECTS | TMV_MEMORY_SCRATCH | TMV_MEMORY_INDEX))
+  {
+    printf("[tmv_tools][memory] out of memory\n");
+    return;
+  }
+
+  /* Sorted before the stream so the sort steps are traced, the stream finds the items sorted */
+  tmv_tools_trace_model(&model, memory->trace);
+  tmv_model_sort(&model);
+
+  span = tmv_tools_trace_begin(memory->trace, "aggregate", 0);
+  tmv_aggregate_weights(&model);
+  tmv_tools_trace_end(memory->trace, span);
+
+  /* Every item gets at most one rect */
+  if (!tmv_tools_vgg_memory(memory, tmv_tools_svg_capacity(model.items_count)))
+  {
+    printf("[tmv_tools][memory] out of memory\n");
+    return;
+  }
+
+  if (!tmv_tools_stream_to_svg(output_svg_file, memory->vgg_buffer, memory->vgg_buffer_capacity, &model, &area, memory->trace))
+  {
+    printf("[tmv_tools][svg] incomplete, %lu rects did not fit\n", model.rects_dropped);
+  }
 }
 
 void tmv_tools_tmv_to_svg(tmv_tools_memory *memory, char *input_tmv_file, char *output_svg_file)
 {
+  unsigned long span;
 
   tmv_model model = {0};
   tmv_rect area = {0};
 
   /* (1) Read the tmv file */
+  span = tmv_tools_trace_begin(memory->trace, "read", input_tmv_file);
   tmv_platform_read(input_tmv_file, memory->io_buffer, memory->io_buffer_capacity, &memory->io_buffer_size);
+  tmv_tools_trace_end(memory->trace, span);
 
   /* (2) Decode tmv file to tmv_model and tmv_rect area */
+  span = tmv_tools_trace_begin(memory->trace, "decode", 0);
   tmv_binary_decode(memory->io_buffer, memory->io_buffer_size, &model, &area);
+  tmv_tools_trace_end(memory->trace, span);
+
+  /* Index the decoded items so each rect finds its item in O(1) */
+  if (tmv_tools_model_memory(memory, &model, TMV_MEMORY_INDEX))
+  {
+    span = tmv_tools_trace_begin(memory->trace, "index", 0);
+    tmv_index_build(model.index, &model);
+    tmv_tools_trace_end(memory->trace, span);
+  }
 
   /* (3) Write the tmv_model as SVG */
-  tmv_tools_write_to_svg(output_svg_file, memory->vgg_buffer, memory->vgg_buffer_capacity, &model, &area);
+  if (!tmv_tools_vgg_memory(memory, tmv_tools_svg_capacity(model.rects_count)))
+  {
+    printf("[tmv_tools][memory] out of memory\n");
+    return;
+  }
+
+  tmv_tools_write_to_svg(output_svg_file, memory->vgg_buffer, memory->vgg_buffer_capacity, &model, &area, memory->trace);
 }
 
-#define TMV_TOOLS_FLAGS 3
-#include <stdlib.h>
+void tmv_tools_query_point(tmv_tools_memory *memory, char *input_tmv_file, tmv_real x, tmv_real y)
+{
+  tmv_model model = {0};
+  tmv_rect area = {0};
+  unsigned long path[64];
+  unsigned long depth;
+  unsigned long i;
+
+  tmv_platform_read(input_tmv_file, memory->io_buffer, memory->io_buffer_capacity, &memory->io_buffer_size);
+  tmv_binary_decode(memory->io_buffer, memory->io_buffer_size, &model, &area);
+
+  /* tmv files are written after a layout, the items are in the sorted order of tmv_squarify */
+  model.items_sorted = 1;
+
+  /* Emission order rects are looked up by id */
+  if (tmv_tools_model_memory(memory, &model, TMV_MEMORY_INDEX))
+  {
+    tmv_index_build(model.index, &model);
+  }
+
+  depth = tmv_hit_test(&model, x, y, path, TMV_ARRAY_SIZE(path));
+
+  if (depth == 0)
+  {
+    printf("[tmv_tools][query] nothing at (%lu, %lu)\n", (unsigned long)x, (unsigned long)y);
+    return;
+  }
+
+  if (depth > TMV_ARRAY_SIZE(path))
+  {
+    printf("[tmv_tools][query] depth %lu, only the first %lu levels and the deepest item are shown\n", depth, (unsigned long)TMV_ARRAY_SIZE(path));
+    depth = TMV_ARRAY_SIZE(path);
+  }
+
+  for (i = 0; i < depth; ++i)
+  {
+    tmv_item *item = &model.items[path[i]];
+    tmv_rect *rect = tmv_model_rect_at(&model, path[i]);
+
+    printf("[tmv_tools][query] %2lu id: %8ld, weight: %12.2f, rect: %8.2f %8.2f %8.2f %8.2f\n",
+           i,
+           item->id,
+           (double)item->weight,
+           (double)rect->x,
+           (double)rect->y,
+           (double)rect->width,
+           (double)rect->height);
+  }
+}
+
+#ifdef TMV_PROFILE
+void tmv_tools_profile_print(tmv_profile *profile)
+{
+  static const char *phases[TMV_PROFILE_PHASES] = {"depth", "sort", "offsets", "layout"};
+  int i;
+
+  printf("[tmv_tools][profile]    depth steps: %12lu\n", profile->depth_steps);
+  printf("[tmv_tools][profile]     sort moves: %12lu\n", profile->sort_moves);
+  printf("[tmv_tools][profile] parent lookups: %12lu\n", profile->parent_lookups);
+  printf("[tmv_tools][profile] group searches: %12lu\n", profile->group_searches);
+  printf("[tmv_tools][profile] row candidates: %12lu\n", profile->row_candidates);
+  printf("[tmv_tools][profile]           rows: %12lu\n", profile->rows);
+
+  for (i = 0; i < TMV_PROFILE_PHASES; ++i)
+  {
+    printf("[tmv_tools][profile] %7s cycles: %12.0f\n", phases[i], profile->cycles[i]);
+  }
+}
+#endif
+
+#define TMV_TOOLS_FLAGS 6
 
 TMV_TOOLS_API TMV_TOOLS_INLINE int tmv_tools_string_compare(const char *a, const char *b)
 {
@@ -111,19 +316,23 @@ TMV_TOOLS_API TMV_TOOLS_INLINE int tmv_tools_string_compare(const char *a, const
 
 int main(int argc, char **argv)
 {
-  unsigned long memory_vgg_capacity = 1024 * 1024 * 256;           /* 64 MB for SVG Buffer */
-  unsigned long memory_io_capacity = 1024 * 1024 * 32;             /* 32 MB for files      */
-  unsigned long memory_items_capacity = sizeof(tmv_item) * 200000; /* tmv_items            */
-  unsigned long memory_rects_capacity = sizeof(tmv_rect) * 200000; /* tmv_rects            */
+  unsigned long memory_io_capacity = 1024 * 1024 * 32;                 /* 32 MB for files      */
+  unsigned long memory_items_capacity = 200000;                        /* tmv_items, the rest is sized per model */
+  unsigned long memory_trace_capacity = 262144;                        /* Trace spans, one per directory and children group */
+  unsigned long flag_point_default = 0;
   tmv_rect area = {0, 0.0, 0.0, 800.0, 300.0};
 
   tmv_tools_memory memory = {0};
+  tmv_tools_trace_buffer trace = {0};
 
   clp_flag flags[TMV_TOOLS_FLAGS];
 
   char flag_command[32] = {0};
   char flag_input[128] = {0};
   char flag_output[128] = {0};
+  unsigned long flag_x = 0;
+  unsigned long flag_y = 0;
+  char flag_trace[128] = {0};
 
   flags[0].name = "cmd";
   flags[0].value = flag_command;
@@ -143,6 +352,24 @@ int main(int argc, char **argv)
   flags[2].maxlen = sizeof(flag_output);
   flags[2].type = FLAG_STRING;
 
+  flags[3].name = "x";
+  flags[3].value = &flag_x;
+  flags[3].def_value = &flag_point_default;
+  flags[3].maxlen = 0;
+  flags[3].type = FLAG_UNSIGNED_LONG;
+
+  flags[4].name = "y";
+  flags[4].value = &flag_y;
+  flags[4].def_value = &flag_point_default;
+  flags[4].maxlen = 0;
+  flags[4].type = FLAG_UNSIGNED_LONG;
+
+  flags[5].name = "trace";
+  flags[5].value = flag_trace;
+  flags[5].def_value = "";
+  flags[5].maxlen = sizeof(flag_trace);
+  flags[5].type = FLAG_STRING;
+
   /* Parse the command line arguments */
   clp_process(flags, CLP_ARRAY_SIZE(flags), argv, argc);
 
@@ -150,15 +377,19 @@ int main(int argc, char **argv)
   printf("[tmv_tools][cli]  input: '%s'\n", flag_input);
   printf("[tmv_tools][cli] output: '%s'\n", flag_output);
 
-  /* Initialize memory buffers */
-  memory.vgg_buffer = malloc(memory_vgg_capacity);
-  memory.vgg_buffer_capacity = memory_vgg_capacity;
+  /* Initialize memory buffers, the SVG buffer is sized by its output, see tmv_tools_vgg_memory */
   memory.io_buffer = malloc(memory_io_capacity);
   memory.io_buffer_capacity = memory_io_capacity;
-  memory.items_buffer = malloc(memory_items_capacity);
+  memory.items_buffer = malloc(sizeof(tmv_item) * memory_items_capacity);
   memory.items_buffer_capacity = memory_items_capacity;
-  memory.rects_buffer = malloc(memory_rects_capacity);
-  memory.rects_buffer_capacity = memory_rects_capacity;
+
+  /* --trace=out.json records the spans of the command for chrome://tracing or Perfetto */
+  if (flag_trace[0])
+  {
+    trace.events = malloc(sizeof(tmv_tools_trace_event) * memory_trace_capacity);
+    trace.capacity = trace.events ? memory_trace_capacity : 0;
+    memory.trace = &trace;
+  }
 
   if (tmv_tools_string_compare(flag_command, "tmv_to_svg") == 0)
   {
@@ -168,11 +399,35 @@ int main(int argc, char **argv)
   {
     tmv_tools_files_to_tmv(&memory, flag_input, flag_output, area);
   }
+  else if (tmv_tools_string_compare(flag_command, "files_to_svg") == 0)
+  {
+    tmv_tools_files_to_svg(&memory, flag_input, flag_output, area);
+  }
+  else if (tmv_tools_string_compare(flag_command, "query_point") == 0)
+  {
+    tmv_tools_query_point(&memory, flag_input, (tmv_real)flag_x, (tmv_real)flag_y);
+  }
+
+#ifdef TMV_PROFILE
+  tmv_tools_profile_print(&memory.profile);
+#endif
+
+  /* The SVG is written, its buffer holds the trace JSON */
+  if (memory.trace)
+  {
+    if (!tmv_tools_vgg_memory(&memory, tmv_tools_trace_capacity(&trace, 1)) ||
+        !tmv_tools_trace_write(flag_trace, memory.vgg_buffer, memory.vgg_buffer_capacity, &trace, 1))
+    {
+      printf("[tmv_tools][trace] could not write '%s'\n", flag_trace);
+    }
+    printf("[tmv_tools][trace] %lu spans, %lu dropped\n", trace.count, trace.dropped);
+  }
 
   free(memory.vgg_buffer);
   free(memory.io_buffer);
   free(memory.items_buffer);
-  free(memory.rects_buffer);
+  free(memory.model_buffer);
+  free(trace.events);
 
   printf("[tmv_tools][cli] status: ok\n\n");
 
@@ -32,14 +32,14 @@ TMV_TOOLS_API TMV_TOOLS_INLINE void tmv_tools_print_model(tmv_model *model, tmv_
     printf("# TMV Model Information                      #\n");
     printf("##############################################\n");
     printf("[area]                    id: %16lu\n", area.id);
-    printf("[area]                     x: %16f\n", area.x);
-    printf("[area]                     y: %16f\n", area.y);
-    printf("[area]                 width: %16f\n", area.width);
-    printf("[area]                height: %16f\n", area.height);
+    printf("[area]                     x: %16f\n", (double)area.x);
+    printf("[area]                     y: %16f\n", (double)area.y);
+    printf("[area]                 width: %16f\n", (double)area.width);
+    printf("[area]                height: %16f\n", (double)area.height);
     printf("\n");
-    printf("[stats]           weigth_min: %16f\n", model->stats.weigth_min);
-    printf("[stats]           weigth_max: %16f\n", model->stats.weigth_max);
-    printf("[stats]           weigth_sum: %16f\n", model->stats.weigth_sum);
+    printf("[stats]           weigth_min: %16f\n", (double)model->stats.weigth_min);
+    printf("[stats]           weigth_max: %16f\n", (double)model->stats.weigth_max);
+    printf("[stats]           weigth_sum: %16f\n", (double)model->stats.weigth_sum);
     printf("[stats]                count: %16lu\n", model->stats.count);
     printf("\n");
     printf("[model]          items_count: %16lu\n", model->items_count);
@@ -62,7 +62,7 @@ TMV_TOOLS_API TMV_TOOLS_INLINE void tmv_tools_print_items(tmv_model *model)
             i,
             item.id,
             item.parent_id,
-            item.weight,
+            (double)item.weight,
             item.children_count,
             item.children_offset_index);
     }
@@ -75,7 +75,7 @@ TMV_TOOLS_API TMV_TOOLS_INLINE void tmv_tools_print_rects(tmv_model *model)
     for (i = 0; i < model->rects_count; ++i)
     {
         tmv_rect rect = model->rects[i];
-        printf("[rect][%4lu] id: %5li, x: %12f, y: %12f, width: %12f, height: %12f\n", i, rect.id, rect.x, rect.y, rect.width, rect.height);
+        printf("[rect][%4lu] id: %5li, x: %12f, y: %12f, width: %12f, height: %12f\n", i, rect.id, (double)rect.x, (double)rect.y, (double)rect.width, (double)rect.height);
     }
     printf("\n");
 }
@@ -97,11 +97,239 @@ TMV_TOOLS_API TMV_TOOLS_INLINE double tmv_tools_ll_to_double(unsigned long lo, u
     return result;
 }
 
-TMV_TOOLS_API TMV_TOOLS_INLINE void tmv_tools_write_to_svg(char *filename, unsigned char *vgg_buffer, unsigned long vgg_buffer_capacity, tmv_model *model, tmv_rect *area)
+#define TMV_TOOLS_TRACE_DETAIL 64
+#define TMV_TOOLS_TRACE_NONE ((unsigned long)-1)
+
+/* A timed span of the tools pipeline */
+typedef struct tmv_tools_trace_event
+{
+    const char *name;                    /* The span name, a string literal */
+    char detail[TMV_TOOLS_TRACE_DETAIL]; /* The directory or item of the span, written as args.detail */
+    double begin_us;
+    double duration_us; /* -1 while the span is open */
+
+} tmv_tools_trace_event;
+
+/* The spans recorded by one thread. Only the owning thread appends to its buffer, so recording needs
+   no locks, the buffers of all threads are merged by tmv_tools_trace_write. */
+typedef struct tmv_tools_trace_buffer
+{
+    tmv_tools_trace_event *events;
+    unsigned long capacity;
+    unsigned long count;
+    unsigned long dropped; /* Spans that did not fit into the events */
+    unsigned long thread_id;
+    unsigned long open; /* The span opened by tmv_tools_trace_span */
+
+} tmv_tools_trace_buffer;
+
+/* Opens a span, returns its handle for tmv_tools_trace_end. Without a trace nothing is recorded. */
+TMV_TOOLS_API TMV_TOOLS_INLINE unsigned long tmv_tools_trace_begin(tmv_tools_trace_buffer *trace, const char *name, const char *detail)
 {
+    tmv_tools_trace_event *event;
+    unsigned long length = 0;
     unsigned long i;
 
+    if (!trace)
+    {
+        return TMV_TOOLS_TRACE_NONE;
+    }
+
+    if (trace->count >= trace->capacity)
+    {
+        trace->dropped++;
+        return TMV_TOOLS_TRACE_NONE;
+    }
+
+    event = &trace->events[trace->count];
+    event->name = name;
+
+    /* Long paths keep their end, the directory name */
+    while (detail && detail[length])
+    {
+        ++length;
+    }
+    detail += (length >= TMV_TOOLS_TRACE_DETAIL) ? length - (TMV_TOOLS_TRACE_DETAIL - 1) : 0;
+    for (i = 0; i < length && i < TMV_TOOLS_TRACE_DETAIL - 1; ++i)
+    {
+        event->detail[i] = detail[i];
+    }
+    event->detail[i] = '\0';
+
+    event->duration_us = -1.0;
+    event->begin_us = tmv_platform_time_us();
+
+    return trace->count++;
+}
+
+TMV_TOOLS_API TMV_TOOLS_INLINE void tmv_tools_trace_end(tmv_tools_trace_buffer *trace, unsigned long span)
+{
+    if (!trace || span == TMV_TOOLS_TRACE_NONE)
+    {
+        return;
+    }
+
+    trace->events[span].duration_us = tmv_platform_time_us() - trace->events[span].begin_us;
+}
+
+TMV_TOOLS_API TMV_TOOLS_INLINE void tmv_tools_json_put_string(vgg_svg_writer *w, const char *s)
+{
+    vgg_svg_putc(w, '"');
+
+    for (; *s; ++s)
+    {
+        if (*s == '"' || *s == '\\')
+        {
+            vgg_svg_putc(w, '\\');
+        }
+        vgg_svg_putc(w, ((unsigned char)*s < 0x20) ? ' ' : *s);
+    }
+
+    vgg_svg_putc(w, '"');
+}
+
+/* Writes the closed spans of all buffers as Chrome trace event JSON, the times start at the first span.
+   Returns 0 if the JSON did not fit into buffer or could not be written. */
+TMV_TOOLS_API TMV_TOOLS_INLINE int tmv_tools_trace_write(char *filename, unsigned char *buffer, unsigned long buffer_capacity, tmv_tools_trace_buffer *traces, unsigned long traces_count)
+{
     vgg_svg_writer w;
+    double origin = -1.0;
+    int first = 1;
+    unsigned long t;
+    unsigned long i;
+
+    w.buffer = buffer;
+    w.capacity = (int)buffer_capacity;
+    w.length = 0;
+
+    for (t = 0; t < traces_count; ++t)
+    {
+        for (i = 0; i < traces[t].count; ++i)
+        {
+            if (origin < 0.0 || traces[t].events[i].begin_us < origin)
+            {
+                origin = traces[t].events[i].begin_us;
+            }
+        }
+    }
+
+    vgg_svg_puts(&w, "{\"traceEvents\":[");
+
+    for (t = 0; t < traces_count; ++t)
+    {
+        for (i = 0; i < traces[t].count; ++i)
+        {
+            tmv_tools_trace_event *event = &traces[t].events[i];
+
+            if (event->duration_us < 0.0)
+            {
+                continue;
+            }
+
+            vgg_svg_puts(&w, first ? "\n{\"name\":" : ",\n{\"name\":");
+            tmv_tools_json_put_string(&w, event->name);
+            vgg_svg_puts(&w, ",\"cat\":\"tmv_tools\",\"ph\":\"X\",\"pid\":1,\"tid\":");
+            vgg_svg_put_uint(&w, (unsigned int)traces[t].thread_id);
+            vgg_svg_puts(&w, ",\"ts\":");
+            vgg_svg_put_double(&w, event->begin_us - origin);
+            vgg_svg_puts(&w, ",\"dur\":");
+            vgg_svg_put_double(&w, event->duration_us);
+
+            if (event->detail[0])
+            {
+                vgg_svg_puts(&w, ",\"args\":{\"detail\":");
+                tmv_tools_json_put_string(&w, event->detail);
+                vgg_svg_putc(&w, '}');
+            }
+
+            vgg_svg_putc(&w, '}');
+            first = 0;
+        }
+    }
+
+    vgg_svg_puts(&w, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+    if (w.length >= w.capacity)
+    {
+        return 0;
+    }
+
+    return tmv_platform_write(filename, w.buffer, (unsigned long)w.length);
+}
+
+/* A tmv_span_hook that records the sort and layout steps of a model into the trace buffer passed as user_data */
+TMV_TOOLS_API TMV_TOOLS_INLINE void tmv_tools_trace_span(void *user_data, const char *name, tmv_item *item, int begin)
+{
+    tmv_tools_trace_buffer *trace = (tmv_tools_trace_buffer *)user_data;
+    char id_buffer[32];
+
+    if (begin)
+    {
+        trace->open = tmv_tools_trace_begin(trace, name, item ? vgg_ltoa(item->id, id_buffer) : 0);
+    }
+    else
+    {
+        tmv_tools_trace_end(trace, trace->open);
+        trace->open = TMV_TOOLS_TRACE_NONE;
+    }
+}
+
+/* Traces the sort steps and each laid out group of the model, nothing without a trace */
+TMV_TOOLS_API TMV_TOOLS_INLINE void tmv_tools_trace_model(tmv_model *model, tmv_tools_trace_buffer *trace)
+{
+    model->span = trace ? tmv_tools_trace_span : 0;
+    model->span_user_data = trace;
+}
+
+#define TMV_TOOLS_SVG_BYTES 256         /* The svg start and end tags */
+#define TMV_TOOLS_SVG_RECT_BYTES 256    /* The longest rect element, four coordinates, the id, fill and weight */
+#define TMV_TOOLS_TRACE_EVENT_BYTES 512 /* The longest trace event, the detail escaped */
+
+/* The SVG buffer size in bytes that fits rects_count rects */
+TMV_TOOLS_API TMV_TOOLS_INLINE unsigned long tmv_tools_svg_capacity(unsigned long rects_count)
+{
+    return TMV_TOOLS_SVG_BYTES + rects_count * TMV_TOOLS_SVG_RECT_BYTES;
+}
+
+/* The buffer size in bytes tmv_tools_trace_write needs for the traces */
+TMV_TOOLS_API TMV_TOOLS_INLINE unsigned long tmv_tools_trace_capacity(tmv_tools_trace_buffer *traces, unsigned long traces_count)
+{
+    unsigned long count = 0;
+    unsigned long t;
+
+    for (t = 0; t < traces_count; ++t)
+    {
+        count += traces[t].count;
+    }
+
+    return TMV_TOOLS_SVG_BYTES + count * TMV_TOOLS_TRACE_EVENT_BYTES;
+}
+
+TMV_TOOLS_API TMV_TOOLS_INLINE void tmv_tools_svg_add_rect(vgg_svg_writer *w, tmv_item *item, tmv_rect rect, tmv_stats *stats)
+{
+    char d1_buffer[32];
+
+    vgg_rect r = {0};
+    vgg_data_field data_fields[1];
+
+    data_fields[0] = vgg_data_field_create_double("weight", (double)item->weight, 3, d1_buffer);
+
+    r.header.id = (unsigned long)rect.id;
+    r.header.type = VGG_TYPE_RECT;
+    r.header.color_fill = vgg_color_map_linear(item->weight, stats->weigth_min, stats->weigth_max, color_start, color_end);
+    r.header.data_fields = data_fields;
+    r.header.data_fields_count = TMV_ARRAY_SIZE(data_fields);
+    r.x = rect.x;
+    r.y = rect.y;
+    r.width = rect.width;
+    r.height = rect.height;
+
+    vgg_svg_element_add(w, (vgg_header *)&r);
+}
+
+TMV_TOOLS_API TMV_TOOLS_INLINE void tmv_tools_svg_start(vgg_svg_writer *w, unsigned char *vgg_buffer, unsigned long vgg_buffer_capacity, tmv_rect *area)
+{
+    unsigned long i;
 
     /* Zero vgg_buffer */
     for (i = 0; i < vgg_buffer_capacity; ++i)
@@ -109,40 +337,112 @@ TMV_TOOLS_API TMV_TOOLS_INLINE void tmv_tools_write_to_svg(char *filename, unsig
         vgg_buffer[i] = 0;
     }
 
-    w.buffer = vgg_buffer;
-    w.capacity = (int)vgg_buffer_capacity;
-    w.length = 0;
+    w->buffer = vgg_buffer;
+    w->capacity = (int)vgg_buffer_capacity;
+    w->length = 0;
+
+    vgg_svg_start(w, "tmvsvg", area->width, area->height);
+}
+
+TMV_TOOLS_API TMV_TOOLS_INLINE void tmv_tools_write_to_svg(char *filename, unsigned char *vgg_buffer, unsigned long vgg_buffer_capacity, tmv_model *model, tmv_rect *area, tmv_tools_trace_buffer *trace)
+{
+    unsigned long i;
+    unsigned long span;
+
+    vgg_svg_writer w;
+
+    span = tmv_tools_trace_begin(trace, "svg", 0);
 
-    vgg_svg_start(&w, "tmvsvg", area->width, area->height);
+    tmv_tools_svg_start(&w, vgg_buffer, vgg_buffer_capacity, area);
 
     for (i = 0; i < model->rects_count; ++i)
     {
         tmv_rect rect = model->rects[i];
-        tmv_item *item = tmv_find_item_by_id(model->items, model->items_count, rect.id);
 
-        char d1_buffer[32];
+        /* Aligned rects are zipped with the items, otherwise joined by id */
+        tmv_item *item = model->rects_aligned ? &model->items[i] : tmv_model_find_item_by_id(model, rect.id);
+
+        if (!item || item->id != rect.id)
+        {
+            /* Item without a rect */
+            continue;
+        }
+
+        tmv_tools_svg_add_rect(&w, item, rect, &model->stats);
+    }
+
+    vgg_svg_end(&w);
+
+    tmv_tools_trace_end(trace, span);
+
+    span = tmv_tools_trace_begin(trace, "write", filename);
+    tmv_platform_write(filename, w.buffer, (unsigned long)w.length);
+    tmv_tools_trace_end(trace, span);
+}
+
+typedef struct tmv_tools_svg_stream
+{
+    vgg_svg_writer *writer;
+    tmv_stats stats; /* The color range, known before the first rect arrives */
+
+} tmv_tools_svg_stream;
+
+/* tmv_rect_sink that writes each laid out group straight into the SVG */
+TMV_TOOLS_API TMV_TOOLS_INLINE int tmv_tools_svg_sink(void *user_data, tmv_rect *rects, tmv_item *items, unsigned long count)
+{
+    tmv_tools_svg_stream *stream = (tmv_tools_svg_stream *)user_data;
+    unsigned long i;
+
+    for (i = 0; i < count; ++i)
+    {
+        tmv_tools_svg_add_rect(stream->writer, &items[i], rects[i], &stream->stats);
+    }
+
+    /* Stop once the SVG buffer is full */
+    return stream->writer->length < stream->writer->capacity;
+}
+
+/* Lays out an emission order model and writes it as SVG without keeping the rects, model->rects
+   only needs room for the sibling groups on the deepest path. Returns 0 if they did not fit. */
+TMV_TOOLS_API TMV_TOOLS_INLINE int tmv_tools_stream_to_svg(char *filename, unsigned char *vgg_buffer, unsigned long vgg_buffer_capacity, tmv_model *model, tmv_rect *area, tmv_tools_trace_buffer *trace)
+{
+    unsigned long i;
+    unsigned long span;
+    int result;
 
-        vgg_rect r = {0};
-        vgg_data_field data_fields[1];
+    vgg_svg_writer w;
+    tmv_tools_svg_stream stream;
 
-        data_fields[0] = vgg_data_field_create_double("weight", item->weight, 3, d1_buffer);
+    stream.writer = &w;
 
-        r.header.id = (unsigned long)rect.id;
-        r.header.type = VGG_TYPE_RECT;
-        r.header.color_fill = vgg_color_map_linear(item->weight, model->stats.weigth_min, model->stats.weigth_max, color_start, color_end);
-        r.header.data_fields = data_fields;
-        r.header.data_fields_count = TMV_ARRAY_SIZE(data_fields);
-        r.x = rect.x;
-        r.y = rect.y;
-        r.width = rect.width;
-        r.height = rect.height;
+    /* The colors are spread over the leaf weights which are known once the items are sorted */
+    tmv_squarify_prepare(model);
+    tmv_stats_reset(&stream.stats);
 
-        vgg_svg_element_add(&w, (vgg_header *)&r);
+    for (i = 0; i < model->items_count; ++i)
+    {
+        if (model->items[i].children_count == 0)
+        {
+            tmv_stats_add(&stream.stats, model->items[i].weight);
+        }
     }
 
+    /* The groups are written as they are laid out, so layout and SVG generation share one span */
+    span = tmv_tools_trace_begin(trace, "layout and svg", 0);
+
+    tmv_tools_svg_start(&w, vgg_buffer, vgg_buffer_capacity, area);
+
+    result = tmv_squarify_stream(model, *area, tmv_tools_svg_sink, &stream);
+
     vgg_svg_end(&w);
 
+    tmv_tools_trace_end(trace, span);
+
+    span = tmv_tools_trace_begin(trace, "write", filename);
     tmv_platform_write(filename, w.buffer, (unsigned long)w.length);
+    tmv_tools_trace_end(trace, span);
+
+    return result;
 }
 
 TMV_TOOLS_API TMV_TOOLS_INLINE int tmv_tools_file_has_wanted_extension(const char *filename, char **wanted_exts, unsigned long count)
@@ -182,18 +482,23 @@ TMV_TOOLS_API TMV_TOOLS_INLINE int tmv_tools_scan_files(
     unsigned long items_capacity,
     long parent_id,
     char **wanted_exts,
-    unsigned long wanted_exts_count)
+    unsigned long wanted_exts_count,
+    tmv_tools_trace_buffer *trace)
 {
     char search_path[TMV_PLATFORM_WIN32_MAX_PATH];
     TMV_PLATFORM_WIN32_FIND_DATAA ffd;
     void *hFind = TMV_PLATFORM_WIN32_INVALID_HANDLE;
     int len = 0;
+    unsigned long span;
 
     if (*items_count >= items_capacity)
     {
         return 1;
     }
 
+    /* One span per directory, nested like the directories */
+    span = tmv_tools_trace_begin(trace, "scan", path);
+
     while (path[len] != '\0' && len < TMV_PLATFORM_WIN32_MAX_PATH - 3)
     {
         search_path[len] = path[len];
@@ -209,6 +514,7 @@ TMV_TOOLS_API TMV_TOOLS_INLINE int tmv_tools_scan_files(
     hFind = FindFirstFileA(search_path, &ffd);
     if (hFind == TMV_PLATFORM_WIN32_INVALID_HANDLE)
     {
+        tmv_tools_trace_end(trace, span);
         return 1;
     }
 
@@ -245,6 +551,7 @@ TMV_TOOLS_API TMV_TOOLS_INLINE int tmv_tools_scan_files(
         if (*items_count >= items_capacity)
         {
             FindClose(hFind);
+            tmv_tools_trace_end(trace, span);
             return 1;
         }
 
@@ -257,38 +564,22 @@ TMV_TOOLS_API TMV_TOOLS_INLINE int tmv_tools_scan_files(
 
         if (ffd.dwFileAttributes & TMV_PLATFORM_WIN32_FILE_ATTRIBUTE_DIRECTORY)
         {
-            unsigned long before;
-            unsigned long after;
-            double total;
-            unsigned long j;
-
             unsigned long dir_index = *items_count;
             item->weight = 0.0;
 
             ++(*items_count);
 
-            before = *items_count;
+            tmv_tools_scan_files(full_path, items_buffer, items_count, items_capacity, (long)dir_index, wanted_exts, wanted_exts_count, trace);
 
-            tmv_tools_scan_files(full_path, items_buffer, items_count, items_capacity, (long)dir_index, wanted_exts, wanted_exts_count);
-
-            after = *items_count;
-            total = 0.0;
-
-            for (j = before; j < after; ++j)
-            {
-                if (items_buffer[j].parent_id == (long)dir_index)
-                {
-                    total += items_buffer[j].weight;
-                }
-            }
-            if (total == 0.0)
+            /* The directory weighs the total of its wanted files by now, rewind the item count to skip
+               a directory without any. The total is passed up to the parent directory. */
+            if (items_buffer[dir_index].weight <= (tmv_real)0)
             {
-                /* Rewind the item count to skip empty directory */
                 *items_count = dir_index;
             }
-            else
+            else if (parent_id >= 0)
             {
-                items_buffer[dir_index].weight = total;
+                items_buffer[parent_id].weight += items_buffer[dir_index].weight;
             }
         }
         else
@@ -296,8 +587,14 @@ TMV_TOOLS_API TMV_TOOLS_INLINE int tmv_tools_scan_files(
             double weight = tmv_tools_ll_to_double(ffd.nFileSizeLow, ffd.nFileSizeHigh);
             if (weight > 0.0 && (wanted_exts_count == 0 || tmv_tools_file_has_wanted_extension(ffd.cFileName, wanted_exts, wanted_exts_count)))
             {
-                item->weight = weight;
+                item->weight = (tmv_real)weight;
                 ++(*items_count);
+
+                /* Item ids are buffer positions, so the parent directory is items_buffer[parent_id] */
+                if (parent_id >= 0)
+                {
+                    items_buffer[parent_id].weight += item->weight;
+                }
             }
         }
 
@@ -305,6 +602,8 @@ TMV_TOOLS_API TMV_TOOLS_INLINE int tmv_tools_scan_files(
 
     FindClose(hFind);
 
+    tmv_tools_trace_end(trace, span);
+
     return 0;
 }
 